@@ -0,0 +1,158 @@
+#!/bin/sh
+#
+# Loopback performance regression suite, run by 'make bench'
+#
+# Starts two flowgrindd instances on 127.0.0.1, runs a fixed matrix of
+# tests through the controller and writes the results as "case.metric value"
+# lines into $BENCH_RESULTS. Every metric that has a direction is compared
+# against $BENCH_BASELINE, the script fails if any of them is worse than the
+# baseline by more than $BENCH_TOLERANCE percent. Without a baseline the
+# results of the run become the baseline.
+#
+# Environment:
+#   BENCH_BINDIR     directory of flowgrind and flowgrindd (default: src)
+#   BENCH_RESULTS    results file (default: bench-results.txt)
+#   BENCH_BASELINE   baseline file (default: bench-baseline.txt)
+#   BENCH_TOLERANCE  allowed regression in percent (default: 10)
+#   BENCH_DURATION   duration of each test in seconds (default: 5)
+#   BENCH_PORT       first of the two control ports (default: 15999)
+#   BENCH_UPDATE     if set to 1, replace the baseline by the results
+
+SCRIPTDIR=$(dirname $(readlink -f $0))
+
+BINDIR=${BENCH_BINDIR:-$SCRIPTDIR/../src}
+RESULTS=${BENCH_RESULTS:-bench-results.txt}
+BASELINE=${BENCH_BASELINE:-bench-baseline.txt}
+TOLERANCE=${BENCH_TOLERANCE:-10}
+DURATION=${BENCH_DURATION:-5}
+PORT=${BENCH_PORT:-15999}
+
+FLOWGRIND=$BINDIR/flowgrind
+FLOWGRINDD=$BINDIR/flowgrindd
+
+for BIN in $FLOWGRIND $FLOWGRINDD; do
+    if [ ! -x $BIN ]; then
+        echo "$BIN not found. Please run 'make' first."
+        exit 1
+    fi
+done
+
+WORKDIR=$(mktemp -d)
+DAEMONS=""
+
+cleanup() {
+    [ -n "$DAEMONS" ] && kill $DAEMONS 2>/dev/null
+    wait 2>/dev/null
+    rm -rf $WORKDIR
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+# Source and destination run in separate daemons, so each side of a flow
+# has a thread and a CPU of its own
+for P in $PORT $(($PORT + 1)); do
+    $FLOWGRINDD -d -b 127.0.0.1 -p $P 2>$WORKDIR/flowgrindd-$P.log &
+    DAEMONS="$DAEMONS $!"
+done
+sleep 1
+
+HOSTS="-H s=127.0.0.1/127.0.0.1:$PORT,d=127.0.0.1/127.0.0.1:$(($PORT + 1))"
+
+: > $RESULTS
+
+# Run a single test and append its metrics to the results
+#   $1      name of the test
+#   $2...   additional options of the controller
+bench() {
+    NAME=$1
+    shift
+    OUT=$WORKDIR/$NAME.log
+
+    echo "running $NAME"
+    if ! $FLOWGRIND $HOSTS -J 1 -T s=$DURATION -i 0.1 -c rtt --daemon-stats \
+         "$@" >$OUT 2>&1; then
+        echo "$NAME failed, see output below"
+        cat $OUT
+        exit 1
+    fi
+
+    # Sum of the goodput of all flows, source view
+    sed -n 's/^# *[0-9]* S:.*through = \([0-9.]*\)\/.*/\1/p' $OUT |
+        awk -v n=$NAME '{ s += $1 } END { printf "%s.throughput %.3f\n", n, s }' >> $RESULTS
+
+    # Percentiles of the mean RTT of all report intervals, in ms
+    awk '$1 == "S" && $4 ~ /^[0-9.]+$/ { print $4 }' $OUT | sort -g |
+        awk -v n=$NAME '{ v[NR] = $1 }
+            END {
+                if (!NR)
+                    exit
+                split("50 90 99", p, " ")
+                for (i = 1; i <= 3; i++) {
+                    r = int(NR * p[i] / 100 + 0.5)
+                    if (r < 1) r = 1
+                    printf "%s.rtt_p%s %.3f\n", n, p[i], v[r]
+                }
+            }' >> $RESULTS
+
+    # CPU utilization of the daemon threads, the same for all flows of a
+    # daemon
+    for SIDE in S D; do
+        sed -n "s/^# *[0-9]* $SIDE:.*cpu = \([0-9.]*\)%.*/\1/p" $OUT | head -n 1 |
+            awk -v n=$NAME -v s=$SIDE '{ printf "%s.cpu_%s %.1f\n", n, s == "S" ? "source" : "destination", $1 }' >> $RESULTS
+    done
+
+    # Event loop counters of both daemons
+    sed -n 's/^# .*: \([0-9]*\) loop iterations,.*, \([0-9]*\) syscalls.*/\1 \2/p' $OUT |
+        awk -v n=$NAME '{ i += $1; s += $2 }
+            END { printf "%s.loop_iterations %d\n%s.syscalls %d\n", n, i, n, s }' >> $RESULTS
+}
+
+bench bulk-1 -n 1
+bench bulk-16 -n 16
+bench bulk-256 -n 256
+bench request-response -n 1 -G s=q,C,64 -G s=p,C,64
+# Throughput versus latency of pipelined transactions
+for DEPTH in 1 8 64; do
+    bench pipeline-$DEPTH -n 1 -G s=q,C,64 -G s=p,C,64 --pipeline s=$DEPTH
+done
+bench small-blocks -n 1 -S s=64
+bench small-blocks-batched -n 1 -S s=64 --write-batch s=64
+bench random-payload -n 1 --payload s=random
+bench rate-limited -n 4 -R s=100Mb
+bench short-flows -n 1 -G s=a,E,0.01 -G s=f,P,1.2,10000
+bench trafgen -n 4 -G s=q,N,2000,50 -G s=p,N,2000,50 -G s=g,U,0.0005,0.001
+
+echo "results written to $RESULTS"
+
+if [ "$BENCH_UPDATE" = "1" ] || [ ! -f $BASELINE ]; then
+    cp $RESULTS $BASELINE
+    echo "baseline written to $BASELINE"
+    exit 0
+fi
+
+# Throughput must not drop, RTT and CPU must not rise. Loop counters depend
+# on the throughput and are recorded for reference only
+awk -v tol=$TOLERANCE '
+    NR == FNR { base[$1] = $2; next }
+    ($1 in base) {
+        dir = 0
+        if ($1 ~ /\.throughput$/)
+            dir = 1
+        else if ($1 ~ /\.(rtt_p[0-9]+|cpu_[a-z]+)$/)
+            dir = -1
+        if (!dir || base[$1] <= 0)
+            next
+        change = 100 * ($2 - base[$1]) / base[$1]
+        status = "ok"
+        if (dir * change < -tol) {
+            status = "REGRESSION"
+            failed++
+        }
+        printf "%-36s %12.3f %12.3f %+8.1f%%  %s\n", $1, base[$1], $2, change, status
+    }
+    END {
+        if (failed) {
+            printf "%d metrics regressed by more than %s%%\n", failed, tol
+            exit 1
+        }
+    }' $BASELINE $RESULTS
@@ -30,6 +30,8 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <stdint.h>
+
 #include "gitversion.h"
 
 #ifdef GITVERSION
@@ -42,7 +44,7 @@
 #endif /* GITVERSION */
 
 /** XML-RPC API version in integer representation */
-#define FLOWGRIND_API_VERSION 3
+#define FLOWGRIND_API_VERSION 4
 
 /** Daemon's default listen port */
 #define DEFAULT_LISTEN_PORT 5999
@@ -50,6 +52,9 @@
 /** Maximal number of parallel flows */
 #define MAX_FLOWS 2048
 
+/** Maximal number of request blocks written with a single call */
+#define MAX_WRITE_BATCH 64
+
 /* XXX add a brief description doxygen */
 #define MAX_EXTRA_SOCKET_OPTIONS 10
 
@@ -85,7 +90,9 @@ enum interval_type {
 	/** Intermediated interval report */
 	INTERVAL = 0,
 	/** Final report */
-	FINAL
+	FINAL,
+	/** Completion of a flow spawned by the dynamic flow arrival process */
+	COMPLETION
 };
 
 /* XXX add a brief description doxygen (no underscore for enum) */
@@ -116,6 +123,19 @@ enum distributions {
 	LOGNORMAL
 };
 
+/** Content of the payload of request blocks (option --payload) */
+enum payload_type {
+	/** Zeros, or enumerated bytes with option -E */
+	PAYLOAD_ZERO = 0,
+	/** Random, incompressible data */
+	PAYLOAD_RANDOM,
+	/** Random data interleaved with zeros, compressible by a given
+	 * ratio */
+	PAYLOAD_COMPRESSIBLE,
+	/** Content of a file on the host of the daemon */
+	PAYLOAD_FILE,
+};
+
 /** Flowgrind's data block layout */
 struct _block {
 	/** Size of our request or response block */
@@ -128,10 +148,15 @@ struct _block {
 	 * -1 indicates this is a response block (needed for parsing data) */
 	int32_t request_block_size;
 
-	/** Sending timestap for calculating delay and RTT */
+	/** Sending timestap (wall-clock) for calculating delay */
 	struct timespec data;
-	/** Used to access 64bit timespec on 32bit arch */
+	/** Sending timestamp (monotonic) for calculating RTT. Used to access
+	 * 64bit timespec on 32bit arch */
 	struct timespec data2;
+
+	/** Id of the transaction. Counts the request blocks that request a
+	 * response, a response block carries the id of its request */
+	uint32_t transaction_id;
 };
 
 /* XXX add a brief description doxygen */
@@ -149,6 +174,16 @@ struct _flow_settings {
 	double delay[2];
 	double duration[2];
 
+	/** Stop sending after this amount of bytes (option -Z, 0 = no limit) */
+#ifdef HAVE_UNSIGNED_LONG_LONG_INT
+	unsigned long long write_bytes;
+#else
+	long write_bytes;
+#endif /* HAVE_UNSIGNED_LONG_LONG_INT */
+	/** Stop sending after this amount of request blocks (option -Z, 0 = no
+	 * limit) */
+	unsigned int write_blocks;
+
 	double reporting_interval;
 
 	int requested_send_buffer_size;
@@ -166,6 +201,16 @@ struct _flow_settings {
 	char *write_rate_str;
 	/** The actual rate we should send */
 	int write_rate;
+	/** Burst size of the rate pacer in bytes, 0 for default */
+	int pacing_burst;
+	/** Let the kernel pace the flow (SO_MAX_PACING_RATE) */
+	int kernel_pacing;
+	/** Maximum number of transactions awaiting their response block, 0
+	 * for no limit */
+	int pipeline_depth;
+	/** Maximum number of request blocks written with a single call, 0 or
+	 * 1 to write them one by one */
+	int write_batch;
 
 	unsigned int random_seed;
 
@@ -173,6 +218,13 @@ struct _flow_settings {
 
 	int byte_counting;
 
+	/** Content of the payload of request blocks (option --payload) */
+	enum payload_type payload;
+	/** Compression ratio of PAYLOAD_COMPRESSIBLE */
+	double payload_ratio;
+	/** Source file of PAYLOAD_FILE */
+	char payload_file[256];
+
 	int cork;
 	int nonagle;
 	char cc_alg[TCP_CA_NAME_MAX];
@@ -186,6 +238,22 @@ struct _flow_settings {
 	struct _trafgen_options response_trafgen_options;
 	struct _trafgen_options interpacket_gap_trafgen_options;
 
+	/** Inter-arrival time of flows spawned during the test (dynamic flow
+	 * arrival, option -G x=a). Zero parameters disable dynamic arrival */
+	struct _trafgen_options flow_arrival_trafgen_options;
+	/** Amount of data, in bytes, a spawned flow transfers (option -G x=f) */
+	struct _trafgen_options flow_size_trafgen_options;
+
+	/** Trace file replayed by the flow, empty if none (option --trace) */
+	char trace_file[256];
+	/** Record the replay starts with, as fraction of the trace records */
+	double trace_start;
+	/** Restart the replay at the end of the trace */
+	int trace_loop;
+	/** Draw the block sizes from all records of the trace instead of
+	 * replaying it */
+	int trace_sample;
+
 	struct _extra_socket_options {
 		int level;
 		int optname;
@@ -213,6 +281,61 @@ struct _fg_tcp_info {
 	int tcpi_backoff;
 	int tcpi_snd_mss;
 	int tcpi_ca_state;
+
+	/** Members only filled by newer Linux kernels, see tcpi_available.
+	 * Rates in bytes per second, times in microseconds @{ */
+	unsigned long long tcpi_pacing_rate;
+	unsigned long long tcpi_delivery_rate;
+	unsigned long long tcpi_bytes_acked;
+	int tcpi_notsent_bytes;
+	int tcpi_min_rtt;
+	/** Time the connection had data to send, and the parts of it the
+	 * receive window or the send buffer limited the sender. Counted
+	 * since the connection was established */
+	unsigned long long tcpi_busy_time;
+	unsigned long long tcpi_rwnd_limited;
+	unsigned long long tcpi_sndbuf_limited;			/** @} */
+	/** Members above the kernel filled, see enum tcp_info_member */
+	int tcpi_available;
+};
+
+/** Members of struct _fg_tcp_info not every kernel provides. The kernel of
+ * the daemon is asked at runtime */
+enum tcp_info_member {
+	/** tcpi_pacing_rate (Linux 3.15) */
+	TCP_INFO_PACING_RATE = 1 << 0,
+	/** tcpi_bytes_acked (Linux 4.1) */
+	TCP_INFO_BYTES_ACKED = 1 << 1,
+	/** tcpi_notsent_bytes and tcpi_min_rtt (Linux 4.6) */
+	TCP_INFO_NOTSENT_BYTES = 1 << 2,
+	/** tcpi_delivery_rate (Linux 4.9) */
+	TCP_INFO_DELIVERY_RATE = 1 << 3,
+	/** tcpi_busy_time, tcpi_rwnd_limited and tcpi_sndbuf_limited
+	 * (Linux 4.10) */
+	TCP_INFO_CHRONO = 1 << 4,
+};
+
+/** Counters of the event loop of the daemon, since the daemon started */
+struct _daemon_stats {
+	/** Iterations of the event loop */
+	unsigned long long loop_iterations;
+	/** Time blocked in pselect(), in seconds */
+	double select_time;
+	/** Time spent in prepare_fds(), in seconds */
+	double prepare_time;
+	/** Time spent in timer_check() and on RPC requests, in seconds */
+	double timer_time;
+	/** Time spent in process_select(), in seconds */
+	double process_time;
+	/** pselect(), read, write and getsockopt system calls issued by the
+	 * event loop */
+	unsigned long long syscalls;
+	/** Writes of request blocks that hit the limit of the send buffer */
+	unsigned long long write_eagain;
+	/** Blocks read that were received with a single call */
+	unsigned long long whole_blocks;
+	/** Blocks read that spanned several receive calls */
+	unsigned long long split_blocks;
 };
 
 /* Report (measurement sample) of a flow */
@@ -259,9 +382,57 @@ struct _report {
 	 * tcp_info struct */
 	struct _fg_tcp_info tcp_info;
 
+	/** Time the sender had data to send, was limited by the receive
+	 * window and was limited by the send buffer during the report, in
+	 * seconds. Valid if tcp_info.tcpi_available has TCP_INFO_CHRONO @{ */
+	double busy_time;
+	double rwnd_limited;
+	double sndbuf_limited;					/** @} */
+
 	int pmtu;
 	int imtu;
 
+	/** Point in time the flow has transferred its given amount of data
+	 * (option -Z). Zero if the flow is not limited by amount */
+	struct timespec completion;
+
+	/** Time between the common start of all flows and the first data
+	 * written by the flow, including its delay (option -Y) */
+	double start_skew;
+
+	/** CPU time spent on reading and writing the data of the flow, in
+	 * seconds */
+	double cpu_flow;
+	/** Utilization of a CPU by the daemon in user and kernel mode, and
+	 * of all CPUs of the host by softirqs. 1.0 is one CPU fully busy @{ */
+	double cpu_user;
+	double cpu_system;
+	double cpu_softirq;					/** @} */
+	/** Clock rate of the CPU of the daemon in Hz, 0 if unknown */
+	double cpu_hz;
+
+	/** Maximum number of response blocks waiting for the socket */
+	unsigned int response_queue_max;
+	/** Maximum time a response block waited for the socket */
+	double response_delay_max;
+	/** Accumulated time response blocks waited for the socket */
+	double response_delay_sum;
+
+	/** Maximum number of transactions awaiting their response block */
+	unsigned int outstanding_max;
+	/** Transactions whose response block was skipped by the responder */
+	unsigned int transactions_lost;
+	/** Number of calls writing request blocks */
+	unsigned int write_calls;
+	/** Number of blocks received with a corrupted payload (option -E) */
+	unsigned int corrupted_blocks;
+	/** Position of the first corrupted byte in the data read by the flow,
+	 * valid if corrupted_blocks is not zero */
+	unsigned long long corruption_offset;
+	/** Completion reports of flows spawned from this flow that the daemon
+	 * dropped, sent with the final report */
+	unsigned int dropped_completions;
+
 	int status;
 
 	struct _report* next;
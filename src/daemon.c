@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <strings.h>
 #include <signal.h>
 #include <string.h>
@@ -40,6 +41,7 @@
 #include <math.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/param.h>
 #include <sys/select.h>
 #include <netinet/in.h>
@@ -50,6 +52,7 @@
 #include <time.h>
 #include <syslog.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <netdb.h>
 #include <pthread.h>
 #include <inttypes.h>
@@ -57,6 +60,8 @@
 
 #include "common.h"
 #include "debug.h"
+#include "fg_events.h"
+#include "fg_probes.h"
 #include "fg_error.h"
 #include "fg_math.h"
 #include "fg_stdlib.h"
@@ -64,6 +69,7 @@
 #include "fg_time.h"
 #include "log.h"
 #include "daemon.h"
+#include "daemon_internal.h"
 #include "source.h"
 #include "destination.h"
 #include "trafgen.h"
@@ -101,6 +107,12 @@ int maxfd;
 struct _report* reports = 0;
 struct _report* reports_last = 0;
 unsigned int pending_reports = 0;
+/** Interval and completion reports dropped because the controller did not
+ * fetch them */
+unsigned long long dropped_reports = 0;
+
+/* Counters of the event loop. Only accessed from the daemon thread */
+struct _daemon_stats daemon_stats;
 
 struct _flow flows[MAX_FLOWS];
 unsigned int num_flows = 0;
@@ -114,10 +126,16 @@ char dumping = 0;
 /* Forward declarations */
 static int write_data(struct _flow *flow);
 static int read_data(struct _flow *flow);
+static void parse_blocks(struct _flow *flow);
+
+/* Payload pattern of byte counting (option -E), long enough to compare any
+ * received chunk starting at any offset of a block */
+static unsigned char byte_pattern[RECEIVE_BUFFER_SIZE + 256];
+static void process_transaction(struct _flow *flow);
 static void process_rtt(struct _flow* flow);
 static void process_iat(struct _flow* flow);
 static void process_delay(struct _flow* flow);
-static void report_flow(struct _flow* flow, int type);
+static int write_responses(struct _flow *flow);
 static void send_response(struct _flow* flow,
 			  int requested_response_block_size);
 int get_tcp_info(struct _flow *flow, struct _fg_tcp_info *info);
@@ -169,9 +187,269 @@ static inline int flow_block_scheduled(struct timespec *now, struct _flow *flow)
 	return time_is_after(now, &flow->next_write_block_timestamp);
 }
 
+/* Returns true if the rate of the flow is enforced by our token bucket */
+static inline int flow_paced(struct _flow *flow)
+{
+	return flow->settings.write_rate && !flow->settings.kernel_pacing;
+}
+
+/* Number of transactions of the flow awaiting their response block */
+static inline unsigned int flow_outstanding(struct _flow *flow)
+{
+	return flow->next_transaction_id - flow->next_response_id;
+}
+
+/* Returns true if the flow may not start another transaction before a
+ * response block arrives (option --pipeline) */
+static inline int flow_pipeline_full(struct _flow *flow)
+{
+	return flow->settings.pipeline_depth &&
+	       flow_outstanding(flow) >=
+	       (unsigned int)flow->settings.pipeline_depth;
+}
+
+/* Returns true if request blocks of the flow were started but not written
+ * completely */
+static inline int flow_write_pending(struct _flow *flow)
+{
+	return flow->current_block_bytes_written ||
+	       flow->batch.next < flow->batch.count;
+}
+
+/* Credit the pacer of the flow with the tokens accrued since the last
+ * refill. Tokens exceeding the burst size are lost. Losing a whole block
+ * means the flow cannot keep up with its rate */
+static void refill_pacer(struct timespec *now, struct _flow *flow)
+{
+	flow->pacing_tokens += time_diff(&flow->pacing_timestamp, now) *
+			       flow->settings.write_rate;
+	flow->pacing_timestamp = *now;
+
+	if (flow->pacing_tokens - flow->pacing_burst >= 1) {
+		DEBUG_MSG(LOG_WARNING, "incipient congestion on flow %u, "
+			  "pacer dropped %.2f blocks", flow->id,
+			  flow->pacing_tokens - flow->pacing_burst);
+		flow->congestion_counter++;
+		FG_PROBE(congestion, flow->id, flow->congestion_counter);
+	}
+	ASSIGN_MIN(flow->pacing_tokens, flow->pacing_burst);
+}
+
+/* The pacer starts with a single block when the flow starts writing and may
+ * accumulate up to its burst size. Default is a millisecond worth of data */
+void init_pacer(struct _flow *flow)
+{
+	if (!flow_paced(flow))
+		return;
+
+	flow->pacing_timestamp = flow->start_timestamp[WRITE];
+	flow->pacing_tokens = 1;
+	if (flow->settings.pacing_burst)
+		flow->pacing_burst = (double)flow->settings.pacing_burst /
+				     flow->settings.maximum_block_size;
+	else
+		flow->pacing_burst = flow->settings.write_rate *
+				     DEFAULT_PACING_BURST;
+	ASSIGN_MAX(flow->pacing_burst, 1.0);
+}
+
+/* Reads the time all CPUs of the host spent in softirqs, where most of the
+ * receive processing of the network stack happens. 0 if unknown */
+static double get_softirq_time(void)
+{
+#ifdef __LINUX__
+	static long ticks = 0;
+	unsigned long long user, nice, system, idle, iowait, irq, softirq;
+	FILE *stat;
+	int rc;
+
+	if (!ticks)
+		ticks = sysconf(_SC_CLK_TCK);
+	if (ticks <= 0)
+		return 0.0;
+
+	stat = fopen("/proc/stat", "r");
+	if (!stat)
+		return 0.0;
+	rc = fscanf(stat, "cpu %llu %llu %llu %llu %llu %llu %llu", &user,
+		    &nice, &system, &idle, &iowait, &irq, &softirq);
+	fclose(stat);
+
+	return rc == 7 ? (double)softirq / ticks : 0.0;
+#else
+	return 0.0;
+#endif /* __LINUX__ */
+}
+
+/* Sample the CPU time of the daemon thread and the softirq time of the host.
+ * The sample is taken once per iteration of the event loop and shared by
+ * all flows reporting in that iteration */
+static void sample_cpu(struct _cpu_sample *sample)
+{
+	static struct _cpu_sample last;
+	static unsigned long long last_iteration;
+	static bool valid = false;
+	struct rusage usage;
+
+	if (valid && last_iteration == daemon_stats.loop_iterations) {
+		*sample = last;
+		return;
+	}
+
+#ifdef RUSAGE_THREAD
+	if (getrusage(RUSAGE_THREAD, &usage) == -1)
+#else
+	if (getrusage(RUSAGE_SELF, &usage) == -1)
+#endif /* RUSAGE_THREAD */
+		memset(&usage, 0, sizeof(usage));
+
+	gettime_monotonic(&last.time);
+	last.user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+	last.system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	last.softirq = get_softirq_time();
+	last_iteration = daemon_stats.loop_iterations;
+	valid = true;
+
+	*sample = last;
+}
+
+/* Clock rate of the CPU in Hz to convert CPU time into cycles. The
+ * calibrated TSC is preferred over the nominal rate. 0 if unknown */
+static double cpu_frequency(void)
+{
+	static double hz = -1.0;
+
+	if (clock_tsc_hz())
+		return clock_tsc_hz();
+
+	if (hz < 0) {
+		hz = 0.0;
+#ifdef __LINUX__
+		char line[256];
+		double mhz;
+		FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+
+		while (cpuinfo && fgets(line, sizeof(line), cpuinfo)) {
+			if (sscanf(line, "cpu MHz : %lf", &mhz) == 1) {
+				hz = mhz * 1e6;
+				break;
+			}
+		}
+		if (cpuinfo)
+			fclose(cpuinfo);
+#endif /* __LINUX__ */
+	}
+
+	return hz;
+}
+
+/* The sockets are non-blocking, hence the time spent in the data path of a
+ * flow is spent on the CPU, in user and kernel mode. Charges the time since
+ * mark to the flow and moves mark to now, so that serving a socket takes a
+ * single clock reading */
+static inline void account_cpu(struct _flow *flow, struct timespec *mark)
+{
+	struct timespec now;
+
+	gettime_monotonic_fast(&now);
+	for (int i = 0; i < 2; i++)
+		flow->statistics[i].cpu_time += time_diff(mark, &now);
+	*mark = now;
+}
+
+/* Add the statistics of a finished spawned flow to its template */
+static void merge_statistics(struct _flow *template, struct _flow *flow)
+{
+	struct _statistics *from = &flow->statistics[FINAL];
+
+	for (int i = 0; i < 2; i++) {
+		struct _statistics *to = &template->statistics[i];
+
+		to->bytes_read += from->bytes_read;
+		to->bytes_written += from->bytes_written;
+		to->request_blocks_read += from->request_blocks_read;
+		to->request_blocks_written += from->request_blocks_written;
+		to->response_blocks_read += from->response_blocks_read;
+		to->response_blocks_written += from->response_blocks_written;
+
+		ASSIGN_MIN(to->iat_min, from->iat_min);
+		ASSIGN_MAX(to->iat_max, from->iat_max);
+		to->iat_sum += from->iat_sum;
+		ASSIGN_MIN(to->rtt_min, from->rtt_min);
+		ASSIGN_MAX(to->rtt_max, from->rtt_max);
+		to->rtt_sum += from->rtt_sum;
+		ASSIGN_MIN(to->delay_min, from->delay_min);
+		ASSIGN_MAX(to->delay_max, from->delay_max);
+		to->delay_sum += from->delay_sum;
+		to->cpu_time += from->cpu_time;
+	}
+
+	for (int i = 0; i <= METRICS_RTT_BUCKETS; i++)
+		template->rtt_buckets[i] += flow->rtt_buckets[i];
+}
+
+/*
+ * Account a flow spawned by the dynamic flow arrival process to its template
+ * and report its completion time. Spawned flows do not report on their own
+ */
+static void retire_spawned_flow(struct _flow *flow)
+{
+	struct _flow *template = NULL;
+	struct _report *report;
+
+	for (unsigned int i = 0; i < num_flows; i++) {
+		if (flows[i].id == flow->template_id) {
+			template = &flows[i];
+			break;
+		}
+	}
+	if (!template)
+		return;
+
+	template->active_children--;
+	merge_statistics(template, flow);
+
+	if (flow->error)
+		logging_log(LOG_WARNING, "flow %d spawned from flow %d failed: "
+			    "%s", flow->id, template->id, flow->error);
+
+	/* Only the source knows the size of the flow */
+	if (flow->endpoint != SOURCE ||
+	    (!flow->completion_timestamp.tv_sec &&
+	     !flow->completion_timestamp.tv_nsec))
+		return;
+
+	report = calloc(1, sizeof(struct _report));
+	if (!report) {
+		logging_log(LOG_ALERT, "could not allocate memory for report");
+		return;
+	}
+	report->id = template->id;
+	report->type = COMPLETION;
+	report->begin = flow->first_report_time;
+	gettime(&report->end);
+	report->completion = flow->completion_timestamp;
+	report->bytes_read = flow->statistics[FINAL].bytes_read;
+	report->bytes_written = flow->statistics[FINAL].bytes_written;
+	report->request_blocks_written =
+		flow->statistics[FINAL].request_blocks_written;
+	report->response_blocks_read =
+		flow->statistics[FINAL].response_blocks_read;
+	report->rtt_min = flow->statistics[FINAL].rtt_min;
+	report->rtt_max = flow->statistics[FINAL].rtt_max;
+	report->rtt_sum = flow->statistics[FINAL].rtt_sum;
+	if (add_report(report) == -1)
+		template->dropped_completions++;
+}
+
 void uninit_flow(struct _flow *flow)
 {
 	DEBUG_MSG(LOG_DEBUG,"uninit_flow() called for flow %d",flow->id);
+	FG_PROBE(flow_finish, flow->id,
+		 flow->statistics[FINAL].bytes_written,
+		 flow->statistics[FINAL].bytes_read);
+	if (flow->template_id != -1)
+		retire_spawned_flow(flow);
 	if (flow->fd != -1)
 		close(flow->fd);
 	if (flow->listenfd_data != -1)
@@ -186,7 +464,10 @@ void uninit_flow(struct _flow *flow)
 		fg_pcap_cleanup(flow);
 	}
 #endif
-	free_all(flow->read_block, flow->write_block, flow->addr, flow->error);
+	trace_close(flow->trace);
+	payload_pool_put(flow->payload_pool);
+	free_all(flow->read_block, flow->write_block, flow->recv_buffer,
+		 flow->batch.blocks, flow->addr, flow->error);
 	free_math_functions(flow);
 }
 
@@ -199,37 +480,99 @@ void remove_flow(unsigned int i)
 		started = 0;
 }
 
-static void prepare_wfds(struct timespec *now, struct _flow *flow, fd_set *wfds)
+/* Returns true if the flow has sent the amount of data given by option -Z */
+static inline int flow_amount_sent(struct _flow *flow)
+{
+	return (flow->settings.write_bytes &&
+		flow->statistics[FINAL].bytes_written >=
+		flow->settings.write_bytes) ||
+	       (flow->settings.write_blocks &&
+		flow->statistics[FINAL].request_blocks_written >=
+		flow->settings.write_blocks);
+}
+
+/* Returns true if the flow has replayed all records of its trace once,
+ * unless the trace is looped (option --trace) */
+static inline int flow_trace_replayed(struct _flow *flow)
+{
+	return flow->trace && !flow->settings.trace_loop &&
+	       flow->trace_replayed >= flow->trace->num_records;
+}
+
+static void stop_writing(struct _flow *flow)
 {
 	int rc = 0;
 
+	flow->finished[WRITE] = 1;
+	if (flow->settings.shutdown) {
+		DEBUG_MSG(LOG_WARNING, "shutting down flow %d (WR)", flow->id);
+		rc = shutdown(flow->fd,SHUT_WR);
+		if (rc == -1)
+			warn("shutdown() SHUT_WR failed");
+	}
+}
+
+/* Add the socket of the flow to the write set if a block may be sent now.
+ * Otherwise lower wait to the time until the next block is due */
+static void prepare_wfds(struct timespec *now, struct _flow *flow,
+			 fd_set *wfds, double *wait)
+{
+	flow->write_scheduled = 0;
+
 	if (flow_in_delay(now, flow, WRITE)) {
 		DEBUG_MSG(LOG_WARNING, "flow %i not started yet (delayed)",
 			  flow->id);
+		/* wake up in time for the start */
+		ASSIGN_MIN(*wait, time_diff(now, &flow->start_timestamp[WRITE]));
 		return;
 	}
 
+	/* Flow has already sent its amount of data */
+	if (flow->finished[WRITE])
+		return;
+
 	if (flow_sending(now, flow, WRITE)) {
 #ifdef DEBUG
 		assert(!flow->finished[WRITE]);
 #endif
-		if (flow_block_scheduled(now, flow)) {
+		/* complete the blocks already started first */
+		if (flow_write_pending(flow)) {
 			DEBUG_MSG(LOG_DEBUG, "adding sock of flow %d to wfds",
 				  flow->id);
 			FD_SET(flow->fd, wfds);
+			flow->write_scheduled = 1;
+			return;
+		}
+		/* a response block wakes us up by the read set */
+		if (flow_pipeline_full(flow)) {
+			DEBUG_MSG(LOG_DEBUG, "pipeline of flow %d is full",
+				  flow->id);
+			return;
+		}
+		if (flow_paced(flow)) {
+			refill_pacer(now, flow);
+			if (flow->pacing_tokens >= 1) {
+				DEBUG_MSG(LOG_DEBUG, "adding sock of flow %d "
+					  "to wfds", flow->id);
+				FD_SET(flow->fd, wfds);
+				flow->write_scheduled = 1;
+			} else {
+				ASSIGN_MIN(*wait, (1 - flow->pacing_tokens) /
+						  flow->settings.write_rate);
+			}
+		} else if (flow_block_scheduled(now, flow)) {
+			DEBUG_MSG(LOG_DEBUG, "adding sock of flow %d to wfds",
+				  flow->id);
+			FD_SET(flow->fd, wfds);
+			flow->write_scheduled = 1;
 		} else {
 			DEBUG_MSG(LOG_DEBUG, "no block for flow %d scheduled "
 				  "yet", flow->id);
+			ASSIGN_MIN(*wait, time_diff(now,
+				   &flow->next_write_block_timestamp));
 		}
-	} else if (!flow->finished[WRITE]) {
-		flow->finished[WRITE] = 1;
-		if (flow->settings.shutdown) {
-			DEBUG_MSG(LOG_WARNING, "shutting down flow %d (WR)",
-				  flow->id);
-			rc = shutdown(flow->fd,SHUT_WR);
-			if (rc == -1)
-				warn("shutdown() SHUT_WR failed");
-		}
+	} else {
+		stop_writing(flow);
 	}
 
 	return;
@@ -263,8 +606,10 @@ static int prepare_rfds(struct timespec *now, struct _flow *flow, fd_set *rfds)
 	}
 
 	/* Altough the server flow might be finished we keep the socket in
-	 * rfd in order to check for buggy servers */
-	if (flow->connect_called && !flow->finished[READ]) {
+	 * rfd in order to check for buggy servers. While the response queue
+	 * is full the requester is throttled by the flow control of TCP */
+	if (flow->connect_called && !flow->finished[READ] &&
+	    flow->responses.count < RESPONSE_QUEUE_SIZE) {
 		DEBUG_MSG(LOG_DEBUG, "adding sock of flow %d to rfds",
 			  flow->id);
 		FD_SET(flow->fd, rfds);
@@ -273,7 +618,9 @@ static int prepare_rfds(struct timespec *now, struct _flow *flow, fd_set *rfds)
 	return 0;
 }
 
-static int prepare_fds() {
+/* Prepare the fd sets for pselect(). wait is lowered to the time until the
+ * next paced block of any flow is due */
+int prepare_fds(double *wait) {
 
 	DEBUG_MSG(LOG_DEBUG, "prepare_fds() called, num_flows: %d", num_flows);
 	unsigned int i = 0;
@@ -291,7 +638,10 @@ static int prepare_fds() {
 	while (i < num_flows) {
 		struct _flow *flow = &flows[i++];
 
-		if (started &&
+		/* a finished flow still writes all queued response blocks,
+		 * unless writing fails */
+		if (started && !flow->active_children &&
+		    !flow->responses.count &&
 		    (flow->finished[READ] ||
 		     !flow->settings.duration[READ] ||
 		     (!flow_in_delay(&now, flow, READ) &&
@@ -329,7 +679,9 @@ static int prepare_fds() {
 		if (flow->fd != -1) {
 			FD_SET(flow->fd, &efds);
 			maxfd = MAX(maxfd, flow->fd);
-			prepare_wfds(&now, flow, &wfds);
+			prepare_wfds(&now, flow, &wfds, wait);
+			if (flow->responses.count)
+				FD_SET(flow->fd, &wfds);
 			prepare_rfds(&now, flow, &rfds);
 		}
 	}
@@ -337,26 +689,25 @@ static int prepare_fds() {
 	return num_flows;
 }
 
-static void start_flows(struct _request_start_flows *request)
+void start_flows(struct _request_start_flows *request)
 {
-	struct timespec start;
+	struct timespec start, target;
 	gettime(&start);
 
-#if 0
-	if (start.tv_sec < request->start_timestamp) {
-		/* If the clock is synchronized between nodes, all nodes will
-		 * start at the same time regardless of any RPC delays */
-		start.tv_sec = request->start_timestamp;
-		start.tv_nsec = 0;
-	}
-#else
-	UNUSED_ARGUMENT(request);
-#endif
+	/* The controller schedules the flows of all daemons to start at the
+	 * same time, translated to our clock. If the command arrives late we
+	 * start at once and the skew shows up in the report */
+	target = request->start_timestamp;
+	if (!target.tv_sec)
+		target = start;
+	else if (time_is_after(&target, &start))
+		start = target;
 
 	for (unsigned int i = 0; i < num_flows; i++) {
 		struct _flow *flow = &flows[i];
 		/* initalize random number generator etc */
 		init_math_functions(flow, flow->settings.random_seed);
+		select_block_generator(flow);
 
 		/* READ and WRITE */
 		for (int j = 0; j < 2; j++) {
@@ -372,10 +723,39 @@ static void start_flows(struct _request_start_flows *request)
 		}
 		flow->next_write_block_timestamp =
 			flow->start_timestamp[WRITE];
+		flow->scheduled_start = target;
+		time_add(&flow->scheduled_start, flow->settings.delay[WRITE]);
+		flow->start_skew = 0;
+#ifdef HAVE_SYS_SDT_H
+		{
+			/* tracers timestamp on the monotonic clock */
+			struct timespec wall, mono;
+
+			gettime(&wall);
+			gettime_monotonic(&mono);
+			FG_PROBE(flow_start, flow->id, flow->endpoint,
+				 probe_ns(&mono) + probe_duration_ns(
+				 time_diff(&wall, &flow->scheduled_start)));
+		}
+#endif /* HAVE_SYS_SDT_H */
+		sample_cpu(&flow->cpu_sample[INTERVAL]);
+		flow->cpu_sample[FINAL] = flow->cpu_sample[INTERVAL];
+		init_pacer(flow);
+
+		/* first spawned flow arrives when the template starts. The
+		 * destination accepts spawned flows a little longer */
+		if (flow_is_template(flow)) {
+			flow->next_arrival_timestamp =
+				flow->start_timestamp[WRITE];
+			if (flow->endpoint == DESTINATION)
+				time_add(&flow->stop_timestamp[READ],
+					 DYNAMIC_ACCEPT_GRACE);
+		}
 
-		gettime(&flow->last_report_time);
-		flow->first_report_time = flow->last_report_time;
-		flow->next_report_time = flow->last_report_time;
+		/* reports begin at the common start */
+		flow->last_report_time = start;
+		flow->first_report_time = start;
+		flow->next_report_time = start;
 
 		time_add(&flow->next_report_time,
 			 flow->settings.reporting_interval);
@@ -431,6 +811,14 @@ static void stop_flow(struct _request_stop_flow *request)
 
 		uninit_flow(flow);
 		remove_flow(i);
+
+		/* stop the flows spawned from this flow as well */
+		for (unsigned int j = 0; j < num_flows; j++) {
+			if (flows[j].template_id != request->flow_id)
+				continue;
+			uninit_flow(&flows[j]);
+			remove_flow(j--);
+		}
 		return;
 	}
 
@@ -447,6 +835,7 @@ static void process_requests()
 	char tmp[100];
 	for (;;) {
 		int rc = read(daemon_pipe[0], tmp, 100);
+		daemon_stats.syscalls++;
 		if (rc != 100)
 			break;
 	}
@@ -481,6 +870,10 @@ static void process_requests()
 				r->num_flows = num_flows;
 			}
 			break;
+		case REQUEST_GET_DAEMON_STATS:
+			((struct _request_get_daemon_stats *)request)->stats =
+				daemon_stats;
+			break;
 		default:
 			request_error(request, "Unknown request type");
 			break;
@@ -496,10 +889,15 @@ static void process_requests()
 /*
  * Prepare a report. type is either INTERVAL or FINAL
  */
-static void report_flow(struct _flow* flow, int type)
+void report_flow(struct _flow* flow, int type)
 {
 	DEBUG_MSG(LOG_DEBUG, "report_flow called for flow %d (type %d)",
 		  flow->id, type);
+
+	/* spawned flows are accounted to their template */
+	if (flow->template_id != -1)
+		return;
+
 	struct _report* report =
 		(struct _report*)malloc(sizeof(struct _report));
 
@@ -546,6 +944,25 @@ static void report_flow(struct _flow* flow, int type)
 	 * and FreeBSD */
 	report->tcp_info = flow->statistics[type].tcp_info;
 
+	/* the kernel counts the chrono statistics from the connect, what
+	 * limited the sender during an interval is their increase */
+	report->busy_time = report->rwnd_limited = report->sndbuf_limited = 0;
+	if (report->tcp_info.tcpi_available & TCP_INFO_CHRONO) {
+		struct _fg_tcp_info base;
+
+		memset(&base, 0, sizeof(base));
+		if (type == INTERVAL) {
+			base = flow->tcp_info_sample;
+			flow->tcp_info_sample = report->tcp_info;
+		}
+		report->busy_time = (report->tcp_info.tcpi_busy_time -
+				     base.tcpi_busy_time) / 1e6;
+		report->rwnd_limited = (report->tcp_info.tcpi_rwnd_limited -
+					base.tcpi_rwnd_limited) / 1e6;
+		report->sndbuf_limited = (report->tcp_info.tcpi_sndbuf_limited -
+					  base.tcpi_sndbuf_limited) / 1e6;
+	}
+
 	if (flow->fd != -1) {
 		/* Get latest MTU */
 		flow->pmtu = get_pmtu(flow->fd);
@@ -558,6 +975,37 @@ static void report_flow(struct _flow* flow, int type)
 		report->imtu = 0;
 		report->pmtu = 0;
 	}
+	report->completion = flow->completion_timestamp;
+	report->start_skew = flow->start_skew;
+
+	/* CPU utilization since the last report or the start of the flow */
+	struct _cpu_sample cpu;
+	sample_cpu(&cpu);
+	double elapsed = time_diff(&flow->cpu_sample[type].time, &cpu.time);
+	if (elapsed > 0) {
+		report->cpu_user = (cpu.user - flow->cpu_sample[type].user) /
+				   elapsed;
+		report->cpu_system = (cpu.system -
+				      flow->cpu_sample[type].system) / elapsed;
+		report->cpu_softirq = (cpu.softirq -
+				       flow->cpu_sample[type].softirq) /
+				      elapsed;
+	}
+	report->cpu_flow = flow->statistics[type].cpu_time;
+	report->cpu_hz = cpu_frequency();
+	if (type == INTERVAL)
+		flow->cpu_sample[INTERVAL] = cpu;
+
+	report->response_queue_max = flow->statistics[type].response_queue_max;
+	report->response_delay_max = flow->statistics[type].response_delay_max;
+	report->response_delay_sum = flow->statistics[type].response_delay_sum;
+	report->outstanding_max = flow->statistics[type].outstanding_max;
+	report->transactions_lost = flow->statistics[type].transactions_lost;
+	report->write_calls = flow->statistics[type].write_calls;
+	report->corrupted_blocks = flow->statistics[type].corrupted_blocks;
+	report->corruption_offset = flow->statistics[type].corruption_offset;
+	report->dropped_completions = flow->dropped_completions;
+
 	/* Add status flags to report */
 	report->status = 0;
 
@@ -612,26 +1060,107 @@ static void report_flow(struct _flow* flow, int type)
 		flow->statistics[INTERVAL].iat_max = FLT_MIN;
 		flow->statistics[INTERVAL].iat_sum = 0.0F;
 		flow->statistics[INTERVAL].delay_min = FLT_MAX;
-		flow->statistics[INTERVAL].delay_max = FLT_MIN;
+		flow->statistics[INTERVAL].delay_max = -FLT_MAX;
 		flow->statistics[INTERVAL].delay_sum = 0.0F;
+		flow->statistics[INTERVAL].cpu_time = 0.0;
+		flow->statistics[INTERVAL].response_queue_max =
+			flow->responses.count;
+		flow->statistics[INTERVAL].response_delay_max = 0.0;
+		flow->statistics[INTERVAL].response_delay_sum = 0.0;
+		flow->statistics[INTERVAL].outstanding_max =
+			flow_outstanding(flow);
+		flow->statistics[INTERVAL].transactions_lost = 0;
+		flow->statistics[INTERVAL].write_calls = 0;
+		flow->statistics[INTERVAL].corrupted_blocks = 0;
 	}
 
+	FG_PROBE(report, report->id, type, report->bytes_written,
+		 report->bytes_read);
 	add_report(report);
 	DEBUG_MSG(LOG_DEBUG, "report_flow finished for flow %d (type %d)",
 		  flow->id, type);
 }
 
+#ifdef __LINUX__
+/* Layout of struct tcp_info of the Linux kernel up to the chrono
+ * statistics. The C library ships an older one, while the kernel only
+ * ever appends members and copies as many bytes as it knows of */
+struct _linux_tcp_info {
+	uint8_t tcpi_state;
+	uint8_t tcpi_ca_state;
+	uint8_t tcpi_retransmits;
+	uint8_t tcpi_probes;
+	uint8_t tcpi_backoff;
+	uint8_t tcpi_options;
+	uint8_t tcpi_wscale;
+	uint8_t tcpi_flags;
+
+	uint32_t tcpi_rto;
+	uint32_t tcpi_ato;
+	uint32_t tcpi_snd_mss;
+	uint32_t tcpi_rcv_mss;
+
+	uint32_t tcpi_unacked;
+	uint32_t tcpi_sacked;
+	uint32_t tcpi_lost;
+	uint32_t tcpi_retrans;
+	uint32_t tcpi_fackets;
+
+	uint32_t tcpi_last_data_sent;
+	uint32_t tcpi_last_ack_sent;
+	uint32_t tcpi_last_data_recv;
+	uint32_t tcpi_last_ack_recv;
+
+	uint32_t tcpi_pmtu;
+	uint32_t tcpi_rcv_ssthresh;
+	uint32_t tcpi_rtt;
+	uint32_t tcpi_rttvar;
+	uint32_t tcpi_snd_ssthresh;
+	uint32_t tcpi_snd_cwnd;
+	uint32_t tcpi_advmss;
+	uint32_t tcpi_reordering;
+
+	uint32_t tcpi_rcv_rtt;
+	uint32_t tcpi_rcv_space;
+
+	uint32_t tcpi_total_retrans;
+
+	uint64_t tcpi_pacing_rate;
+	uint64_t tcpi_max_pacing_rate;
+	uint64_t tcpi_bytes_acked;
+	uint64_t tcpi_bytes_received;
+	uint32_t tcpi_segs_out;
+	uint32_t tcpi_segs_in;
+
+	uint32_t tcpi_notsent_bytes;
+	uint32_t tcpi_min_rtt;
+	uint32_t tcpi_data_segs_in;
+	uint32_t tcpi_data_segs_out;
+
+	uint64_t tcpi_delivery_rate;
+
+	uint64_t tcpi_busy_time;
+	uint64_t tcpi_rwnd_limited;
+	uint64_t tcpi_sndbuf_limited;
+};
+#endif /* __LINUX__ */
+
 /* Fills the given _fg_tcp_info with the values of the OS specific tcp_info,
  * returns 0 on success */
 int get_tcp_info(struct _flow *flow, struct _fg_tcp_info *info)
 {
 #if (defined __LINUX__ || defined __FreeBSD__)
+#ifdef __LINUX__
+	struct _linux_tcp_info tmp_info;
+#else
 	struct tcp_info tmp_info;
+#endif /* __LINUX__ */
 	socklen_t info_len = sizeof(tmp_info);
 	int rc;
 	memset(info, 0, sizeof(struct _fg_tcp_info));
 
 	rc = getsockopt(flow->fd, IPPROTO_TCP, TCP_INFO, &tmp_info, &info_len);
+	daemon_stats.syscalls++;
 	if (rc == -1) {
 		warn("getsockopt() failed");
 		return -1;
@@ -650,9 +1179,38 @@ int get_tcp_info(struct _flow *flow, struct _fg_tcp_info *info)
 	CPY_INFO_MEMBER(tcpi_unacked);
 	CPY_INFO_MEMBER(tcpi_sacked);
 	CPY_INFO_MEMBER(tcpi_retrans);
+	CPY_INFO_MEMBER(tcpi_lost);
 	CPY_INFO_MEMBER(tcpi_retransmits);
 	CPY_INFO_MEMBER(tcpi_fackets);
 	CPY_INFO_MEMBER(tcpi_reordering);
+	CPY_INFO_MEMBER(tcpi_ca_state);
+
+	/* older kernels copy less, the members beyond stay unknown */
+	#define HAS_INFO_MEMBER(a) (info_len >= offsetof(struct _linux_tcp_info, a) + \
+				    sizeof(tmp_info.a))
+	if (HAS_INFO_MEMBER(tcpi_pacing_rate)) {
+		info->tcpi_pacing_rate = tmp_info.tcpi_pacing_rate;
+		info->tcpi_available |= TCP_INFO_PACING_RATE;
+	}
+	if (HAS_INFO_MEMBER(tcpi_bytes_acked)) {
+		info->tcpi_bytes_acked = tmp_info.tcpi_bytes_acked;
+		info->tcpi_available |= TCP_INFO_BYTES_ACKED;
+	}
+	if (HAS_INFO_MEMBER(tcpi_min_rtt)) {
+		CPY_INFO_MEMBER(tcpi_notsent_bytes);
+		CPY_INFO_MEMBER(tcpi_min_rtt);
+		info->tcpi_available |= TCP_INFO_NOTSENT_BYTES;
+	}
+	if (HAS_INFO_MEMBER(tcpi_delivery_rate)) {
+		info->tcpi_delivery_rate = tmp_info.tcpi_delivery_rate;
+		info->tcpi_available |= TCP_INFO_DELIVERY_RATE;
+	}
+	if (HAS_INFO_MEMBER(tcpi_sndbuf_limited)) {
+		info->tcpi_busy_time = tmp_info.tcpi_busy_time;
+		info->tcpi_rwnd_limited = tmp_info.tcpi_rwnd_limited;
+		info->tcpi_sndbuf_limited = tmp_info.tcpi_sndbuf_limited;
+		info->tcpi_available |= TCP_INFO_CHRONO;
+	}
 #endif
 #else
 	memset(info, 0, sizeof(_fg_tcp_info);
@@ -660,20 +1218,42 @@ int get_tcp_info(struct _flow *flow, struct _fg_tcp_info *info)
 	return 0;
 }
 
-static void timer_check()
+/* Spawn all flows of the dynamic flow arrival process that are due */
+static void spawn_flows(struct timespec *now, struct _flow *flow)
+{
+	int rc;
+
+	/* Bound the work per iteration if arrivals fall due faster than
+	 * flows can be spawned. Later arrivals are spawned late */
+	for (int i = 0; i < MAX_SPAWNS_PER_TICK &&
+	     flow_sending(now, flow, WRITE) &&
+	     !time_is_after(&flow->next_arrival_timestamp, now); i++) {
+		rc = spawn_flow_source(flow);
+		time_add(&flow->next_arrival_timestamp,
+			 next_flow_arrival(flow));
+		/* arrival is lost if the daemon is at its capacity */
+		if (rc == -1)
+			break;
+	}
+}
+
+void timer_check(void)
 {
 	struct timespec now;
 
 	if (!started)
 		return;
 
-	gettime(&now);
+	gettime_cached(&now);
 	for (unsigned int i = 0; i < num_flows; i++) {
 		struct _flow *flow = &flows[i];
 
 		DEBUG_MSG(LOG_DEBUG, "processing timer_check() for flow %d",
 			  flow->id);
 
+		if (flow_is_template(flow) && flow->endpoint == SOURCE)
+			spawn_flows(&now, flow);
+
 		if (!flow->settings.reporting_interval)
 			continue;
 
@@ -699,6 +1279,11 @@ static void timer_check()
 static void process_select(fd_set *rfds, fd_set *wfds, fd_set *efds)
 {
 	unsigned int i = 0;
+	struct timespec mark;
+
+	/* the CPU time of a flow is the time since the previous reading, which
+	 * includes checking the flows in between that are not ready */
+	gettime_monotonic_fast(&mark);
 	while (i < num_flows) {
 
 		struct _flow *flow = &flows[i];
@@ -709,7 +1294,11 @@ static void process_select(fd_set *rfds, fd_set *wfds, fd_set *efds)
 		if (flow->listenfd_data != -1 &&
 		    FD_ISSET(flow->listenfd_data, rfds)) {
 			DEBUG_MSG(LOG_DEBUG, "ready for accept");
-			if (flow->state == GRIND_WAIT_ACCEPT) {
+			if (flow_is_template(flow)) {
+				if (accept_flow_destination(flow) == -1)
+					DEBUG_MSG(LOG_ERR, "accept_flow_destination() "
+						  "failed");
+			} else if (flow->state == GRIND_WAIT_ACCEPT) {
 				if (accept_data(flow) == -1) {
 					DEBUG_MSG(LOG_ERR, "accept_data() "
 						  "failed");
@@ -729,6 +1318,7 @@ static void process_select(fd_set *rfds, fd_set *wfds, fd_set *efds)
 						SO_ERROR,
 						(void *)&error_number,
 						&error_number_size);
+				daemon_stats.syscalls++;
 				if (rc == -1) {
 					warn("failed to get errno for"
 					     "non-blocking connect");
@@ -739,17 +1329,33 @@ static void process_select(fd_set *rfds, fd_set *wfds, fd_set *efds)
 					goto remove;
 				}
 			}
-			if (FD_ISSET(flow->fd, wfds))
-				if (write_data(flow) == -1) {
+			if (FD_ISSET(flow->fd, wfds)) {
+				int rc;
+
+				rc = write_responses(flow);
+				/* room in the response queue for the blocks
+				 * left in the receive buffer */
+				if (rc != -1 && flow->recv_pos < flow->recv_len)
+					parse_blocks(flow);
+				if (rc != -1 && flow->write_scheduled)
+					rc = write_data(flow);
+				account_cpu(flow, &mark);
+				if (rc == -1) {
 					DEBUG_MSG(LOG_ERR, "write_data() failed");
 					goto remove;
 				}
+			}
+
+			if (FD_ISSET(flow->fd, rfds)) {
+				int rc;
 
-			if (FD_ISSET(flow->fd, rfds))
-				if (read_data(flow) == -1) {
+				rc = read_data(flow);
+				account_cpu(flow, &mark);
+				if (rc == -1) {
 					DEBUG_MSG(LOG_ERR, "read_data() failed");
 					goto remove;
 				}
+			}
 		}
 		i++;
 		continue;
@@ -768,18 +1374,83 @@ remove:
 	}
 }
 
+/* Copy the statistics of all flows into the snapshot served by the metrics
+ * thread. Skipped if the metrics thread is just reading the snapshot */
+static void publish_metrics(void)
+{
+	struct timespec now;
+	struct _metrics_snapshot *snapshot;
+
+	gettime_cached(&now);
+	if (!metrics_due(&now, num_flows))
+		return;
+	if (!(snapshot = metrics_acquire()))
+		return;
+
+	snapshot->timestamp = now;
+	snapshot->stats = daemon_stats;
+	/* read without the mutex, a stale value is fine here */
+	snapshot->pending_reports = pending_reports;
+	snapshot->dropped_reports = dropped_reports;
+	snapshot->num_flows = num_flows;
+
+	for (unsigned int i = 0; i < num_flows; i++) {
+		struct _flow *flow = &flows[i];
+		struct _flow_metrics *m = &snapshot->flows[i];
+
+		m->id = flow->id;
+		m->endpoint = flow->endpoint;
+		m->bytes_read = flow->statistics[FINAL].bytes_read;
+		m->bytes_written = flow->statistics[FINAL].bytes_written;
+		m->request_blocks_read =
+			flow->statistics[FINAL].request_blocks_read;
+		m->request_blocks_written =
+			flow->statistics[FINAL].request_blocks_written;
+		m->response_blocks_read =
+			flow->statistics[FINAL].response_blocks_read;
+		m->response_blocks_written =
+			flow->statistics[FINAL].response_blocks_written;
+		m->response_queue = flow->responses.count;
+		memcpy(m->rtt_buckets, flow->rtt_buckets,
+		       sizeof(m->rtt_buckets));
+		m->rtt_sum = flow->statistics[FINAL].rtt_sum;
+		m->has_tcp_info = flow->fd != -1 && flow->state == GRIND &&
+				  !get_tcp_info(flow, &m->tcp_info);
+	}
+
+	metrics_release(snapshot);
+}
+
+/* Add the time since mark to the given counter and move mark to now */
+static inline void account_time(double *counter, struct timespec *mark)
+{
+	struct timespec now;
+
+	gettime_monotonic_fast(&now);
+	*counter += time_diff(mark, &now);
+	*mark = now;
+}
+
 void* daemon_main(void* ptr __attribute__((unused)))
 {
-	struct timespec timeout;
+	struct timespec timeout, mark;
+
+	gettime_monotonic_fast(&mark);
 	for (;;) {
-		int need_timeout = prepare_fds();
+		double wait = DEFAULT_SELECT_TIMEOUT / 1e9;
+		int need_timeout = prepare_fds(&wait);
+		account_time(&daemon_stats.prepare_time, &mark);
 
+		/* wake up in time for the next paced block */
+		ASSIGN_MAX(wait, 0.0);
 		timeout.tv_sec = 0;
-		timeout.tv_nsec = DEFAULT_SELECT_TIMEOUT;
+		timeout.tv_nsec = wait * 1e9;
 		DEBUG_MSG(LOG_DEBUG, "calling pselect() need_timeout: %i",
 			  need_timeout);
 		int rc = pselect(maxfd + 1, &rfds, &wfds, &efds,
 				 need_timeout ? &timeout : 0, NULL);
+		daemon_stats.syscalls++;
+		account_time(&daemon_stats.select_time, &mark);
 		if (rc < 0) {
 			if (errno == EINTR)
 				continue;
@@ -790,21 +1461,32 @@ void* daemon_main(void* ptr __attribute__((unused)))
 		if (FD_ISSET(daemon_pipe[0], &rfds))
 			process_requests();
 
+		/* all blocks of this iteration share one timestamp */
+		update_clock();
 		timer_check();
+		account_time(&daemon_stats.timer_time, &mark);
 		process_select(&rfds, &wfds, &efds);
+		publish_metrics();
+		account_time(&daemon_stats.process_time, &mark);
+		daemon_stats.loop_iterations++;
 	}
 }
 
-void add_report(struct _report* report)
+/* Queue a report for the controller. Returns -1 if the report was dropped */
+int add_report(struct _report* report)
 {
 	DEBUG_MSG(LOG_DEBUG, "add_report trying to lock mutex");
 	pthread_mutex_lock(&mutex);
 	DEBUG_MSG(LOG_DEBUG, "add_report aquired mutex");
 	/* Do not keep too much data */
-	if (pending_reports >= 250 && report->type != FINAL) {
+	if ((report->type == INTERVAL &&
+	     pending_reports >= MAX_PENDING_INTERVALS) ||
+	    (report->type == COMPLETION &&
+	     pending_reports >= MAX_PENDING_COMPLETIONS)) {
+		dropped_reports++;
 		free(report);
 		pthread_mutex_unlock(&mutex);
-		return;
+		return -1;
 	}
 
 	report->next = 0;
@@ -819,6 +1501,7 @@ void add_report(struct _report* report)
 
 	pthread_mutex_unlock(&mutex);
 	DEBUG_MSG(LOG_DEBUG, "add_report unlocked mutex");
+	return 0;
 }
 
 struct _report* get_reports(int *has_more)
@@ -854,11 +1537,87 @@ struct _report* get_reports(int *has_more)
 	return ret;
 }
 
+/* Allocate read/write blocks of a flow and fill in the payload pattern */
+int alloc_flow_blocks(struct _flow *flow)
+{
+	/* expected payload of received blocks (option -E) */
+	if (flow->settings.byte_counting && !byte_pattern[1]) {
+		for (unsigned int i = 0; i < sizeof(byte_pattern); i++)
+			byte_pattern[i] = (unsigned char)(i & 0xff);
+	}
+
+	/* be greedy with buffer sizes */
+	flow->write_block = calloc(1, flow->settings.maximum_block_size);
+	/* only the header of a received block is kept */
+	flow->read_block = calloc(1, MIN_BLOCK_SIZE);
+	flow->recv_buffer = malloc(RECEIVE_BUFFER_SIZE);
+
+	if (flow->write_block == NULL || flow->read_block == NULL ||
+	    flow->recv_buffer == NULL)
+		return -1;
+
+	/* blocks written with a single call (option --write-batch) */
+	if (flow->settings.write_batch > 1) {
+		flow->batch.blocks = calloc(flow->settings.write_batch,
+					    sizeof(struct _batch_block));
+		if (flow->batch.blocks == NULL)
+			return -1;
+	}
+
+	if (flow->settings.byte_counting) {
+		int byte_idx;
+		for (byte_idx = 0; byte_idx < flow->settings.maximum_block_size;
+		     byte_idx++)
+			*(flow->write_block + byte_idx) =
+				(unsigned char)(byte_idx & 0xff);
+	}
+	flow->payload = flow->write_block;
+	return 0;
+}
+
+/* Generate the payload pool of the flow (option --payload). The pool is
+ * shared with all flows of the daemon having the same payload */
+int init_payload(struct _flow *flow)
+{
+	const char *error = NULL;
+
+	if (flow->settings.payload == PAYLOAD_ZERO)
+		return 0;
+
+	flow->payload_pool = payload_pool_get(flow->settings.payload,
+					      flow->settings.payload_ratio,
+					      flow->settings.payload_file,
+					      flow->settings.maximum_block_size,
+					      &error);
+	if (!flow->payload_pool) {
+		flow_error(flow, "Unable to generate payload: %s", error);
+		return -1;
+	}
+	return 0;
+}
+
+/* Payload of the next request block of the given size. Consecutive blocks
+ * take their payload from consecutive offsets of the payload pool, so the
+ * payload is generated only once */
+static inline char *next_payload(struct _flow *flow, unsigned int size)
+{
+	char *payload;
+
+	if (!flow->payload_pool)
+		return flow->write_block;
+
+	payload = flow->payload_pool->data + flow->payload_offset;
+	flow->payload_offset = (flow->payload_offset + size) %
+			       PAYLOAD_POOL_SIZE;
+	return payload;
+}
+
 void init_flow(struct _flow* flow, int is_source)
 {
 	memset(flow, 0, sizeof(struct _flow));
 
 	flow->id = next_flow_id++;
+	flow->template_id = -1;
 	flow->endpoint = is_source ? SOURCE : DESTINATION;
 	flow->state = is_source ? GRIND_WAIT_CONNECT : GRIND_WAIT_ACCEPT;
 	flow->fd = -1;
@@ -887,52 +1646,369 @@ void init_flow(struct _flow* flow, int is_source)
 		flow->statistics[i].iat_max = FLT_MIN;
 		flow->statistics[i].iat_sum = 0.0F;
 		flow->statistics[i].delay_min = FLT_MAX;
-		flow->statistics[i].delay_max = FLT_MIN;
+		flow->statistics[i].delay_max = -FLT_MAX;
 		flow->statistics[i].delay_sum = 0.0F;
 	}
 
 	DEBUG_MSG(LOG_NOTICE, "called init flow %d", flow->id);
 }
 
+/* Fill in the header of a new request block. queued is the number of bytes
+ * of blocks started but not written yet. Returns 1 if a block was started,
+ * 0 if no block may be started now and -1 if the flow exceeded its
+ * congestion limit */
+int start_block(struct _flow *flow, struct _block *header,
+		unsigned int *size, unsigned long long queued)
+{
+	int response_block_size = 0;
+	struct timespec now;
+
+	/* finish the response block in progress first */
+	if (flow->responses.bytes_written)
+		return 0;
+	if (flow_pipeline_full(flow))
+		return 0;
+	/* a paced flow sends a new block only if it has a token left */
+	if (flow_paced(flow)) {
+		gettime_cached(&now);
+		refill_pacer(&now, flow);
+		if (flow->congestion_counter > CONGESTION_LIMIT &&
+		    flow->settings.flow_control)
+			return -1;
+		if (flow->pacing_tokens < 1)
+			return 0;
+		flow->pacing_tokens--;
+	}
+	*size = flow->next_block(flow, &response_block_size);
+	/* send exactly the given amount of data. As every block carries a
+	 * complete header, do not leave less than a header for the last
+	 * block, but shorten the block before */
+	if (flow->settings.write_bytes) {
+		unsigned long long left = flow->settings.write_bytes -
+			flow->statistics[FINAL].bytes_written - queued;
+
+		if (*size >= left)
+			*size = MAX(left, (unsigned)MIN_BLOCK_SIZE);
+		else if (left - *size < (unsigned)MIN_BLOCK_SIZE) {
+			if (left <= (unsigned)flow->settings.maximum_block_size)
+				*size = left;
+			else
+				*size = MAX(left - MIN_BLOCK_SIZE,
+					    (unsigned)MIN_BLOCK_SIZE);
+		}
+	}
+	/* serialize data:
+	 * this_block_size */
+	header->this_block_size = htonl(*size);
+	/* requested_block_size */
+	header->request_block_size = htonl(response_block_size);
+	/* write delay and rtt data (will be echoed back by the receiver in
+	 * the response packet) */
+	gettime_cached(&header->data);
+	gettime_monotonic_cached(&header->data2);
+	/* a request for a response starts a transaction */
+	if (response_block_size) {
+		header->transaction_id = htonl(flow->next_transaction_id++);
+		for (int i = 0; i < 2; i++)
+			ASSIGN_MAX(flow->statistics[i].outstanding_max,
+				   flow_outstanding(flow));
+	} else {
+		header->transaction_id = 0;
+	}
+
+	DEBUG_MSG(LOG_DEBUG, "wrote new request data to out buffer bs = %d, "
+		  "rqs = %d, on flow %d", ntohl(header->this_block_size),
+		  ntohl(header->request_block_size), flow->id);
+	return 1;
+}
+
+/* Account data of request blocks handed to the kernel by a single call */
+static void account_written(struct _flow *flow, int bytes)
+{
+	struct timespec now;
+
+	/* first data of the flow */
+	if (!flow->statistics[FINAL].bytes_written) {
+		gettime_cached(&now);
+		flow->start_skew = time_diff(&flow->scheduled_start, &now);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		flow->statistics[i].bytes_written += bytes;
+		flow->statistics[i].write_calls++;
+	}
+}
+
+/* Advance the interpacket gap schedule of the flow by the gap to the next
+ * block. Returns -1 if the flow exceeded its congestion limit */
+int schedule_next_block(struct _flow *flow)
+{
+	double interpacket_gap = flow->next_gap(flow);
+
+	/* if we calculated a non-zero packet add relative time to the next
+	 * write stamp which is then checked in the select call */
+	if (interpacket_gap) {
+		time_add(&flow->next_write_block_timestamp, interpacket_gap);
+		if (time_is_after(&flow->last_block_written,
+				  &flow->next_write_block_timestamp)) {
+			DEBUG_MSG(LOG_WARNING, "incipient congestion on flow "
+				  "%u new block scheduled for %s, %.6lfs before "
+				  "now.", flow->id,
+				  ctimespec(&flow->next_write_block_timestamp),
+				  time_diff(&flow->next_write_block_timestamp,
+					    &flow->last_block_written));
+			flow->congestion_counter++;
+			FG_PROBE(congestion, flow->id,
+				 flow->congestion_counter);
+			if (flow->congestion_counter > CONGESTION_LIMIT &&
+			    flow->settings.flow_control)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/* Record a completely written or read block in the event log (option -e
+ * of the daemon). Written blocks are sent now, read blocks carry the time
+ * they were sent in their header */
+static inline void log_block_event(struct _flow *flow, enum event_type type,
+				   unsigned int size,
+				   const struct timespec *sent, double rtt)
+{
+	struct timespec now;
+
+	if (!event_ring)
+		return;
+
+	gettime_cached(&now);
+	if (!sent)
+		events_record(flow->id, type, size, probe_ns(&now), 0, 0);
+	else
+		events_record(flow->id, type, size, probe_ns(sent),
+			      probe_ns(&now),
+			      rtt > 0 ? probe_duration_ns(rtt) : 0);
+}
+
+/* Account a completely written request block. Returns -1 if the flow
+ * exceeded its congestion limit and 1 if the flow has sent its amount of
+ * data */
+static int finish_block(struct _flow *flow, struct _block *header,
+			unsigned int size)
+{
+	struct timespec now;
+
+#ifndef HAVE_SYS_SDT_H
+	/* only passed to the probe */
+	UNUSED_ARGUMENT(header);
+#endif /* HAVE_SYS_SDT_H */
+	gettime_cached(&flow->last_block_written);
+	for (int i = 0; i < 2; i++)
+		flow->statistics[i].request_blocks_written++;
+	gettime_monotonic_cached(&now);
+	FG_PROBE(block_written, flow->id, size,
+		 (int)ntohl(header->request_block_size), probe_ns(&now));
+	log_block_event(flow, EVENT_REQUEST_WRITTEN, size, NULL, 0);
+
+	/* a batch is scheduled when its blocks are started */
+	if (!flow->batch.blocks && schedule_next_block(flow) == -1)
+		return -1;
+
+	if (flow->settings.cork && toggle_tcp_cork(flow->fd) == -1)
+		DEBUG_MSG(LOG_NOTICE, "failed to recork test socket for flow "
+			  "%d: %s", flow->id, strerror(errno));
+
+	/* stop sending as soon as the flow has transferred its amount of data
+	 * or replayed its trace */
+	if (flow_amount_sent(flow) || flow_trace_replayed(flow)) {
+		DEBUG_MSG(LOG_NOTICE, "flow %d sent its amount of data",
+			  flow->id);
+		flow->completion_timestamp = flow->last_block_written;
+		stop_writing(flow);
+		return 1;
+	}
+	return 0;
+}
+
+/* Start as many blocks as the interpacket gap schedule and the option
+ * --write-batch allow. Returns the number of blocks started or -1 if the
+ * flow exceeded its congestion limit */
+static int fill_batch(struct _flow *flow)
+{
+	struct _write_batch *batch = &flow->batch;
+	unsigned long long queued = 0;
+	struct timespec now;
+	int rc;
+
+	batch->count = 0;
+	batch->next = 0;
+
+	while (batch->count < (unsigned int)flow->settings.write_batch) {
+		struct _batch_block *block = &batch->blocks[batch->count];
+
+		/* do not start blocks beyond the amount of data given by -Z
+		 * or the end of the trace */
+		if ((flow->settings.write_blocks &&
+		     flow->statistics[FINAL].request_blocks_written +
+		     batch->count >= flow->settings.write_blocks) ||
+		    (flow->settings.write_bytes &&
+		     flow->statistics[FINAL].bytes_written + queued >=
+		     flow->settings.write_bytes) ||
+		    flow_trace_replayed(flow))
+			break;
+
+		rc = start_block(flow, &block->header, &block->size, queued);
+		if (rc == -1)
+			return -1;
+		if (!rc)
+			break;
+		block->payload = next_payload(flow, block->size);
+		queued += block->size;
+		batch->count++;
+
+		if (schedule_next_block(flow) == -1)
+			return -1;
+		gettime_cached(&now);
+		if (!flow_block_scheduled(&now, flow))
+			break;
+	}
+	return batch->count;
+}
+
+/* Write the started blocks of the batch with a single writev(). The headers
+ * of the blocks are followed by their payload */
+static int write_batch(struct _flow *flow)
+{
+	struct _write_batch *batch = &flow->batch;
+	struct iovec iov[2 * MAX_WRITE_BATCH];
+	unsigned int skip = flow->current_block_bytes_written;
+	int iovcnt = 0;
+	int rc;
+
+	if (batch->next == batch->count) {
+		rc = fill_batch(flow);
+		if (rc <= 0)
+			return rc;
+	} else {
+		/* blocks left over by a short write carry the time they
+		 * are actually written */
+		for (unsigned int i = batch->next + (skip ? 1 : 0);
+		     i < batch->count; i++) {
+			gettime_cached(&batch->blocks[i].header.data);
+			gettime_monotonic_cached(&batch->blocks[i].header.data2);
+		}
+	}
+
+	for (unsigned int i = batch->next; i < batch->count; i++) {
+		struct _batch_block *block = &batch->blocks[i];
+		unsigned int offset = i == batch->next ? skip : 0;
+
+		if (offset < (unsigned int)MIN_BLOCK_SIZE) {
+			iov[iovcnt].iov_base = (char *)&block->header + offset;
+			iov[iovcnt++].iov_len = MIN_BLOCK_SIZE - offset;
+			offset = MIN_BLOCK_SIZE;
+		}
+		if (block->size > offset) {
+			iov[iovcnt].iov_base = block->payload + offset;
+			iov[iovcnt++].iov_len = block->size - offset;
+		}
+	}
+
+	rc = writev(flow->fd, iov, iovcnt);
+	daemon_stats.syscalls++;
+
+	if (rc == -1) {
+		if (errno == EAGAIN) {
+			daemon_stats.write_eagain++;
+			logging_log(LOG_WARNING, "write queue limit hit for flow "
+				    "%d", flow->id);
+			return 0;
+		}
+		DEBUG_MSG(LOG_WARNING, "writev() returned %d on flow %d, fd %d: "
+			  "%s", rc, flow->id, flow->fd, strerror(errno));
+		flow_error(flow, "premature end of test: %s", strerror(errno));
+		return rc;
+	}
+
+	DEBUG_MSG(LOG_DEBUG, "flow %d sent %d bytes of %u request blocks",
+		  flow->id, rc, batch->count - batch->next);
+	account_written(flow, rc);
+
+	while (rc) {
+		struct _batch_block *block = &batch->blocks[batch->next];
+		unsigned int left = block->size -
+				    flow->current_block_bytes_written;
+
+		if ((unsigned int)rc < left) {
+			flow->current_block_bytes_written += rc;
+			break;
+		}
+		rc -= left;
+		flow->current_block_bytes_written = 0;
+		batch->next++;
+
+		switch (finish_block(flow, &block->header, block->size)) {
+		case -1:
+			return -1;
+		case 1:
+			batch->next = batch->count;
+			return 0;
+		}
+	}
+	return 0;
+}
+
+/* Write the rest of the current request block. Without a payload pool the
+ * payload follows the header in the write block */
+static int write_block_data(struct _flow *flow)
+{
+	unsigned int offset = flow->current_block_bytes_written;
+	unsigned int size = flow->current_write_block_size;
+	struct iovec iov[2];
+	int iovcnt = 0;
+
+	if (flow->payload == flow->write_block)
+		return write(flow->fd, flow->write_block + offset,
+			     size - offset);
+
+	if (offset < (unsigned int)MIN_BLOCK_SIZE) {
+		iov[iovcnt].iov_base = flow->write_block + offset;
+		iov[iovcnt++].iov_len = MIN_BLOCK_SIZE - offset;
+		offset = MIN_BLOCK_SIZE;
+	}
+	if (size > offset) {
+		iov[iovcnt].iov_base = flow->payload + offset;
+		iov[iovcnt++].iov_len = size - offset;
+	}
+	return writev(flow->fd, iov, iovcnt);
+}
+
 static int write_data(struct _flow *flow)
 {
 	int rc = 0;
-	int response_block_size = 0;
-	double interpacket_gap = .0;
+
+	if (flow->batch.blocks)
+		return write_batch(flow);
+
 	for (;;) {
 
 		/* fill buffer with new data */
 		if (flow->current_block_bytes_written == 0) {
-			flow->current_write_block_size =
-				next_request_block_size(flow);
-			response_block_size = next_response_block_size(flow);
-			/* serialize data:
-			 * this_block_size */
-			((struct _block *)flow->write_block)->this_block_size =
-				htonl(flow->current_write_block_size);
-			/* requested_block_size */
-			((struct _block *)flow->write_block)->request_block_size =
-				htonl(response_block_size);
-			/* write rtt data (will be echoed back by the receiver
-			 * in the response packet) */
-			gettime((struct timespec *)
-				(flow->write_block + 2 * (sizeof (int32_t))));
-
-			DEBUG_MSG(LOG_DEBUG, "wrote new request data to out "
-				  "buffer bs = %d, rqs = %d, on flow %d",
-				  ntohl(((struct _block *)flow->write_block)->this_block_size),
-				  ntohl(((struct _block *)flow->write_block)->request_block_size),
-				  flow->id);
+			rc = start_block(flow, (struct _block *)flow->write_block,
+					 &flow->current_write_block_size, 0);
+			if (rc == -1)
+				return -1;
+			if (!rc)
+				break;
+			flow->payload = next_payload(flow,
+					flow->current_write_block_size);
 		}
 
-		rc = write(flow->fd,
-			   flow->write_block +
-			   flow->current_block_bytes_written,
-			   flow->current_write_block_size -
-			   flow->current_block_bytes_written);
+		rc = write_block_data(flow);
+		daemon_stats.syscalls++;
 
 		if (rc == -1) {
 			if (errno == EAGAIN) {
+				daemon_stats.write_eagain++;
 				logging_log(LOG_WARNING, "write queue limit hit "
 					    "for flow %d", flow->id);
 				break;
@@ -956,9 +2032,7 @@ static int write_data(struct _flow *flow)
 			  flow->current_write_block_size,
 			  flow->current_block_bytes_written);
 
-		for (int i = 0; i < 2; i++)
-			flow->statistics[i].bytes_written += rc;
-
+		account_written(flow, rc);
 		flow->current_block_bytes_written += rc;
 
 		if (flow->current_block_bytes_written >=
@@ -969,50 +2043,29 @@ static int write_data(struct _flow *flow)
 #endif
 			/* we just finished writing a block */
 			flow->current_block_bytes_written = 0;
-			gettime(&flow->last_block_written);
-			for (int i = 0; i < 2; i++)
-				flow->statistics[i].request_blocks_written++;
-
-			interpacket_gap = next_interpacket_gap(flow);
-
-			/* if we calculated a non-zero packet add relative time
-			 * to the next write stamp which is then checked in the
-			 * select call */
-			if (interpacket_gap) {
-				time_add(&flow->next_write_block_timestamp,
-					 interpacket_gap);
-				if (time_is_after(&flow->last_block_written,
-						  &flow->next_write_block_timestamp)) {
-					DEBUG_MSG(LOG_WARNING, "incipient "
-						  "congestion on flow %u new "
-						  "block scheduled for %s, "
-						  "%.6lfs before now.",
-						   flow->id,
-						   ctimespec(&flow->next_write_block_timestamp),
-						   time_diff(&flow->next_write_block_timestamp,
-							     &flow->last_block_written));
-					flow->congestion_counter++;
-					if (flow->congestion_counter >
-					    CONGESTION_LIMIT &&
-					    flow->settings.flow_control)
-						return -1;
-				}
-			}
-			if (flow->settings.cork && toggle_tcp_cork(flow->fd) == -1)
-				DEBUG_MSG(LOG_NOTICE, "failed to recork test "
-					  "socket for flow %d: %s",
-					  flow->id, strerror(errno));
+			rc = finish_block(flow,
+					  (struct _block *)flow->write_block,
+					  flow->current_write_block_size);
+			if (rc == -1)
+				return -1;
+			if (rc == 1)
+				break;
 		}
 
-		if (!flow->settings.pushy)
+		/* a paced flow sends its burst at once */
+		if (!flow->settings.pushy && !flow_paced(flow))
 			break;
 	}
 	return 0;
 }
 
-static inline int try_read_n_bytes(struct _flow *flow, int bytes)
+/* Receive as much data as fits into the receive buffer of the flow with a
+ * single call. Returns the number of bytes received, 0 if the socket holds
+ * no data and -1 if the flow ends */
+static int receive_data(struct _flow *flow)
 {
 	int rc;
+	unsigned int bytes;
 	struct iovec iov;
 	struct msghdr msg;
 /* we only read out of band data for debugging purpose */
@@ -1022,8 +2075,16 @@ static inline int try_read_n_bytes(struct _flow *flow, int bytes)
 #else
 	char cbuf[16];
 #endif
-	iov.iov_base = flow->read_block +
-		       flow->current_block_bytes_read;
+	/* move the data not parsed yet to the front */
+	if (flow->recv_pos) {
+		memmove(flow->recv_buffer, flow->recv_buffer + flow->recv_pos,
+			flow->recv_len - flow->recv_pos);
+		flow->recv_len -= flow->recv_pos;
+		flow->recv_pos = 0;
+	}
+	bytes = RECEIVE_BUFFER_SIZE - flow->recv_len;
+
+	iov.iov_base = flow->recv_buffer + flow->recv_len;
 	iov.iov_len = bytes;
 	/* no name required */
 	msg.msg_name = NULL;
@@ -1034,19 +2095,36 @@ static inline int try_read_n_bytes(struct _flow *flow, int bytes)
 	msg.msg_controllen = sizeof(cbuf);
 
 	rc = recvmsg(flow->fd, &msg, 0);
+	daemon_stats.syscalls++;
 
-	DEBUG_MSG(LOG_DEBUG, "tried reading %d bytes, got %d", bytes, rc);
+	DEBUG_MSG(LOG_DEBUG, "tried reading %u bytes, got %d", bytes, rc);
 
 	if (rc == -1) {
 		if (errno == EAGAIN)
-			flow_error(flow, "Premature end of test: %s",
-				   strerror(errno));
-			return -1;
+			return 0;
+		flow_error(flow, "Premature end of test: %s",
+			   strerror(errno));
+		return -1;
 	}
 
 	if (rc == 0) {
 		DEBUG_MSG(LOG_ERR, "server shut down test socket of "
 			  "flow %d", flow->id);
+		/* peer is limited by amount of data (option -Z) and closed the
+		 * connection after the last block */
+		if (flow->settings.duration[READ] < 0 &&
+		    !flow->current_block_bytes_read) {
+			/* without any data received the close by the peer
+			 * completes the flow */
+			if (flow->last_block_read.tv_sec ||
+			    flow->last_block_read.tv_nsec)
+				flow->completion_timestamp =
+					flow->last_block_read;
+			else
+				gettime(&flow->completion_timestamp);
+			flow->finished[READ] = 1;
+			return -1;
+		}
 		if (!flow->finished[READ] || !flow->settings.shutdown)
 			warnx("premature shutdown of server flow");
 			flow->finished[READ] = 1;
@@ -1055,7 +2133,7 @@ static inline int try_read_n_bytes(struct _flow *flow, int bytes)
 
 	DEBUG_MSG(LOG_DEBUG, "flow %d received %u bytes", flow->id, rc);
 
-	flow->current_block_bytes_read += rc;
+	flow->recv_len += rc;
 	for (int i = 0; i < 2; i++)
 		flow->statistics[i].bytes_read += rc;
 
@@ -1069,111 +2147,233 @@ static inline int try_read_n_bytes(struct _flow *flow, int bytes)
 	return rc;
 }
 
-static int read_data(struct _flow *flow)
+/* Parse and check the header of the current block, which is complete in
+ * the read block */
+static void parse_block_header(struct _flow *flow)
 {
-	int rc = 0;
 	int optint = 0;
-	int requested_response_block_size = 0;
 
-	for (;;) {
+	/* parse and check current block size for validity */
+	optint = ntohl( ((struct _block *)flow->read_block)->this_block_size );
+	if (optint >= MIN_BLOCK_SIZE &&
+	    optint <= flow->settings.maximum_block_size )
+		flow->current_read_block_size = optint;
+	else
+		logging_log(LOG_WARNING, "flow %d parsed illegal cbs %d, "
+			    "ignoring (max: %d)", flow->id, optint,
+			    flow->settings.maximum_block_size);
+
+	/* parse and check current request size for validity */
+	optint = ntohl( ((struct _block *)flow->read_block)->request_block_size );
+	if (optint == -1 || optint == 0  ||
+	    (optint >= MIN_BLOCK_SIZE &&
+	     optint <= flow->settings.maximum_block_size))
+		flow->requested_response_block_size = optint;
+	else
+		logging_log(LOG_WARNING, "flow %d parsed illegal qbs "
+			    "%d, ignoring (max: %d)",
+			    flow->id,
+			    optint,
+			    flow->settings.maximum_block_size);
+#ifdef DEBUG
+	if (flow->requested_response_block_size == -1) {
+		DEBUG_MSG(LOG_NOTICE, "processing response block on "
+			  "flow %d size: %d", flow->id,
+			  flow->current_read_block_size);
+	} else {
+		DEBUG_MSG(LOG_NOTICE, "processing request block on "
+			  "flow %d size: %d, request: %d",
+			  flow->id,
+			  flow->current_read_block_size,
+			  flow->requested_response_block_size);
+	}
+#endif
+}
+
+/* Account the block just read completely */
+static void process_block(struct _flow *flow)
+{
+	int requested_response_block_size = flow->requested_response_block_size;
+#ifdef HAVE_SYS_SDT_H
+	struct timespec now;
+
+	gettime_monotonic_cached(&now);
+#endif /* HAVE_SYS_SDT_H */
+	FG_PROBE(block_read, flow->id, flow->current_read_block_size,
+		 requested_response_block_size, probe_ns(&now));
+
+	if (requested_response_block_size == -1) {
+		/* this is a response block, consider DATA as RTT  */
+		for (int i = 0; i < 2; i++)
+			flow->statistics[i].response_blocks_read++;
+		process_transaction(flow);
+		process_rtt(flow);
+	} else {
+		/* this is a request block, calculate IAT */
+		for (int i = 0; i < 2; i++)
+			flow->statistics[i].request_blocks_read++;
+		process_iat(flow);
+		process_delay(flow);
+		log_block_event(flow, EVENT_REQUEST_READ,
+				flow->current_read_block_size,
+				&((struct _block *)flow->read_block)->data, 0);
+
+		/* send response if requested */
+		if (requested_response_block_size >= (signed)MIN_BLOCK_SIZE &&
+		    !flow->finished[READ])
+			send_response(flow, requested_response_block_size);
+	}
+}
+
+/* Compare the payload of the current block just received against the
+ * pattern of byte counting (option -E). memcmp() of the C library is
+ * vectorized (SSE4.2/AVX2 on x86), the bytes are only scanned one by one to
+ * locate a corruption. Each corrupted block is counted once */
+static void verify_payload(struct _flow *flow, unsigned int n)
+{
+	const unsigned char *data =
+		(unsigned char *)flow->recv_buffer + flow->recv_pos;
+	const unsigned char *expected =
+		byte_pattern + (flow->current_block_bytes_read & 0xff);
+	unsigned long long offset;
+	unsigned int i = 0;
+
+	if (flow->block_corrupted || !memcmp(data, expected, n))
+		return;
+
+	while (data[i] == expected[i])
+		i++;
+	/* position of the bad byte in the data received by the flow */
+	offset = (unsigned long long)flow->statistics[FINAL].bytes_read -
+		 (flow->recv_len - flow->recv_pos) + i;
+
+	if (!flow->statistics[FINAL].corrupted_blocks)
+		logging_log(LOG_WARNING, "flow %d received corrupted block, "
+			    "first bad byte at offset %u of the block (byte "
+			    "%llu of the flow)", flow->id,
+			    flow->current_block_bytes_read + i, offset);
+
+	flow->block_corrupted = 1;
+	for (int j = 0; j < 2; j++) {
+		if (!flow->statistics[j].corrupted_blocks)
+			flow->statistics[j].corruption_offset = offset;
+		flow->statistics[j].corrupted_blocks++;
+	}
+}
+
+/* Parse all blocks in the receive buffer. Only the block headers are copied
+ * into the read block, the payload is skipped. All blocks of a receive call
+ * share the timestamp of the loop iteration. While the response queue is
+ * full the remaining blocks stay in the buffer */
+static void parse_blocks(struct _flow *flow)
+{
+	unsigned int n;
+
+	while (flow->recv_pos < flow->recv_len) {
+		if (!flow->current_block_bytes_read &&
+		    flow->responses.count == RESPONSE_QUEUE_SIZE)
+			break;
+
 		/* make sure to read block header for new block */
 		if (flow->current_block_bytes_read < MIN_BLOCK_SIZE) {
-			rc = try_read_n_bytes(flow,
-					      MIN_BLOCK_SIZE-flow->current_block_bytes_read);
-			if (flow->current_block_bytes_read < MIN_BLOCK_SIZE)
+			n = MIN(flow->recv_len - flow->recv_pos,
+				MIN_BLOCK_SIZE - flow->current_block_bytes_read);
+			memcpy(flow->read_block + flow->current_block_bytes_read,
+			       flow->recv_buffer + flow->recv_pos, n);
+			flow->recv_pos += n;
+			flow->current_block_bytes_read += n;
+			if (flow->current_block_bytes_read < MIN_BLOCK_SIZE) {
+				flow->block_split = 1;
 				break;
+			}
+			parse_block_header(flow);
 		}
-		/* parse data and update status */
 
-		/* parse and check current block size for validity */
-		optint = ntohl( ((struct _block *)flow->read_block)->this_block_size );
-		if (optint >= MIN_BLOCK_SIZE &&
-		    optint <= flow->settings.maximum_block_size )
-			flow->current_read_block_size = optint;
-		else
-			logging_log(LOG_WARNING, "flow %d parsed illegal cbs %d, "
-				    "ignoring (max: %d)", flow->id, optint,
-				    flow->settings.maximum_block_size);
-
-		/* parse and check current request size for validity */
-		optint = ntohl( ((struct _block *)flow->read_block)->request_block_size );
-		if (optint == -1 || optint == 0  ||
-		    (optint >= MIN_BLOCK_SIZE &&
-		     optint <= flow->settings.maximum_block_size))
-			requested_response_block_size = optint;
-		else
-			logging_log(LOG_WARNING, "flow %d parsed illegal qbs "
-				    "%d, ignoring (max: %d)",
-				    flow->id,
-				    optint,
-				    flow->settings.maximum_block_size);
-#ifdef DEBUG
-		if (requested_response_block_size == -1) {
-			DEBUG_MSG(LOG_NOTICE, "processing response block on "
-				  "flow %d size: %d", flow->id,
-				  flow->current_read_block_size);
-		} else {
-			DEBUG_MSG(LOG_NOTICE, "processing request block on "
-				  "flow %d size: %d, request: %d",
-				  flow->id,
-				  flow->current_read_block_size,
-				  requested_response_block_size);
-		}
-#endif
-		/* read rest of block, if we have more to read */
+		/* skip rest of block, as far as received */
+		n = MIN(flow->recv_len - flow->recv_pos,
+			flow->current_read_block_size -
+			flow->current_block_bytes_read);
+		if (flow->settings.byte_counting && n)
+			verify_payload(flow, n);
+		flow->recv_pos += n;
+		flow->current_block_bytes_read += n;
 		if (flow->current_block_bytes_read <
-		    flow->current_read_block_size)
-			rc += try_read_n_bytes(flow,
-					       flow->current_read_block_size -
-					       flow->current_block_bytes_read);
-
-		if (flow->current_block_bytes_read >=
-		    flow->current_read_block_size ) {
-#ifdef DEBUG
-			assert(flow->current_block_bytes_read ==
-					flow->current_read_block_size);
-#endif
-			flow->current_block_bytes_read = 0;
-
-			/* TODO process_rtt(), process_iat(), and
-			 * process_delay () call all gettime().
-			 * Quite inefficient... */
-
-			if (requested_response_block_size == -1) {
-				/* this is a response block, consider DATA as
-				 * RTT  */
-				for (int i = 0; i < 2; i++)
-					flow->statistics[i].response_blocks_read++;
-				process_rtt(flow);
-			} else {
-				/* this is a request block, calculate IAT */
-				for (int i = 0; i < 2; i++)
-					flow->statistics[i].request_blocks_read++;
-				process_iat(flow);
-				process_delay(flow);
-
-				/* send response if requested */
-				if (requested_response_block_size >=
-				    (signed)MIN_BLOCK_SIZE && !flow->finished[READ])
-					send_response(flow,
-						      requested_response_block_size);
-			}
+		    flow->current_read_block_size) {
+			flow->block_split = 1;
+			break;
 		}
+
+		if (flow->block_split)
+			daemon_stats.split_blocks++;
+		else
+			daemon_stats.whole_blocks++;
+		flow->current_block_bytes_read = 0;
+		flow->block_corrupted = 0;
+		flow->block_split = 0;
+		process_block(flow);
+	}
+}
+
+static int read_data(struct _flow *flow)
+{
+	int rc = 0;
+
+	parse_blocks(flow);
+
+	/* receive only once the response queue took all parsed blocks */
+	while (flow->recv_pos == flow->recv_len) {
+		rc = receive_data(flow);
+		if (rc <= 0)
+			break;
+		parse_blocks(flow);
 		if (!flow->settings.pushy)
 			break;
 	}
 	return rc;
 }
 
+/* Match a response block to its transaction. Transactions the responder
+ * skipped are counted as lost */
+static void process_transaction(struct _flow *flow)
+{
+	uint32_t id =
+		ntohl(((struct _block *)flow->read_block)->transaction_id);
+	uint32_t skipped = id - flow->next_response_id;
+
+	if (skipped >= flow_outstanding(flow)) {
+		logging_log(LOG_WARNING, "flow %d received response block of "
+			    "unknown transaction %u, ignoring", flow->id, id);
+		return;
+	}
+
+	flow->next_response_id = id + 1;
+	for (int i = 0; i < 2; i++)
+		flow->statistics[i].transactions_lost += skipped;
+
+	DEBUG_MSG(LOG_NOTICE, "processed transaction %u of flow %d, %u "
+		  "outstanding", id, flow->id, flow_outstanding(flow));
+}
+
 static void process_rtt(struct _flow* flow)
 {
 	double current_rtt = .0;
 	struct timespec now;
-	struct timespec *data = (struct timespec *)
-		(flow->read_block + 2*(sizeof (int32_t)));
+	struct _block *block = (struct _block *)flow->read_block;
+
+	/* the monotonic timestamp is not echoed back by receivers on 32bit
+	 * arch, fall back to the wall-clock time */
+	gettime_monotonic_cached(&now);
+	if (block->data2.tv_nsec >= 0 && block->data2.tv_nsec < NSEC_PER_SEC &&
+	    (block->data2.tv_sec || block->data2.tv_nsec))
+		current_rtt = time_diff(&block->data2, &now);
+	else
+		current_rtt = -1;
 
-	gettime(&now);
-	current_rtt = time_diff(data, &now);
+	flow->last_block_read_monotonic = now;
+
+	gettime_cached(&now);
+	if (current_rtt < 0)
+		current_rtt = time_diff(&block->data, &now);
 
 	if (current_rtt < 0) {
 		logging_log(LOG_CRIT, "received malformed rtt block of flow %d "
@@ -1190,7 +2390,11 @@ static void process_rtt(struct _flow* flow)
 			ASSIGN_MAX(flow->statistics[i].rtt_max, current_rtt);
 			flow->statistics[i].rtt_sum += current_rtt;
 		}
+		flow->rtt_buckets[metrics_rtt_bucket(current_rtt)]++;
+		FG_PROBE(rtt, flow->id, probe_duration_ns(current_rtt));
 	}
+	log_block_event(flow, EVENT_RESPONSE_READ, flow->current_read_block_size,
+			&block->data, current_rtt);
 
 	DEBUG_MSG(LOG_NOTICE, "processed RTT of flow %d (%.3lfms)",
 		  flow->id, current_rtt * 1e3);
@@ -1201,13 +2405,14 @@ static void process_iat(struct _flow* flow)
 	double current_iat = .0;
 	struct timespec now;
 
-	gettime(&now);
+	gettime_monotonic_cached(&now);
 
-	if (flow->last_block_read.tv_sec ||
-	    flow->last_block_read.tv_nsec)
-		current_iat = time_diff(&flow->last_block_read, &now);
+	if (flow->last_block_read_monotonic.tv_sec ||
+	    flow->last_block_read_monotonic.tv_nsec)
+		current_iat = time_diff(&flow->last_block_read_monotonic, &now);
 	else
 		current_iat = NAN;
+	flow->last_block_read_monotonic = now;
 
 	if (current_iat < 0) {
 		logging_log(LOG_CRIT, "calculated malformed iat of flow %d "
@@ -1216,7 +2421,7 @@ static void process_iat(struct _flow* flow)
 		current_iat = NAN;
 	}
 
-	flow->last_block_read = now;
+	gettime_cached(&flow->last_block_read);
 
 	if (!isnan(current_iat)) {
 		for (int i = 0; i < 2; i++) {
@@ -1233,115 +2438,135 @@ static void process_delay(struct _flow* flow)
 {
 	double current_delay = .0;
 	struct timespec now;
-	struct timespec *data = (struct timespec *)
-		(flow->read_block + 2*(sizeof (int32_t)));
+	struct timespec *data = &((struct _block *)flow->read_block)->data;
 
-	gettime(&now);
+	/* negative if the clock of the sender is ahead. The controller
+	 * corrects the delay by the estimated clock offset */
+	gettime_cached(&now);
 	current_delay = time_diff(data, &now);
 
-	if (current_delay < 0) {
-		logging_log(LOG_CRIT, "calculated malformed delay of flow "
-			    "%d (rtt = %.3lfms) (clocks out-of-sync?), "
-			    "ignoring", flow->id, current_delay * 1e3);
-		current_delay = NAN;
-	}
-
-	if (!isnan(current_delay)) {
-		for (int i = 0; i < 2; i++) {
-			ASSIGN_MIN(flow->statistics[i].delay_min,
-				   current_delay);
-			ASSIGN_MAX(flow->statistics[i].delay_max,
-				   current_delay);
-			flow->statistics[i].delay_sum += current_delay;
-		}
+	for (int i = 0; i < 2; i++) {
+		ASSIGN_MIN(flow->statistics[i].delay_min, current_delay);
+		ASSIGN_MAX(flow->statistics[i].delay_max, current_delay);
+		flow->statistics[i].delay_sum += current_delay;
 	}
 
 	DEBUG_MSG(LOG_NOTICE, "processed delay of flow %d (%.3lfms)",
 		  flow->id, current_delay * 1e3);
 }
 
-static void send_response(struct _flow* flow, int requested_response_block_size)
+/* Write the queued response blocks until the socket would block. A response
+ * block is not started while a request block is only partially written,
+ * since both share the stream and the write buffer */
+static int write_responses(struct _flow *flow)
 {
+	struct _response_queue *queue = &flow->responses;
+	struct _block *block = (struct _block *)flow->write_block;
+	struct timespec now;
+	double delay;
 	int rc;
-	int try = 0;
-#ifdef DEBUG
-	assert(!flow->current_block_bytes_written);
-#endif
-	/* write requested block size as current size */
-	((struct _block *)flow->write_block)->this_block_size =
-		htonl(requested_response_block_size);
-	/* rqs = -1 indicates response block */
-	((struct _block *)flow->write_block)->request_block_size = htonl(-1);
-	/* copy rtt data from received block to response block (echo back) */
-	((struct _block *)flow->write_block)->data =
-		((struct _block *)flow->read_block)->data;
-	/* workaround for 64bit sender and 32bit receiver: we check if the
-	 * timespec is 64bit and then echo the missing 32bit back, too */
-	if ((((struct _block *)flow->write_block)->data.tv_sec) ||
-	    ((struct _block *)flow->write_block)->data.tv_nsec)
-		((struct _block *)flow->write_block)->data2 =
-			((struct _block *)flow->read_block)->data2;
-
-	DEBUG_MSG(LOG_DEBUG, "wrote new response data to out buffer bs = %d, "
-		  "rqs = %d on flow %d",
-		  ntohl(((struct _block *)flow->write_block)->this_block_size),
-		  ntohl(((struct _block *)flow->write_block)->request_block_size),
-		  flow->id);
-
-	/* send data out until block is finished (or abort if 0 zero bytes are
-	 * send CONGESTION_LIMIT times) */
-	for (;;) {
-		rc = write(flow->fd,
-			   flow->write_block + flow->current_block_bytes_written,
-			   requested_response_block_size -
-				flow->current_block_bytes_written);
+
+	while (queue->count && !flow->current_block_bytes_written) {
+		struct _response *response = &queue->blocks[queue->head];
+
+		if (!queue->bytes_written) {
+			/* write requested block size as current size */
+			block->this_block_size = htonl(response->size);
+			/* rqs = -1 indicates response block */
+			block->request_block_size = htonl(-1);
+			/* echo back the timestamps of the request block. On
+			 * 32bit arch data2 also holds the upper half of the
+			 * timespec of a 64bit sender */
+			block->data = response->data;
+			block->data2 = response->data2;
+			block->transaction_id = response->transaction_id;
+
+			DEBUG_MSG(LOG_DEBUG, "wrote new response data to out "
+				  "buffer bs = %d, rqs = %d on flow %d",
+				  response->size, -1, flow->id);
+		}
+
+		rc = write(flow->fd, flow->write_block + queue->bytes_written,
+			   response->size - queue->bytes_written);
+		daemon_stats.syscalls++;
 
 		DEBUG_MSG(LOG_NOTICE, "send %d bytes response (rqs %d) on flow "
-			  "%d", rc, requested_response_block_size,flow->id);
+			  "%d", rc, response->size, flow->id);
 
 		if (rc == -1) {
 			if (errno == EAGAIN) {
-				DEBUG_MSG(LOG_DEBUG,
-					  "%s, still trying to send response "
-					  "block (write queue hit limit)",
-					  strerror(errno));
-				try++;
-				if (try >= CONGESTION_LIMIT &&
-				    !flow->current_block_bytes_written) {
-					logging_log(LOG_WARNING,
-						    "tried to send response "
-						    "block %d times without "
-						    "success, dropping (%s)",
-						    try, strerror(errno));
-						break;
-				}
-			} else {
-				logging_log(LOG_WARNING,
-					    "Premature end of test: %s, abort "
-					    "flow", strerror(errno));
-				flow->finished[READ] = 1;
-				break;
+				daemon_stats.write_eagain++;
+				DEBUG_MSG(LOG_DEBUG, "write queue limit hit, %u "
+					  "response blocks of flow %d pending",
+					  queue->count, flow->id);
+				return 0;
 			}
-		} else {
-			flow->current_block_bytes_written += rc;
-			for (int i = 0; i < 2; i++)
-				flow->statistics[i].bytes_written += rc;
+			logging_log(LOG_WARNING, "Premature end of test: %s, "
+				    "abort flow with %u response blocks pending",
+				    strerror(errno), queue->count);
+			flow->finished[READ] = 1;
+			queue->count = 0;
+			queue->bytes_written = 0;
+			return -1;
+		}
+
+		queue->bytes_written += rc;
+		for (int i = 0; i < 2; i++)
+			flow->statistics[i].bytes_written += rc;
+
+		if (queue->bytes_written < (unsigned int)response->size)
+			continue;
 
-			if (flow->current_block_bytes_written >=
-			    (unsigned int)requested_response_block_size) {
 #ifdef DEBUG
-				assert(flow->current_block_bytes_written ==
-					(unsigned int)requested_response_block_size);
+		assert(queue->bytes_written == (unsigned int)response->size);
 #endif
-				/* just finish sending response block */
-				flow->current_block_bytes_written = 0;
-				gettime(&flow->last_block_written);
-				for (int i = 0; i < 2; i++)
-					flow->statistics[i].response_blocks_written++;
-				break;
-			}
+		/* just finished sending response block */
+		queue->bytes_written = 0;
+		queue->head = (queue->head + 1) % RESPONSE_QUEUE_SIZE;
+		queue->count--;
+
+		gettime_cached(&flow->last_block_written);
+		gettime_monotonic_cached(&now);
+		delay = time_diff(&response->queued, &now);
+		for (int i = 0; i < 2; i++) {
+			flow->statistics[i].response_blocks_written++;
+			ASSIGN_MAX(flow->statistics[i].response_delay_max, delay);
+			flow->statistics[i].response_delay_sum += delay;
 		}
+		FG_PROBE(response_sent, flow->id, response->size,
+			 probe_ns(&now));
+		log_block_event(flow, EVENT_RESPONSE_WRITTEN, response->size,
+				NULL, 0);
 	}
+	return 0;
+}
+
+/* Queue a response to the request block just read and write out as much of
+ * the queue as the socket takes. The rest is written when the socket becomes
+ * writable again, so a slow requester never stalls the other flows */
+static void send_response(struct _flow* flow, int requested_response_block_size)
+{
+	struct _response_queue *queue = &flow->responses;
+	struct _response *response;
+
+#ifdef DEBUG
+	assert(queue->count < RESPONSE_QUEUE_SIZE);
+#endif
+	response = &queue->blocks[(queue->head + queue->count) %
+				  RESPONSE_QUEUE_SIZE];
+	response->size = requested_response_block_size;
+	response->data = ((struct _block *)flow->read_block)->data;
+	response->data2 = ((struct _block *)flow->read_block)->data2;
+	response->transaction_id =
+		((struct _block *)flow->read_block)->transaction_id;
+	gettime_monotonic_cached(&response->queued);
+	queue->count++;
+
+	for (int i = 0; i < 2; i++)
+		ASSIGN_MAX(flow->statistics[i].response_queue_max,
+			   queue->count);
+
+	write_responses(flow);
 }
 
 
@@ -1451,6 +2676,18 @@ int set_flow_tcp_options(struct _flow *flow)
 			   strerror(errno));
 		return -1;
 	}
+	if (flow->settings.kernel_pacing && flow->settings.write_rate) {
+		double rate = (double)flow->settings.write_rate *
+			      flow->settings.maximum_block_size;
+
+		ASSIGN_MIN(rate, (double)UINT32_MAX - 1);
+		if (set_so_max_pacing_rate(flow->fd,
+					   (unsigned int)rate) == -1) {
+			flow_error(flow, "Unable to set SO_MAX_PACING_RATE: "
+				   "%s", strerror(errno));
+			return -1;
+		}
+	}
 	if (apply_extra_socket_options(flow) == -1)
 		return -1;
 
@@ -29,15 +29,48 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
-#ifdef HAVE_LIBGSL
-#include <gsl/gsl_rng.h>
-#endif /* HAVE_LIBGSL */
+#include <stdint.h>
 
 #include "common.h"
+#include "fg_metrics.h"
+#include "fg_payload.h"
+#include "fg_trace.h"
 
 /** time select() will block waiting for a file descriptor to become ready */
 #define DEFAULT_SELECT_TIMEOUT  10000000
 
+/** Time a destination keeps accepting spawned flows after its test period,
+ * in seconds. Covers the start offset between source and destination */
+#define DYNAMIC_ACCEPT_GRACE 1.0
+
+/** Default burst of the rate pacer, in seconds worth of the flow rate */
+#define DEFAULT_PACING_BURST 0.001
+
+/** Number of values the traffic generator draws at once from a distribution */
+#define TRAFGEN_BATCH 32
+
+/** Size of the buffer a flow receives into, in bytes. A single receive
+ * call fetches all blocks that fit */
+#define RECEIVE_BUFFER_SIZE 65536
+
+/** Number of response blocks a flow may have waiting for the socket. No
+ * further request block is read while the queue is full */
+#define RESPONSE_QUEUE_SIZE 32
+
+/** Number of distinct pairs of request and response size a trace may have
+ * to be sampled (option --trace FILE:sample) */
+#define TRACE_SAMPLE_MAX_PAIRS (1 << 20)
+
+/** Number of pending reports from which on interval reports are dropped */
+#define MAX_PENDING_INTERVALS 250
+
+/** Number of pending reports from which on completion reports of spawned
+ * flows are dropped. Their count is sent with the final report instead */
+#define MAX_PENDING_COMPLETIONS 8192
+
+/** Number of flows spawned at most from one flow per event loop iteration */
+#define MAX_SPAWNS_PER_TICK 16
+
 enum flow_state
 {
 	/* SOURCE */
@@ -58,9 +91,91 @@ struct _flow_source_settings
 	pthread_cond_t* add_source_condition;
 };
 
+/** CPU time consumed up to a point in time */
+struct _cpu_sample
+{
+	/** Monotonic point in time the sample was taken */
+	struct timespec time;
+	/** CPU time of the daemon thread in user and kernel mode, in
+	 * seconds @{ */
+	double user;
+	double system;						/** @} */
+	/** CPU time of all CPUs of the host spent in softirqs, in seconds */
+	double softirq;
+};
+
+/** Values drawn in advance from the distribution of a traffic generation
+ * parameter */
+struct _trafgen_ring
+{
+	/** Number of values not used yet */
+	unsigned int count;
+	double values[TRAFGEN_BATCH];
+};
+
+/** Request block of a batch written with a single call */
+struct _batch_block
+{
+	/** Header of the block */
+	struct _block header;
+	/** Size of the block */
+	unsigned int size;
+	/** Payload of the block, indexed by the offset in the block */
+	char *payload;
+};
+
+/** Request blocks written with a single call (option --write-batch) */
+struct _write_batch
+{
+	/** Number of blocks started */
+	unsigned int count;
+	/** Index of the block written next, current_block_bytes_written of
+	 * it are written */
+	unsigned int next;
+	/** settings.write_batch blocks, NULL if blocks are written one by
+	 * one */
+	struct _batch_block *blocks;
+};
+
+/** Response block waiting for the socket to become writable */
+struct _response
+{
+	/** Size of the response block */
+	int size;
+	/** Timestamps and transaction id of the request block, echoed back
+	 * to the requester @{ */
+	struct timespec data;
+	struct timespec data2;
+	uint32_t transaction_id;				/** @} */
+	/** Monotonic point in time the request block was read */
+	struct timespec queued;
+};
+
+/** Response blocks of a flow not written yet, in order of their requests */
+struct _response_queue
+{
+	/** Index of the oldest response block */
+	unsigned int head;
+	/** Number of response blocks in the queue */
+	unsigned int count;
+	/** Bytes written of the oldest response block */
+	unsigned int bytes_written;
+	struct _response blocks[RESPONSE_QUEUE_SIZE];
+};
+
 struct _flow
 {
 	int id;
+	/** Id of the flow this flow was spawned from by the dynamic flow
+	 * arrival process, -1 for flows set up by the controller */
+	int template_id;
+	/** Number of active flows spawned from this flow */
+	unsigned int active_children;
+	/** Completion reports of flows spawned from this flow that were
+	 * dropped because too many reports were pending */
+	unsigned int dropped_completions;
+	/** Point in time the next flow is spawned from this flow */
+	struct timespec next_arrival_timestamp;
 
 	enum flow_state state;
 	enum flow_endpoint endpoint;
@@ -73,8 +188,16 @@ struct _flow
 
 	struct timespec start_timestamp[2];
 	struct timespec stop_timestamp[2];
+	/** Point in time the flow was scheduled to start writing at */
+	struct timespec scheduled_start;
+	/** Time between the scheduled start and the first write */
+	double start_skew;
+	/** Point in time the given amount of data was transferred */
+	struct timespec completion_timestamp;
 	struct timespec last_block_read;
 	struct timespec last_block_written;
+	/** Monotonic point in time the last block was read, for the IAT */
+	struct timespec last_block_read_monotonic;
 
 	struct timespec first_report_time;
 	struct timespec last_report_time;
@@ -82,14 +205,80 @@ struct _flow
 
 	struct timespec next_write_block_timestamp;
 
+	/** Tokens of the rate pacer, counted in blocks */
+	double pacing_tokens;
+	/** Capacity of the rate pacer, counted in blocks */
+	double pacing_burst;
+	/** Point in time the pacer was last refilled */
+	struct timespec pacing_timestamp;
+
+	/** Trace replayed by this flow, NULL if none (option --trace) */
+	struct _trace *trace;
+	/** Index of the trace record of the current block */
+	uint64_t trace_pos;
+	/** Number of trace records replayed so far */
+	uint64_t trace_replayed;
+
+	/** State of the random number generator of the flow */
+	uint64_t rng[4];
+	/** Request sizes, response sizes and interpacket gaps drawn in
+	 * advance @{ */
+	struct _trafgen_ring request_sizes;
+	struct _trafgen_ring response_sizes;
+	struct _trafgen_ring interpacket_gaps;			/** @} */
+
+	/** Size of the next request block, the size of the response it
+	 * requests is stored in @p response_size. Specialized for the traffic
+	 * generation of the flow by select_block_generator() */
+	int (*next_block)(struct _flow *flow, int *response_size);
+	/** Gap to the next request block, specialized like next_block */
+	double (*next_gap)(struct _flow *flow);
+	/** Request size, response size and gap of flows with constant
+	 * traffic generation @{ */
+	int constant_request_size;
+	int constant_response_size;
+	double constant_gap;					/** @} */
+
 	char *read_block;
 	char *write_block;
+	/** Payload of the current request block, indexed by the offset in the
+	 * block. Points to the write block if the flow has no payload pool */
+	char *payload;
+	/** Generated payload of the request blocks, NULL if none (option
+	 * --payload) */
+	struct _payload_pool *payload_pool;
+	/** Offset of the payload of the next request block in the pool */
+	unsigned int payload_offset;
+
+	/** Data received but not parsed yet is recv_buffer[recv_pos,
+	 * recv_len) */
+	char *recv_buffer;
+	unsigned int recv_pos;
+	unsigned int recv_len;
 
 	unsigned int current_write_block_size;
 	unsigned int current_read_block_size;
 
 	unsigned int current_block_bytes_read;
 	unsigned int current_block_bytes_written;
+	/** Response size requested by the block currently read, -1 for a
+	 * response block */
+	int requested_response_block_size;
+	/** Set if the payload of the block currently read is corrupted */
+	char block_corrupted;
+	/** Set if the block currently read spans several receive calls */
+	char block_split;
+
+	/** Request blocks written with a single call */
+	struct _write_batch batch;
+
+	/** Response blocks to be written once the socket becomes writable */
+	struct _response_queue responses;
+
+	/** Id of the next transaction started by a request block */
+	uint32_t next_transaction_id;
+	/** Id of the transaction whose response block is expected next */
+	uint32_t next_response_id;
 
 	unsigned short requested_server_test_port;
 
@@ -98,6 +287,8 @@ struct _flow
 
 	char connect_called;
 	char finished[2];
+	/** Set by prepare_wfds() if a request block may be written */
+	char write_scheduled;
 
 	int pmtu;
 
@@ -140,6 +331,25 @@ struct _flow
 		double rtt_max;
 		/** Accumulated round-trip time */
 		double rtt_sum;
+		/** Time spent in read_data() and write_data() */
+		double cpu_time;
+		/** Maximum number of queued response blocks */
+		unsigned int response_queue_max;
+		/** Maximum time a response block was queued */
+		double response_delay_max;
+		/** Accumulated time response blocks were queued */
+		double response_delay_sum;
+		/** Maximum number of transactions awaiting their response */
+		unsigned int outstanding_max;
+		/** Transactions whose response block never arrived */
+		unsigned int transactions_lost;
+		/** Number of calls writing request blocks */
+		unsigned int write_calls;
+		/** Number of blocks whose payload differs from the pattern of
+		 * byte counting (option -E) */
+		unsigned int corrupted_blocks;
+		/** Position of the first corrupted byte in the data read */
+		unsigned long long corruption_offset;
 
 #if (defined __LINUX__ || defined __FreeBSD__)
 		int has_tcp_info;
@@ -148,16 +358,22 @@ struct _flow
 
 	} statistics[2];
 
+	/** CPU time at the beginning of the interval and of the flow */
+	struct _cpu_sample cpu_sample[2];
+
+	/** TCP_INFO of the last interval report, the TCP chrono statistics of
+	 * the next interval are counted from it */
+	struct _fg_tcp_info tcp_info_sample;
+
+	/** Number of RTT samples per bucket of the metrics histogram */
+	unsigned long long rtt_buckets[METRICS_RTT_BUCKETS + 1];
+
 #ifdef HAVE_LIBPCAP
 	pthread_t pcap_thread;
 	struct pcap_t *pcap_handle;
 	struct pcap_dumper_t *pcap_dumper;
 #endif /* HAVE_LIBPCAP */
 
-#ifdef HAVE_LIBGSL
-	gsl_rng * r;
-#endif /* HAVE_LIBGSL */
-
 	char* error;
 };
 
@@ -166,6 +382,7 @@ struct _flow
 #define REQUEST_START_FLOWS 2
 #define REQUEST_STOP_FLOW 3
 #define REQUEST_GET_STATUS 4
+#define REQUEST_GET_DAEMON_STATS 5
 struct _request
 {
 	char type;
@@ -211,7 +428,8 @@ struct _request_start_flows
 {
 	struct _request r;
 
-	int start_timestamp;
+	/** Common start of all flows in our clock, zero to start at once */
+	struct timespec start_timestamp;
 };
 
 struct _request_stop_flow
@@ -229,6 +447,13 @@ struct _request_get_status
 	int num_flows;
 };
 
+struct _request_get_daemon_stats
+{
+	struct _request r;
+
+	struct _daemon_stats stats;
+};
+
 pthread_t daemon_thread;
 
 /* Through this pipe we wakeup the thread from select */
@@ -242,6 +467,7 @@ extern unsigned int num_flows;
 extern struct _report* reports;
 extern struct _report* reports_last;
 extern unsigned int pending_reports;
+extern unsigned long long dropped_reports;
 
 /* Gets 50 reports. There may be more pending but there's a limit on how
  * large a reply can get */
@@ -253,9 +479,19 @@ char *dump_dir;
 #endif /* HAVE_LIBPCAP */
 
 void *daemon_main(void* ptr);
-void add_report(struct _report* report);
+int add_report(struct _report* report);
 void flow_error(struct _flow *flow, const char *fmt, ...);
 void request_error(struct _request *request, const char *fmt, ...);
 int set_flow_tcp_options(struct _flow *flow);
+int alloc_flow_blocks(struct _flow *flow);
+int init_payload(struct _flow *flow);
+void init_pacer(struct _flow *flow);
+
+/** Returns true if new flows are spawned from this flow during the test
+ * (dynamic flow arrival) */
+static inline int flow_is_template(const struct _flow *flow)
+{
+	return flow->settings.flow_arrival_trafgen_options.param_one != 0;
+}
 
 #endif /* _DAEMON_H_ */
@@ -0,0 +1,50 @@
+/**
+ * @file daemon_internal.h
+ * @brief Functions of the daemon thread that are private to the daemon,
+ * exported for its microbenchmark
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _DAEMON_INTERNAL_H_
+#define _DAEMON_INTERNAL_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+#include "daemon.h"
+
+/** Id of the next flow set up by the daemon */
+extern int next_flow_id;
+/** Counters of the event loop. Only accessed from the daemon thread */
+extern struct _daemon_stats daemon_stats;
+
+/* Stages of the event loop */
+int prepare_fds(double *wait);
+void timer_check(void);
+
+void init_flow(struct _flow* flow, int is_source);
+void start_flows(struct _request_start_flows *request);
+void report_flow(struct _flow* flow, int type);
+
+/* Request blocks of the source */
+int start_block(struct _flow *flow, struct _block *header,
+		unsigned int *size, unsigned long long queued);
+int schedule_next_block(struct _flow *flow);
+
+#endif /* _DAEMON_INTERNAL_H_ */
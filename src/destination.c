@@ -58,6 +58,7 @@
 #include "fg_math.h"
 #include "log.h"
 #include "daemon.h"
+#include "trafgen.h"
 
 void remove_flow(unsigned int i);
 
@@ -120,7 +121,9 @@ static int create_listen_socket(struct _flow *flow, char *bind_addr,
 	if (flow->settings.cc_alg)
 		set_congestion_control(fd, flow->settings.cc_alg);
 
-	if (listen(fd, 0) < 0) {
+	/* a template for spawned flows needs a backlog for simultaneous
+	 * arrivals */
+	if (listen(fd, flow_is_template(flow) ? SOMAXCONN : 0) < 0) {
 		logging_log(LOG_ALERT, "listen failed: %s",
 			    strerror(errno));
 		flow_error(flow, "Listen failed: %s", strerror(errno));
@@ -158,9 +161,7 @@ void add_flow_destination(struct _request_add_flow_destination *request)
 	init_flow(flow, 0);
 
 	flow->settings = request->settings;
-	flow->write_block = calloc(1, flow->settings.maximum_block_size );
-	flow->read_block = calloc(1, flow->settings.maximum_block_size );
-	if (flow->write_block == NULL || flow->read_block == NULL) {
+	if (alloc_flow_blocks(flow) == -1) {
 		logging_log(LOG_ALERT, "could not allocate memory for "
 			    "read/write blocks");
 		request_error(&request->r, "could not allocate memory "
@@ -170,12 +171,12 @@ void add_flow_destination(struct _request_add_flow_destination *request)
 		return;
 	}
 
-	if (flow->settings.byte_counting) {
-		int byte_idx;
-		for (byte_idx = 0; byte_idx < flow->settings.maximum_block_size;
-		     byte_idx++)
-			*(flow->write_block + byte_idx) =
-				(unsigned char)(byte_idx & 0xff);
+	if (init_trace_replay(flow) == -1 || init_payload(flow) == -1) {
+		request->r.error = flow->error;
+		flow->error = NULL;
+		uninit_flow(flow);
+		num_flows--;
+		return;
 	}
 
 	/* Create listen socket for data connection */
@@ -278,3 +279,90 @@ int accept_data(struct _flow *flow)
 
 	return 0;
 }
+
+int accept_flow_destination(struct _flow *template)
+{
+	struct _flow *flow;
+	struct timespec now;
+	int fd;
+
+	fd = accept(template->listenfd_data, NULL, NULL);
+	if (fd == -1) {
+		/* try again later .... */
+		if (errno == EINTR || errno == EAGAIN)
+			return 0;
+		logging_log(LOG_ALERT, "accept() failed: %s", strerror(errno));
+		return -1;
+	}
+
+	if (num_flows >= MAX_FLOWS) {
+		logging_log(LOG_WARNING, "Can not accept spawned flow, already "
+			    "handling MAX_FLOW flows.");
+		close(fd);
+		return 0;
+	}
+
+	flow = &flows[num_flows++];
+	init_flow(flow, 0);
+
+	/* A spawned flow reads until the source closes the connection */
+	flow->settings = template->settings;
+	flow->settings.delay[WRITE] = flow->settings.delay[READ] = 0;
+	flow->settings.duration[WRITE] = 0;
+	flow->settings.duration[READ] = -1;
+	flow->settings.reporting_interval = 0;
+	flow->settings.traffic_dump = 0;
+	memset(&flow->settings.flow_arrival_trafgen_options, 0,
+	       sizeof(flow->settings.flow_arrival_trafgen_options));
+	flow->fd = fd;
+
+	if (alloc_flow_blocks(flow) == -1) {
+		logging_log(LOG_ALERT, "could not allocate memory for "
+			    "read/write blocks");
+		goto error;
+	}
+
+	if (init_payload(flow) == -1) {
+		logging_log(LOG_WARNING, "could not generate payload of spawned "
+			    "flow: %s", flow->error);
+		goto error;
+	}
+
+	set_window_size_directed(flow->fd,
+				 flow->settings.requested_send_buffer_size,
+				 SO_SNDBUF);
+	set_window_size_directed(flow->fd,
+				 flow->settings.requested_read_buffer_size,
+				 SO_RCVBUF);
+	if (set_flow_tcp_options(flow) == -1) {
+		logging_log(LOG_WARNING, "could not set options of spawned "
+			    "flow: %s", flow->error);
+		goto error;
+	}
+	flow->state = GRIND;
+	flow->connect_called = 1;
+
+	init_math_functions(flow, flow->settings.random_seed ?
+			    flow->settings.random_seed + flow->id : 0);
+	select_block_generator(flow);
+
+	gettime(&now);
+	for (int i = 0; i < 2; i++)
+		flow->start_timestamp[i] = now;
+	flow->next_write_block_timestamp = now;
+	flow->first_report_time = flow->last_report_time = now;
+	flow->next_report_time = now;
+
+	flow->template_id = template->id;
+	template->active_children++;
+
+	DEBUG_MSG(LOG_NOTICE, "accepted flow %d spawned from flow %d",
+		  flow->id, template->id);
+
+	return 0;
+
+error:
+	uninit_flow(flow);
+	num_flows--;
+	return -1;
+}
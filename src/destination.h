@@ -31,5 +31,6 @@
 
 void add_flow_destination(struct _request_add_flow_destination *request);
 int accept_data(struct _flow *flow);
+int accept_flow_destination(struct _flow *template);
 
 #endif /* _DESTINATION_H_ */
@@ -0,0 +1,459 @@
+/**
+ * @file fg_daemon_bench.c
+ * @brief Microbenchmark of the hot functions of the Flowgrind daemon
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <xmlrpc-c/base.h>
+
+#include "common.h"
+#include "daemon.h"
+#include "daemon_internal.h"
+#include "fg_error.h"
+#include "fg_math.h"
+#include "fg_progname.h"
+#include "fg_reports.h"
+#include "fg_socket.h"
+#include "fg_stdlib.h"
+#include "fg_time.h"
+#include "trafgen.h"
+
+/** Number of operations per benchmark */
+#define OPERATIONS 1000000
+
+/** Number of operations of the benchmarks that scan all flows */
+#define SCANS 10000
+
+/** Reports handed out by a single get_reports call */
+#define REPORT_BATCH 50
+
+/** Numbers of flows the scans over all flows are run with */
+static const unsigned int scan_flows[] = {1, 16, 256, MAX_FLOWS};
+static const unsigned int num_scan_flows =
+	sizeof(scan_flows) / sizeof(scan_flows[0]);
+
+/* Counts the allocations of the daemon. The benchmark is linked with
+ * --wrap for malloc, calloc and realloc, hence allocations within shared
+ * libraries like XML-RPC are not counted */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static unsigned long long allocations = 0;
+
+void *__wrap_malloc(size_t size)
+{
+	allocations++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	allocations++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	allocations++;
+	return __real_realloc(ptr, size);
+}
+
+/* Keeps the compiler from optimizing the operations away */
+static volatile double sink;
+
+/* Both ends of the loopback connection all flows share */
+static int sockets[2];
+
+static const struct {
+	const char *name;
+	enum distributions type;
+	double param_one;
+	double param_two;
+} dists[] = {
+	{"constant", CONSTANT, 8192, 0},
+	{"uniform", UNIFORM, 100, 1000},
+	{"exponential", EXPONENTIAL, 1000, 0},
+	{"normal", NORMAL, 1000, 100},
+	{"lognormal", LOGNORMAL, 7, 1},
+	{"pareto", PARETO, 1.5, 100},
+	{"weibull", WEIBULL, 1000, 1.5},
+};
+
+static struct timespec bench_start;
+static double bench_time;
+static unsigned long long bench_allocations;
+
+/* Time is accumulated between resume and pause, so that the setup of an
+ * operation is not accounted to it */
+static void bench_resume(void)
+{
+	bench_allocations -= allocations;
+	gettime_monotonic(&bench_start);
+}
+
+static void bench_pause(void)
+{
+	struct timespec now;
+
+	gettime_monotonic(&now);
+	bench_time += time_diff(&bench_start, &now);
+	bench_allocations += allocations;
+}
+
+static void bench_begin(void)
+{
+	bench_time = 0;
+	bench_allocations = 0;
+	bench_resume();
+}
+
+static void bench_end(const char *name, unsigned int ops)
+{
+	bench_pause();
+	printf("%-32s %10.2f ns/op %8.2f allocs/op\n", name,
+	       bench_time * 1e9 / ops, (double)bench_allocations / ops);
+}
+
+static void connect_sockets(void)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int listenfd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listenfd == -1 ||
+	    bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    listen(listenfd, 1) == -1 ||
+	    getsockname(listenfd, (struct sockaddr *)&addr, &addr_len) == -1)
+		crit("unable to listen on loopback");
+
+	sockets[SOURCE] = socket(AF_INET, SOCK_STREAM, 0);
+	if (sockets[SOURCE] == -1 ||
+	    connect(sockets[SOURCE], (struct sockaddr *)&addr,
+		    addr_len) == -1)
+		crit("unable to connect on loopback");
+
+	sockets[DESTINATION] = accept(listenfd, NULL, NULL);
+	if (sockets[DESTINATION] == -1)
+		crit("unable to accept on loopback");
+
+	close(listenfd);
+	set_non_blocking(sockets[SOURCE]);
+	set_non_blocking(sockets[DESTINATION]);
+}
+
+/* Free all pending reports, like the get_reports RPC method */
+static void drain_reports(void)
+{
+	struct _report *report;
+	int has_more;
+
+	do {
+		report = get_reports(&has_more);
+		while (report) {
+			struct _report *next = report->next;
+			free(report);
+			report = next;
+		}
+	} while (has_more);
+}
+
+/* Replace the flows of the daemon by n started bulk flows, alternating
+ * between source and destination, with a report interval of one second */
+static void setup_flows(unsigned int n)
+{
+	struct _request_start_flows request;
+
+	for (unsigned int i = 0; i < num_flows; i++)
+		free_math_functions(&flows[i]);
+	num_flows = 0;
+	next_flow_id = 0;
+
+	for (unsigned int i = 0; i < n; i++) {
+		struct _flow *flow = &flows[i];
+
+		init_flow(flow, !(i % 2));
+		flow->fd = sockets[flow->endpoint];
+		flow->state = GRIND;
+		flow->connect_called = 1;
+		flow->settings.duration[READ] = 3600;
+		flow->settings.duration[WRITE] = 3600;
+		flow->settings.reporting_interval = 1;
+		flow->settings.maximum_block_size = 8192;
+		flow->settings.request_trafgen_options.param_one = 8192;
+	}
+	num_flows = n;
+
+	memset(&request, 0, sizeof(request));
+	start_flows(&request);
+}
+
+static void bench_time_functions(void)
+{
+	struct timespec tp1, tp2;
+
+	gettime(&tp1);
+	tp2 = tp1;
+
+	bench_begin();
+	for (unsigned int i = 0; i < OPERATIONS; i++)
+		time_add(&tp2, 0.001);
+	sink = tp2.tv_nsec;
+	bench_end("time_add", OPERATIONS);
+
+	bench_begin();
+	for (unsigned int i = 0; i < OPERATIONS; i++) {
+		tp2.tv_nsec = i % NSEC_PER_SEC;
+		sink = time_diff(&tp1, &tp2);
+	}
+	bench_end("time_diff", OPERATIONS);
+}
+
+static void bench_prepare_fds(void)
+{
+	char name[64];
+	double wait;
+
+	for (unsigned int k = 0; k < num_scan_flows; k++) {
+		unsigned int n = scan_flows[k];
+
+		setup_flows(n);
+
+		bench_begin();
+		for (unsigned int i = 0; i < SCANS; i++) {
+			wait = 1;
+			prepare_fds(&wait);
+		}
+		snprintf(name, sizeof(name), "prepare_fds (%u flows)", n);
+		bench_end(name, SCANS);
+	}
+}
+
+static void bench_timer_check(void)
+{
+	struct timespec due;
+	char name[64];
+
+	for (unsigned int k = 0; k < num_scan_flows; k++) {
+		unsigned int n = scan_flows[k];
+
+		setup_flows(n);
+
+		/* no report due */
+		bench_begin();
+		for (unsigned int i = 0; i < SCANS; i++) {
+			update_clock();
+			timer_check();
+		}
+		snprintf(name, sizeof(name), "timer_check (%u flows)", n);
+		bench_end(name, SCANS);
+	}
+
+	/* a report of every flow due at every call. Reports beyond the limit
+	 * of pending reports are dropped, as in the daemon */
+	bench_begin();
+	for (unsigned int i = 0; i < SCANS / 100; i++) {
+		bench_pause();
+		drain_reports();
+		update_clock();
+		gettime_cached(&due);
+		time_add(&due, -1.0);
+		for (unsigned int j = 0; j < num_flows; j++) {
+			flows[j].last_report_time = due;
+			flows[j].next_report_time = due;
+		}
+		daemon_stats.loop_iterations++;
+		bench_resume();
+
+		timer_check();
+	}
+	drain_reports();
+	snprintf(name, sizeof(name), "timer_check (%u reports)", num_flows);
+	bench_end(name, SCANS / 100);
+}
+
+static void bench_reports(void)
+{
+	xmlrpc_env env;
+	xmlrpc_value *result;
+
+	/* without a report interval no report is discarded as too early */
+	setup_flows(1);
+	flows[0].settings.reporting_interval = 0;
+
+	/* every report samples the CPU time anew, like the first report of
+	 * a loop iteration */
+	bench_begin();
+	for (unsigned int i = 0; i < OPERATIONS / 10; i++) {
+		daemon_stats.loop_iterations++;
+		report_flow(&flows[0], INTERVAL);
+
+		if (pending_reports >= REPORT_BATCH)
+			drain_reports();
+	}
+	drain_reports();
+	bench_end("report_flow + get_reports", OPERATIONS / 10);
+
+	xmlrpc_env_init(&env);
+	bench_begin();
+	for (unsigned int i = 0; i < OPERATIONS / 10; i += REPORT_BATCH) {
+		bench_pause();
+		for (unsigned int j = 0; j < REPORT_BATCH; j++)
+			report_flow(&flows[0], INTERVAL);
+		bench_resume();
+
+		result = method_get_reports(&env, NULL, NULL);
+		if (env.fault_occurred)
+			critx("get_reports failed: %s", env.fault_string);
+		xmlrpc_DECREF(result);
+	}
+	bench_end("method_get_reports (per report)", OPERATIONS / 10);
+	xmlrpc_env_clean(&env);
+}
+
+static void bench_trafgen(void)
+{
+	struct _flow *flow;
+	char name[64];
+
+	setup_flows(1);
+	flow = &flows[0];
+
+	for (unsigned int d = 0; d < sizeof(dists) / sizeof(dists[0]); d++) {
+		flow->settings.request_trafgen_options.distribution =
+			dists[d].type;
+		flow->settings.request_trafgen_options.param_one =
+			dists[d].param_one;
+		flow->settings.request_trafgen_options.param_two =
+			dists[d].param_two;
+		flow->request_sizes.count = 0;
+
+		bench_begin();
+		for (unsigned int i = 0; i < OPERATIONS; i++)
+			sink = next_request_block_size(flow);
+		snprintf(name, sizeof(name), "next_request_block_size (%s)",
+			 dists[d].name);
+		bench_end(name, OPERATIONS);
+	}
+}
+
+/* Traffic generation of the block generator variants */
+static const struct {
+	const char *name;
+	struct _trafgen_options request;
+	struct _trafgen_options response;
+	struct _trafgen_options gap;
+} generators[] = {
+	{"bulk", {CONSTANT, 8192, 0}, {CONSTANT, 0, 0}, {CONSTANT, 0, 0}},
+	{"constant", {CONSTANT, 64, 0}, {CONSTANT, 64, 0},
+	 {CONSTANT, 0.001, 0}},
+	{"stochastic", {NORMAL, 2000, 50}, {NORMAL, 2000, 50},
+	 {UNIFORM, 0.0005, 0.001}},
+};
+
+/* Per block cost of drawing the sizes and the gap of a request block,
+ * specialized per flow and through the distributions as before */
+static void bench_block_generators(void)
+{
+	struct _flow *flow;
+	struct _block header;
+	unsigned int size;
+	int response_size;
+	char name[64];
+
+	setup_flows(1);
+	flow = &flows[0];
+
+	for (unsigned int g = 0; g < sizeof(generators) / sizeof(generators[0]);
+	     g++) {
+		flow->settings.request_trafgen_options = generators[g].request;
+		flow->settings.response_trafgen_options =
+			generators[g].response;
+		flow->settings.interpacket_gap_trafgen_options =
+			generators[g].gap;
+		flow->request_sizes.count = 0;
+		flow->response_sizes.count = 0;
+		flow->interpacket_gaps.count = 0;
+		select_block_generator(flow);
+
+		bench_begin();
+		for (unsigned int i = 0; i < OPERATIONS; i++) {
+			start_block(flow, &header, &size, 0);
+			schedule_next_block(flow);
+		}
+		snprintf(name, sizeof(name), "start_block (%s)",
+			 generators[g].name);
+		bench_end(name, OPERATIONS);
+
+		bench_begin();
+		for (unsigned int i = 0; i < OPERATIONS; i++) {
+			size = next_request_block_size(flow);
+			response_size = next_response_block_size(flow);
+			sink = next_interpacket_gap(flow) + size +
+			       response_size;
+		}
+		snprintf(name, sizeof(name), "unspecialized sizes (%s)",
+			 generators[g].name);
+		bench_end(name, OPERATIONS);
+
+		bench_begin();
+		for (unsigned int i = 0; i < OPERATIONS; i++) {
+			size = flow->next_block(flow, &response_size);
+			sink = flow->next_gap(flow) + size + response_size;
+		}
+		snprintf(name, sizeof(name), "specialized sizes (%s)",
+			 generators[g].name);
+		bench_end(name, OPERATIONS);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	UNUSED_ARGUMENT(argc);
+	set_progname(argv[0]);
+
+	if (pipe(daemon_pipe) == -1)
+		crit("unable to create pipe");
+	pthread_mutex_init(&mutex, NULL);
+	connect_sockets();
+
+	bench_time_functions();
+	bench_prepare_fds();
+	bench_timer_check();
+	bench_reports();
+	bench_trafgen();
+	bench_block_generators();
+
+	exit(EXIT_SUCCESS);
+}
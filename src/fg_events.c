@@ -0,0 +1,219 @@
+/**
+ * @file fg_events.c
+ * @brief Log of every block event of the daemon to a binary file
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/param.h>
+#include <arpa/inet.h>
+
+#include "fg_events.h"
+#include "fg_stdlib.h"
+#include "log.h"
+
+/** Maximum number of records written with a single call */
+#define EVENT_WRITE_BATCH 4096
+
+struct _event_ring *event_ring = NULL;
+
+/** File descriptor of the event log, -1 after a write error */
+static int event_fd = -1;
+
+static pthread_t event_thread;
+
+/** Protects the wait of the writer thread for events and stopping @{ */
+static pthread_mutex_t event_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t event_cond = PTHREAD_COND_INITIALIZER;		/** @} */
+
+/** Set by events_stop() once the ring is to be drained a last time */
+static int stopping = 0;
+
+static inline void split_u64(uint64_t value, uint32_t *high, uint32_t *low)
+{
+	*high = htonl(value >> 32);
+	*low = htonl((uint32_t)value);
+}
+
+static void encode(struct _event_record *record, uint32_t flow_id,
+		   uint32_t type, uint32_t size, uint64_t sent,
+		   uint64_t received, uint64_t rtt)
+{
+	record->flow_id = htonl(flow_id);
+	record->type = htonl(type);
+	record->size = htonl(size);
+	split_u64(sent, &record->sent_high, &record->sent_low);
+	split_u64(received, &record->received_high, &record->received_low);
+	split_u64(rtt, &record->rtt_high, &record->rtt_low);
+}
+
+/* Write all records, on error the log is closed and the ring is only
+ * drained from then on */
+static void write_records(const struct _event_record *records,
+			  unsigned int n)
+{
+	const char *buf = (const char *)records;
+	size_t len = n * sizeof(struct _event_record);
+	ssize_t rc;
+
+	while (len && event_fd != -1) {
+		rc = write(event_fd, buf, len);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc == -1) {
+			logging_log(LOG_WARNING, "could not write event log: "
+				    "%s, further events are discarded",
+				    strerror(errno));
+			close(event_fd);
+			event_fd = -1;
+			return;
+		}
+		buf += rc;
+		len -= rc;
+	}
+}
+
+static void *events_main(void *arg)
+{
+	static struct _event_record records[EVENT_WRITE_BATCH];
+	struct _event_ring *ring = event_ring;
+	uint64_t lost_logged = 0;
+
+	UNUSED_ARGUMENT(arg);
+
+	for (;;) {
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint64_t lost = __atomic_load_n(&ring->lost, __ATOMIC_RELAXED);
+		uint64_t tail = ring->tail;
+		unsigned int n = 0;
+
+		/* losses are recorded where they were noticed */
+		if (lost != lost_logged) {
+			if (!lost_logged)
+				logging_log(LOG_WARNING, "event log can not "
+					    "keep up, events are lost");
+			encode(&records[n++], 0, EVENT_LOST,
+			       MIN(lost - lost_logged, UINT32_MAX), 0, 0, 0);
+			lost_logged += MIN(lost - lost_logged, UINT32_MAX);
+		}
+
+		for (; tail != head && n < EVENT_WRITE_BATCH; tail++, n++) {
+			const struct _event *event =
+				&ring->events[tail & (EVENT_RING_SIZE - 1)];
+
+			encode(&records[n], event->flow_id, event->type,
+			       event->size, event->sent, event->received,
+			       event->rtt);
+		}
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+		if (n) {
+			write_records(records, n);
+			continue;
+		}
+
+		/* the ring is empty, wait until the daemon thread appends an
+		 * event or the log is stopped */
+		pthread_mutex_lock(&event_mutex);
+		if (stopping) {
+			pthread_mutex_unlock(&event_mutex);
+			break;
+		}
+		__atomic_store_n(&ring->sleeping, 1, __ATOMIC_RELAXED);
+		/* pairs with the fence in events_record() */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) == tail)
+			pthread_cond_wait(&event_cond, &event_mutex);
+		__atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&event_mutex);
+	}
+
+	return NULL;
+}
+
+void events_wake(void)
+{
+	pthread_mutex_lock(&event_mutex);
+	pthread_cond_signal(&event_cond);
+	pthread_mutex_unlock(&event_mutex);
+}
+
+int events_open(const char *path)
+{
+	event_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (event_fd == -1) {
+		logging_log(LOG_ALERT, "could not create event log %s: %s",
+			    path, strerror(errno));
+		return -1;
+	}
+
+	event_ring = calloc(1, sizeof(struct _event_ring));
+	if (!event_ring) {
+		logging_log(LOG_ALERT, "could not allocate event ring");
+		close(event_fd);
+		event_fd = -1;
+		return -1;
+	}
+
+	if (write(event_fd, EVENT_MAGIC, strlen(EVENT_MAGIC)) !=
+	    (ssize_t)strlen(EVENT_MAGIC)) {
+		logging_log(LOG_ALERT, "could not write event log %s: %s",
+			    path, strerror(errno));
+		close(event_fd);
+		event_fd = -1;
+		free(event_ring);
+		event_ring = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+int events_start(void)
+{
+	if (pthread_create(&event_thread, NULL, events_main, NULL)) {
+		logging_log(LOG_ALERT, "could not start event log thread");
+		return -1;
+	}
+
+	return 0;
+}
+
+void events_stop(void)
+{
+	pthread_mutex_lock(&event_mutex);
+	stopping = 1;
+	pthread_cond_signal(&event_cond);
+	pthread_mutex_unlock(&event_mutex);
+
+	pthread_join(event_thread, NULL);
+	if (event_fd != -1) {
+		close(event_fd);
+		event_fd = -1;
+	}
+}
@@ -0,0 +1,175 @@
+/**
+ * @file fg_events.h
+ * @brief Log of every block event of the daemon to a binary file
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_EVENTS_H_
+#define _FG_EVENTS_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+
+/** Magic number at the beginning of each event log */
+#define EVENT_MAGIC "FGEVENT1"
+
+/** Number of events the ring between the daemon thread and the writer
+ * thread holds, a power of two */
+#define EVENT_RING_SIZE 65536
+
+/** Kind of a block event */
+enum event_type {
+	/** A request block was completely written */
+	EVENT_REQUEST_WRITTEN = 0,
+	/** A response block was completely written */
+	EVENT_RESPONSE_WRITTEN,
+	/** A request block was completely read */
+	EVENT_REQUEST_READ,
+	/** A response block was completely read */
+	EVENT_RESPONSE_READ,
+	/** Events were lost since the ring was full, the size of the record
+	 * holds their number */
+	EVENT_LOST,
+};
+
+/** A single event of an event log, in network byte order. The header of
+ * a log is EVENT_MAGIC, not null-terminated, followed by the records */
+struct _event_record {
+	/** Id of the flow */
+	uint32_t flow_id;
+	/** Kind of the event, see enum event_type */
+	uint32_t type;
+	/** Size of the block */
+	uint32_t size;
+	/** Point in time the block was sent (wall-clock), in nanoseconds.
+	 * For read blocks taken from the header of the block @{ */
+	uint32_t sent_high;
+	uint32_t sent_low;					/** @} */
+	/** Point in time the block was read (wall-clock), in nanoseconds. 0
+	 * for written blocks @{ */
+	uint32_t received_high;
+	uint32_t received_low;					/** @} */
+	/** Round-trip time of a response block, in nanoseconds. 0 for all
+	 * other blocks @{ */
+	uint32_t rtt_high;
+	uint32_t rtt_low;					/** @} */
+};
+
+/** An event in the ring, in host byte order */
+struct _event {
+	uint32_t flow_id;
+	uint32_t type;
+	uint32_t size;
+	uint64_t sent;
+	uint64_t received;
+	uint64_t rtt;
+};
+
+/** Single producer, single consumer ring of events. The daemon thread
+ * appends events at the head, the writer thread takes them from the tail.
+ * Both indices only grow, the position in the ring is the index modulo
+ * EVENT_RING_SIZE */
+struct _event_ring {
+	/** Index of the next event appended, only written by the daemon
+	 * thread */
+	uint64_t head;
+	/** Last tail seen by the daemon thread, saves reading the cache line
+	 * of the writer thread for every event */
+	uint64_t tail_cache;
+	/** Number of events dropped since the ring was full */
+	uint64_t lost;
+	/** Set while the writer thread waits for events */
+	int sleeping;
+	/** Index of the next event taken, only written by the writer thread.
+	 * On a cache line of its own @{ */
+	char pad[64];
+	uint64_t tail;
+	char pad2[64];						/** @} */
+	struct _event events[EVENT_RING_SIZE];
+};
+
+/** Ring of the event log, NULL if the log is disabled */
+extern struct _event_ring *event_ring;
+
+/**
+ * Create the event log @p path and its ring. Must be called before the
+ * daemon thread is started
+ *
+ * @return zero on success, -1 otherwise
+ */
+int events_open(const char *path);
+
+/**
+ * Start the thread draining the ring into the event log
+ *
+ * @return zero on success, -1 otherwise
+ */
+int events_start(void);
+
+/**
+ * Write the events left in the ring, stop the writer thread and close the
+ * event log
+ */
+void events_stop(void);
+
+/**
+ * Wake the writer thread waiting for events
+ */
+void events_wake(void);
+
+/**
+ * Append an event to the ring. Never waits for the writer thread, an event
+ * that does not fit into the ring is counted as lost. Must only be called
+ * by the daemon thread
+ */
+static inline void events_record(uint32_t flow_id, enum event_type type,
+				 uint32_t size, uint64_t sent,
+				 uint64_t received, uint64_t rtt)
+{
+	struct _event_ring *ring = event_ring;
+	struct _event *event;
+	uint64_t head = ring->head;
+
+	if (head - ring->tail_cache == EVENT_RING_SIZE) {
+		ring->tail_cache = __atomic_load_n(&ring->tail,
+						   __ATOMIC_ACQUIRE);
+		if (head - ring->tail_cache == EVENT_RING_SIZE) {
+			__atomic_store_n(&ring->lost, ring->lost + 1,
+					 __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	event = &ring->events[head & (EVENT_RING_SIZE - 1)];
+	event->flow_id = flow_id;
+	event->type = type;
+	event->size = size;
+	event->sent = sent;
+	event->received = received;
+	event->rtt = rtt;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	/* pairs with the fence of the writer thread before it waits */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->sleeping, __ATOMIC_RELAXED))
+		events_wake();
+}
+
+#endif /* _FG_EVENTS_H_ */
@@ -31,6 +31,7 @@
 #include <string.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/param.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -43,42 +44,24 @@
 #include "fg_error.h"
 #include "fg_stdlib.h"
 
-#ifdef HAVE_LIBGSL
-#include <gsl/gsl_rng.h>
-#include <gsl/gsl_randist.h>
-#include <gsl/gsl_cdf.h>
-#include <gsl/gsl_sf_gamma.h>
-#include <gsl/gsl_math.h>
-#include <gsl/gsl_errno.h>
-#endif /* HAVE_LIBGSL */
-
-#ifndef HAVE_LIBGSL
-/* RANDOM_MAX only needed for POSIX math functions */
-#ifdef __DARWIN__
-#define RANDOM_MAX LONG_MAX        /* Darwin */
-#else
-#define RANDOM_MAX RAND_MAX        /* Linux, FreeBSD */
-#endif /* __SOLARIS__ */
-
-#endif /* HAVE_LIBGSL */
+/** Next value of the generator used to seed the flow generators (splitmix64) */
+static uint64_t splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
 
 extern void init_math_functions (struct _flow *flow, unsigned long seed)
 {
 	int rc;
-#ifndef HAVE_LIBGSL
-	UNUSED_ARGUMENT(flow);
-#endif /* HAVE_LIBGSL */
+	uint64_t x;
+
 	/* set rounding */
 	fesetround(FE_TONEAREST);
 
-	/* initalize rng */
-#ifdef HAVE_LIBGSL
-	const gsl_rng_type * T;
-	gsl_rng_env_setup();
-	T = gsl_rng_default;
-	flow->r = gsl_rng_alloc (T);
-#endif /* HAVE_LIBGSL */
-
 	if (!seed) {
 	/* if no seed supplied use urandom */
 		DEBUG_MSG(LOG_WARNING, "client did not supply random seed "
@@ -90,158 +73,260 @@ extern void init_math_functions (struct _flow *flow, unsigned long seed)
 			crit("read /dev/urandom failed");
 	}
 
-#ifdef HAVE_LIBGSL
-	gsl_rng_set (flow->r, seed);
-	DEBUG_MSG(LOG_WARNING, "initalized local libgsl random functions for "
-		  "flow %d with seed %lu, gsl generator is: %s",
-		  flow->id,seed,gsl_rng_name (flow->r));
-#else
-	srand((unsigned int)seed);
-	DEBUG_MSG(LOG_WARNING, "initalized posix random functions with seed "
-		  "%u", (unsigned int)seed);
-#endif /* HAVE_LIBGSL */
+	/* initalize rng, the state must not be all zero */
+	x = seed;
+	for (int i = 0; i < 4; i++)
+		flow->rng[i] = splitmix64(&x);
+
+	/* discard values drawn with a previous seed */
+	flow->request_sizes.count = 0;
+	flow->response_sizes.count = 0;
+	flow->interpacket_gaps.count = 0;
+
+	DEBUG_MSG(LOG_WARNING, "initalized random functions for flow %d with "
+		  "seed %lu", flow->id, seed);
 }
 
 extern void free_math_functions (struct _flow *flow)
 {
-#ifdef HAVE_LIBGSL
-	gsl_rng_free(flow->r);
-#else
 	UNUSED_ARGUMENT(flow);
-#endif /* HAVE_LIBGSL */
 }
 
-static inline double rn_uniform(struct _flow *flow)
+/* Quantile function of the standard normal distribution. Rational
+ * approximation by P. J. Acklam, relative error below 1.15e-9 */
+static double normal_quantile(const double p)
 {
-#ifndef HAVE_LIBGSL
-	UNUSED_ARGUMENT(flow);
-#endif  /* HAVE_LIBGSL */
+	static const double a[] = { -3.969683028665376e+01,
+		2.209460984245205e+02, -2.759285104469687e+02,
+		1.383577518672690e+02, -3.066479806614716e+01,
+		2.506628277459239e+00 };
+	static const double b[] = { -5.447609879822406e+01,
+		1.615858368580409e+02, -1.556989798598866e+02,
+		6.680131188771972e+01, -1.328068155288572e+01 };
+	static const double c[] = { -7.784894002430293e-03,
+		-3.223964580411365e-01, -2.400758277161838e+00,
+		-2.549732539343734e+00, 4.374664141464968e+00,
+		2.938163982698783e+00 };
+	static const double d[] = { 7.784695709041462e-03,
+		3.224671290700398e-01, 2.445134137142996e+00,
+		3.754408661907416e+00 };
+	const double p_low = 0.02425;
+	double q, r;
+
+	if (p < p_low) {
+		q = sqrt(-2 * log(p));
+		return (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q +
+			c[5]) / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+	}
+	if (p > 1 - p_low) {
+		q = sqrt(-2 * log1p(-p));
+		return -(((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q +
+			 c[5]) / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+	}
 
-#ifdef HAVE_LIBGSL
-	gsl_rng * r = flow->r;
-	return gsl_rng_get(r);
-#else
-	return rand();
-#endif /* HAVE_LIBGSL */
+	q = p - 0.5;
+	r = q * q;
+	return (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q /
+	       (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1);
 }
 
-static inline double rn_uniform_zero_to_one(struct _flow *flow)
+static inline double normal_cdf(const double x)
 {
-#ifdef HAVE_LIBGSL
-	gsl_rng * r = flow->r;
-	return gsl_rng_uniform_pos(r);
-#else
-	return rn_uniform(flow)/(RANDOM_MAX+1.0);
-#endif /* HAVE_LIBGSL */
+	return 0.5 * erfc(-x / M_SQRT2);
 }
 
-#ifndef HAVE_LIBGSL
-static inline double rn_uniform_minusone_to_one(struct _flow *flow)
+/* Cumulative distribution function of a traffic generation distribution,
+ * parameterized like its random numbers. Not defined for CONSTANT */
+static double dist_cdf(enum distributions type, const double param_one,
+		       const double param_two, const double x)
 {
-	return (rn_uniform(flow)/(RANDOM_MAX/2.0) - 1.0);
+	switch (type) {
+	case UNIFORM:
+		if (x <= param_one)
+			return 0;
+		if (x >= param_two)
+			return 1;
+		return (x - param_one) / (param_two - param_one);
+	case EXPONENTIAL:
+		return x <= 0 ? 0 : -expm1(-x / param_one);
+	case NORMAL:
+		return normal_cdf((x - param_one) / param_two);
+	case LOGNORMAL:
+		return x <= 0 ? 0 : normal_cdf((log(x) - param_one) / param_two);
+	case PARETO:
+		return x <= param_two ? 0 : 1 - pow(param_two / x, param_one);
+	case WEIBULL:
+		return x <= 0 ? 0 : -expm1(-pow(x / param_one, param_two));
+	case CONSTANT:
+	default:
+		return 0;
+	}
 }
-#endif /* HAVE_LIBGSL */
 
-extern double dist_exponential(struct _flow *flow, const double mu)
+/* Quantile function of a traffic generation distribution, the inverse of
+ * dist_cdf() for @p p within (0,1) */
+static double dist_quantile(enum distributions type, const double param_one,
+			    const double param_two, const double p)
 {
-#ifdef HAVE_LIBGSL
-	gsl_rng * r = flow->r;
-	return gsl_ran_exponential(r, mu);
-#else
-	return -log(rn_uniform(flow))+mu;
-#endif /* HAVE_LIBGSL */
+	switch (type) {
+	case UNIFORM:
+		return param_one + p * (param_two - param_one);
+	case EXPONENTIAL:
+		return -param_one * log1p(-p);
+	case NORMAL:
+		return param_one + param_two * normal_quantile(p);
+	case LOGNORMAL:
+		return exp(param_one + param_two * normal_quantile(p));
+	case PARETO:
+		return param_two * pow(1 - p, -1 / param_one);
+	case WEIBULL:
+		return param_one * pow(-log1p(-p), 1 / param_two);
+	case CONSTANT:
+	default:
+		return param_one;
+	}
 }
 
-/* source for naive implementation english wikipedia articles */
+/* All distributions are sampled by inversion with the same parameters as
+ * the GNU Scientific Library uses */
+
+extern double dist_exponential(struct _flow *flow, const double mu)
+{
+	return dist_quantile(EXPONENTIAL, mu, 0, rn_uniform_pos(flow));
+}
 
 extern double dist_uniform(struct _flow *flow, const double minval,
 			   const double maxval)
 {
-#ifdef HAVE_LIBGSL
-	gsl_rng * r = flow->r;
-	return gsl_ran_flat(r, minval, maxval);
-#else
-	const double x = rn_uniform_zero_to_one(flow);
-	return ((maxval-minval) * x) + minval;
-#endif /* HAVE_LIBGSL */
+	return dist_quantile(UNIFORM, minval, maxval, rn_uniform_pos(flow));
 }
 
 extern double dist_normal(struct _flow *flow, const double mu,
-			  const double sigma_square)
+			  const double sigma)
 {
-#ifdef HAVE_LIBGSL
-	const gsl_rng * r = flow->r;
-	return gsl_ran_gaussian (r, sigma_square) + mu;
-#else
-	const double x = rn_uniform_minusone_to_one(flow);
-	return (1.0 / sqrt(2.0*M_PI*sigma_square)) *
-		exp((-pow ((x-mu),2)) / (2 * sigma_square));
-#endif /* HAVE_LIBGSL */
+	return dist_quantile(NORMAL, mu, sigma, rn_uniform_pos(flow));
 }
 
 extern double dist_lognormal(struct _flow *flow, const double zeta,
 			     const double sigma)
 {
-#ifdef HAVE_LIBGSL
-	gsl_rng * r = flow->r;
-	return gsl_ran_lognormal (r, zeta, sigma);
-#else
-	/* not implemented */
-	UNUSED_ARGUMENT(flow);
-	UNUSED_ARGUMENT(zeta);
-	UNUSED_ARGUMENT(sigma);
-	return 0;
-#endif /* HAVE_LIBGSL */
+	return dist_quantile(LOGNORMAL, zeta, sigma, rn_uniform_pos(flow));
 }
 
-
 extern int dist_bernoulli(struct _flow *flow, const double p)
 {
-#ifdef HAVE_LIBGSL
-	gsl_rng * r = flow->r;
-	return gsl_ran_bernoulli (r, p);
-#else
-	return rn_uniform_zero_to_one(flow) <= p;
-#endif /* HAVE_LIBGSL */
+	return rn_uniform_pos(flow) <= p;
 }
 
 extern double dist_pareto (struct _flow *flow, const double k,
 			   const double x_min)
 {
-#ifdef HAVE_LIBGSL
-	gsl_rng * r = flow->r;
-	return gsl_ran_pareto (r, k, x_min);
-#else
-	const double x = rn_uniform(flow);
-	if (x < x_min)
-		return 0;
-	else
-		return  (k/x_min) * pow (x_min/x,k+1);
-#endif /* HAVE_LIBGSL */
+	return dist_quantile(PARETO, k, x_min, rn_uniform_pos(flow));
 }
 
 extern double dist_weibull (struct _flow *flow, const double alpha,
 			    const double beta)
 {
-#ifdef HAVE_LIBGSL
-	gsl_rng * r = flow->r;
-	return gsl_ran_weibull (r, alpha, beta);
-#else
-	const double x = rn_uniform_zero_to_one(flow);
-	return  alpha * beta * pow (x,beta-1.0) * exp(-alpha * pow(x,beta));
-#endif /* HAVE_LIBGSL */
+	return dist_quantile(WEIBULL, alpha, beta, rn_uniform_pos(flow));
 }
 
-extern double dist_chisq (struct _flow *flow, const double nu)
+extern double dist_sample(struct _flow *flow, enum distributions type,
+			  const double param_one, const double param_two)
 {
-#ifdef HAVE_LIBGSL
-	gsl_rng * r = flow->r;
-	return gsl_ran_chisq(r, nu);
-#else
-	/* not implemented */
-	UNUSED_ARGUMENT(flow);
-	UNUSED_ARGUMENT(nu);
+	if (type == CONSTANT)
+		return param_one;
+
+	return dist_quantile(type, param_one, param_two, rn_uniform_pos(flow));
+}
+
+/* Draw @p n values from the distribution truncated to [min,max]. Instead of
+ * rejecting values out of bounds, the uniform random numbers are mapped
+ * onto the probability mass within the bounds */
+extern void dist_truncated(struct _flow *flow, enum distributions type,
+			   const double param_one, const double param_two,
+			   const double min, const double max,
+			   double *values, unsigned int n)
+{
+	double lo = 0, hi = 0, x;
+
+	if (type != CONSTANT) {
+		lo = dist_cdf(type, param_one, param_two, min);
+		hi = dist_cdf(type, param_one, param_two, max);
+	}
+
+	for (unsigned int i = 0; i < n; i++) {
+		if (hi > lo)
+			x = dist_quantile(type, param_one, param_two,
+					  lo + (hi - lo) * rn_uniform_pos(flow));
+		else
+			/* no probability mass within the bounds */
+			x = dist_sample(flow, type, param_one, param_two);
+
+		/* rounding errors of the quantile function */
+		values[i] = MIN(MAX(x, min), max);
+	}
+}
+
+extern int alias_table_init(struct _alias_table *table, const double *weights,
+			    unsigned int size)
+{
+	unsigned int *work, num_small = 0, num_large = 0, s, l, i;
+	double sum = 0;
+
+	for (i = 0; i < size; i++)
+		sum += weights[i];
+	if (!size || !(sum > 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	table->size = size;
+	table->prob = malloc(size * sizeof(*table->prob));
+	table->alias = malloc(size * sizeof(*table->alias));
+	/* small columns are pushed from the front, large from the back */
+	work = malloc(size * sizeof(*work));
+	if (!table->prob || !table->alias || !work) {
+		free_all(table->prob, table->alias, work);
+		table->prob = NULL;
+		table->alias = NULL;
+		return -1;
+	}
+
+	for (i = 0; i < size; i++) {
+		table->prob[i] = weights[i] * size / sum;
+		table->alias[i] = i;
+		if (table->prob[i] < 1)
+			work[num_small++] = i;
+		else
+			work[size - ++num_large] = i;
+	}
+
+	/* fill up each small column with the excess of a large one */
+	while (num_small && num_large) {
+		s = work[--num_small];
+		l = work[size - num_large--];
+		table->alias[s] = l;
+		table->prob[l] -= 1 - table->prob[s];
+		if (table->prob[l] < 1)
+			work[num_small++] = l;
+		else
+			work[size - ++num_large] = l;
+	}
+
+	/* remaining columns are full up to rounding errors */
+	while (num_small)
+		table->prob[work[--num_small]] = 1;
+	while (num_large)
+		table->prob[work[size - num_large--]] = 1;
+
+	free(work);
 	return 0;
-#endif /* HAVE_LIBGSL */
 }
 
+extern void alias_table_free(struct _alias_table *table)
+{
+	free_all(table->prob, table->alias);
+	table->prob = NULL;
+	table->alias = NULL;
+	table->size = 0;
+}
@@ -27,12 +27,52 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <stdint.h>
+
 #include "daemon.h"
 
+/** Table for sampling a discrete distribution in constant time (alias
+ * method). Column i is chosen uniformly, then i itself with probability
+ * prob[i] or alias[i] otherwise */
+struct _alias_table {
+	/** Number of values of the distribution */
+	unsigned int size;
+	double *prob;
+	unsigned int *alias;
+};
+
 /* initalization for random number generator */
 extern void init_math_functions (struct _flow *flow, unsigned long seed);
 extern void free_math_functions (struct _flow *flow);
 
+static inline uint64_t rotl64(const uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/** Next random number of the flow (xoshiro256**) */
+static inline uint64_t rn_next(struct _flow *flow)
+{
+	uint64_t *s = flow->rng;
+	const uint64_t result = rotl64(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl64(s[3], 45);
+
+	return result;
+}
+
+/** Uniformly distributed random number within (0,1) */
+static inline double rn_uniform_pos(struct _flow *flow)
+{
+	return ((rn_next(flow) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
 /* basic probability distributions */
 extern int dist_bernoulli (struct _flow *flow, const double p);
 extern double dist_pareto (struct _flow *flow,
@@ -40,12 +80,36 @@ extern double dist_pareto (struct _flow *flow,
 extern double dist_weibull (struct _flow *flow,
 			    const double alpha, const double beta);
 extern double dist_normal (struct _flow *flow,
-			   const double mu, const double sigma_square);
+			   const double mu, const double sigma);
 extern double dist_lognormal (struct _flow *flow,
 			      const double zeta, const double sigma);
 extern double dist_uniform (struct _flow *flow,
 			    const double minval, const double maxval);
 extern double dist_exponential (struct _flow *flow, const double mu);
-extern double dist_chisq (struct _flow *flow, const double nu);
+
+/* traffic generation distributions */
+extern double dist_sample (struct _flow *flow, enum distributions type,
+			   const double param_one, const double param_two);
+extern void dist_truncated (struct _flow *flow, enum distributions type,
+			    const double param_one, const double param_two,
+			    const double min, const double max,
+			    double *values, unsigned int n);
+
+/* empirical distributions */
+extern int alias_table_init (struct _alias_table *table,
+			     const double *weights, unsigned int size);
+extern void alias_table_free (struct _alias_table *table);
+
+/** Index of a value drawn from the distribution of @p table */
+static inline unsigned int alias_table_sample(struct _flow *flow,
+					      const struct _alias_table *table)
+{
+	const uint64_t r = rn_next(flow);
+	/* upper half selects the column, lower half tosses the coin */
+	const unsigned int i = ((r >> 32) * table->size) >> 32;
+
+	return (uint32_t)r * (1.0 / 4294967296.0) < table->prob[i] ?
+		i : table->alias[i];
+}
 
 #endif /* _FG_MATH_H_ */
@@ -0,0 +1,152 @@
+/**
+ * @file fg_math_bench.c
+ * @brief Microbenchmark of the random number generation of the traffic
+ * generator
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "fg_error.h"
+#include "fg_math.h"
+#include "fg_progname.h"
+#include "fg_stdlib.h"
+#include "fg_time.h"
+
+/** Number of samples drawn per benchmark */
+#define SAMPLES 10000000
+
+/** Upper bound of the truncated block sizes, like -U */
+#define MAX_BLOCK_SIZE 8192
+
+/** Number of values of the empirical distribution */
+#define ALIAS_SIZE 4096
+
+static struct _flow flow;
+
+/* Keeps the compiler from optimizing the sampling away */
+static volatile double sink;
+
+static const struct {
+	const char *name;
+	enum distributions type;
+	double param_one;
+	double param_two;
+} dists[] = {
+	{"uniform", UNIFORM, 100, 1000},
+	{"exponential", EXPONENTIAL, 1000, 0},
+	{"normal", NORMAL, 1000, 100},
+	{"lognormal", LOGNORMAL, 7, 1},
+	{"pareto", PARETO, 1.5, 100},
+	{"weibull", WEIBULL, 1000, 1.5},
+};
+
+static void report(const char *name, const struct timespec *start)
+{
+	struct timespec now;
+
+	gettime(&now);
+	printf("%-32s %8.2f Msamples/s\n", name,
+	       SAMPLES / time_diff(start, &now) / 1e6);
+}
+
+/* Block sizes drawn the way the traffic generator did before truncated
+ * sampling: values out of bounds are drawn again, at most 10 times */
+static double rejection_sample(int d)
+{
+	double x = 0;
+
+	for (int i = 0; i < 10 && (x < MIN_BLOCK_SIZE || x > MAX_BLOCK_SIZE);
+	     i++)
+		x = dist_sample(&flow, dists[d].type, dists[d].param_one,
+				dists[d].param_two);
+
+	return x;
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec start;
+	struct _alias_table table;
+	double values[TRAFGEN_BATCH];
+	double *weights;
+	char name[64];
+	unsigned int d, i, j;
+
+	UNUSED_ARGUMENT(argc);
+	set_progname(argv[0]);
+	init_math_functions(&flow, 1);
+
+	gettime(&start);
+	for (i = 0; i < SAMPLES; i++)
+		sink = rn_next(&flow);
+	report("xoshiro256**", &start);
+
+	for (d = 0; d < sizeof(dists) / sizeof(dists[0]); d++) {
+		gettime(&start);
+		for (i = 0; i < SAMPLES; i++)
+			sink = dist_sample(&flow, dists[d].type,
+					   dists[d].param_one,
+					   dists[d].param_two);
+		snprintf(name, sizeof(name), "%s", dists[d].name);
+		report(name, &start);
+
+		gettime(&start);
+		for (i = 0; i < SAMPLES; i++)
+			sink = rejection_sample(d);
+		snprintf(name, sizeof(name), "%s rejection", dists[d].name);
+		report(name, &start);
+
+		gettime(&start);
+		for (i = 0; i < SAMPLES; i += TRAFGEN_BATCH) {
+			dist_truncated(&flow, dists[d].type,
+				       dists[d].param_one, dists[d].param_two,
+				       MIN_BLOCK_SIZE, MAX_BLOCK_SIZE, values,
+				       TRAFGEN_BATCH);
+			for (j = 0; j < TRAFGEN_BATCH; j++)
+				sink = values[j];
+		}
+		snprintf(name, sizeof(name), "%s truncated", dists[d].name);
+		report(name, &start);
+	}
+
+	weights = malloc(ALIAS_SIZE * sizeof(*weights));
+	if (!weights)
+		critx("out of memory");
+	for (i = 0; i < ALIAS_SIZE; i++)
+		weights[i] = dist_pareto(&flow, 1.5, 1);
+	if (alias_table_init(&table, weights, ALIAS_SIZE) == -1)
+		crit("unable to build alias table");
+
+	gettime(&start);
+	for (i = 0; i < SAMPLES; i++)
+		sink = alias_table_sample(&flow, &table);
+	report("alias table", &start);
+
+	alias_table_free(&table);
+	free(weights);
+
+	exit(EXIT_SUCCESS);
+}
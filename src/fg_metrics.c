@@ -0,0 +1,425 @@
+/**
+ * @file fg_metrics.c
+ * @brief Exposition of live daemon metrics over HTTP in the Prometheus text
+ * format
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "debug.h"
+#include "fg_error.h"
+#include "fg_metrics.h"
+#include "fg_stdlib.h"
+#include "fg_string.h"
+#include "fg_time.h"
+#include "log.h"
+
+/** Size of the buffer for the HTTP request of the scraper */
+#define METRICS_REQUEST_SIZE 4096
+
+const double metrics_rtt_bounds[METRICS_RTT_BUCKETS] = {
+	0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+	0.01, 0.025, 0.05, 0.1, 0.25, 1.0
+};
+
+/* Kind of value of a per-flow metric */
+enum metric_kind {
+	/* unsigned long long counter */
+	KIND_COUNTER,
+	/* unsigned long long gauge */
+	KIND_GAUGE,
+	/* int gauge from tcp_info */
+	KIND_TCP_INFO,
+	/* int gauge from tcp_info in microseconds */
+	KIND_TCP_INFO_USEC
+};
+
+/* Per-flow metrics, except the RTT histogram */
+static const struct {
+	const char *name;
+	const char *help;
+	enum metric_kind kind;
+	size_t offset;
+} flow_metrics[] = {
+	{"flowgrind_flow_bytes_read_total", "Bytes read by the flow",
+	 KIND_COUNTER, offsetof(struct _flow_metrics, bytes_read)},
+	{"flowgrind_flow_bytes_written_total", "Bytes written by the flow",
+	 KIND_COUNTER, offsetof(struct _flow_metrics, bytes_written)},
+	{"flowgrind_flow_request_blocks_read_total",
+	 "Request blocks read by the flow", KIND_COUNTER,
+	 offsetof(struct _flow_metrics, request_blocks_read)},
+	{"flowgrind_flow_request_blocks_written_total",
+	 "Request blocks written by the flow", KIND_COUNTER,
+	 offsetof(struct _flow_metrics, request_blocks_written)},
+	{"flowgrind_flow_response_blocks_read_total",
+	 "Response blocks read by the flow", KIND_COUNTER,
+	 offsetof(struct _flow_metrics, response_blocks_read)},
+	{"flowgrind_flow_response_blocks_written_total",
+	 "Response blocks written by the flow", KIND_COUNTER,
+	 offsetof(struct _flow_metrics, response_blocks_written)},
+	{"flowgrind_flow_response_queue",
+	 "Response blocks waiting for the socket", KIND_GAUGE,
+	 offsetof(struct _flow_metrics, response_queue)},
+	{"flowgrind_flow_tcp_cwnd", "Congestion window (tcpi_snd_cwnd)",
+	 KIND_TCP_INFO, offsetof(struct _fg_tcp_info, tcpi_snd_cwnd)},
+	{"flowgrind_flow_tcp_ssthresh",
+	 "Slow start threshold (tcpi_snd_ssthresh)", KIND_TCP_INFO,
+	 offsetof(struct _fg_tcp_info, tcpi_snd_ssthresh)},
+	{"flowgrind_flow_tcp_unacked", "Unacknowledged segments (tcpi_unacked)",
+	 KIND_TCP_INFO, offsetof(struct _fg_tcp_info, tcpi_unacked)},
+	{"flowgrind_flow_tcp_sacked", "Selectively acknowledged segments "
+	 "(tcpi_sacked)", KIND_TCP_INFO,
+	 offsetof(struct _fg_tcp_info, tcpi_sacked)},
+	{"flowgrind_flow_tcp_lost", "Segments considered lost (tcpi_lost)",
+	 KIND_TCP_INFO, offsetof(struct _fg_tcp_info, tcpi_lost)},
+	{"flowgrind_flow_tcp_retrans", "Retransmitted segments in flight "
+	 "(tcpi_retrans)", KIND_TCP_INFO,
+	 offsetof(struct _fg_tcp_info, tcpi_retrans)},
+	{"flowgrind_flow_tcp_retransmits", "Consecutive retransmission "
+	 "timeouts (tcpi_retransmits)", KIND_TCP_INFO,
+	 offsetof(struct _fg_tcp_info, tcpi_retransmits)},
+	{"flowgrind_flow_tcp_reordering", "Reordering metric "
+	 "(tcpi_reordering)", KIND_TCP_INFO,
+	 offsetof(struct _fg_tcp_info, tcpi_reordering)},
+	{"flowgrind_flow_tcp_rtt_seconds", "Smoothed RTT of the kernel "
+	 "(tcpi_rtt)", KIND_TCP_INFO_USEC,
+	 offsetof(struct _fg_tcp_info, tcpi_rtt)},
+	{"flowgrind_flow_tcp_rttvar_seconds", "RTT variance of the kernel "
+	 "(tcpi_rttvar)", KIND_TCP_INFO_USEC,
+	 offsetof(struct _fg_tcp_info, tcpi_rttvar)},
+	{"flowgrind_flow_tcp_rto_seconds", "Retransmission timeout (tcpi_rto)",
+	 KIND_TCP_INFO_USEC, offsetof(struct _fg_tcp_info, tcpi_rto)},
+	{"flowgrind_flow_tcp_backoff", "Exponential backoff (tcpi_backoff)",
+	 KIND_TCP_INFO, offsetof(struct _fg_tcp_info, tcpi_backoff)},
+	{"flowgrind_flow_tcp_ca_state", "Congestion avoidance state "
+	 "(tcpi_ca_state)", KIND_TCP_INFO,
+	 offsetof(struct _fg_tcp_info, tcpi_ca_state)},
+	{"flowgrind_flow_tcp_mss", "Sender maximum segment size "
+	 "(tcpi_snd_mss)", KIND_TCP_INFO,
+	 offsetof(struct _fg_tcp_info, tcpi_snd_mss)},
+};
+
+/* The snapshot is written by the daemon thread with trylock only, hence a
+ * slow scraper delays the next snapshot but never the data path */
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct _metrics_snapshot snapshot;
+
+static pthread_t metrics_thread;
+static int metrics_fd = -1;
+
+/* Number of flows and point in time of the last snapshot. Only accessed
+ * from the daemon thread */
+static struct timespec last_publish;
+static unsigned int last_num_flows;
+
+static const char *endpoint_label(enum flow_endpoint endpoint)
+{
+	return endpoint == SOURCE ? "source" : "destination";
+}
+
+/* Print the metrics of the snapshot in the Prometheus text format */
+static char *format_metrics(const struct _metrics_snapshot *s)
+{
+	const unsigned int num_metrics =
+		sizeof(flow_metrics) / sizeof(flow_metrics[0]);
+	char *body = NULL;
+
+	asprintf_append(&body,
+		"# HELP flowgrind_daemon_snapshot_timestamp_seconds Point in "
+		"time the metrics were taken\n"
+		"# TYPE flowgrind_daemon_snapshot_timestamp_seconds gauge\n"
+		"flowgrind_daemon_snapshot_timestamp_seconds %ld.%09ld\n"
+		"# HELP flowgrind_daemon_loop_iterations_total Iterations of "
+		"the event loop\n"
+		"# TYPE flowgrind_daemon_loop_iterations_total counter\n"
+		"flowgrind_daemon_loop_iterations_total %llu\n"
+		"# HELP flowgrind_daemon_loop_seconds_total Time spent in the "
+		"parts of the event loop\n"
+		"# TYPE flowgrind_daemon_loop_seconds_total counter\n"
+		"flowgrind_daemon_loop_seconds_total{part=\"select\"} %.9f\n"
+		"flowgrind_daemon_loop_seconds_total{part=\"prepare\"} %.9f\n"
+		"flowgrind_daemon_loop_seconds_total{part=\"timer\"} %.9f\n"
+		"flowgrind_daemon_loop_seconds_total{part=\"process\"} %.9f\n"
+		"# HELP flowgrind_daemon_syscalls_total System calls issued by "
+		"the event loop\n"
+		"# TYPE flowgrind_daemon_syscalls_total counter\n"
+		"flowgrind_daemon_syscalls_total %llu\n"
+		"# HELP flowgrind_daemon_write_eagain_total Writes that hit the "
+		"limit of the send buffer\n"
+		"# TYPE flowgrind_daemon_write_eagain_total counter\n"
+		"flowgrind_daemon_write_eagain_total %llu\n"
+		"# HELP flowgrind_daemon_blocks_read_total Blocks read by "
+		"whether they were received with a single call\n"
+		"# TYPE flowgrind_daemon_blocks_read_total counter\n"
+		"flowgrind_daemon_blocks_read_total{received=\"whole\"} %llu\n"
+		"flowgrind_daemon_blocks_read_total{received=\"split\"} %llu\n"
+		"# HELP flowgrind_daemon_pending_reports Reports not fetched by "
+		"the controller yet\n"
+		"# TYPE flowgrind_daemon_pending_reports gauge\n"
+		"flowgrind_daemon_pending_reports %u\n"
+		"# HELP flowgrind_daemon_dropped_reports_total Interval and "
+		"completion reports dropped because the controller did not "
+		"fetch them\n"
+		"# TYPE flowgrind_daemon_dropped_reports_total counter\n"
+		"flowgrind_daemon_dropped_reports_total %llu\n"
+		"# HELP flowgrind_daemon_flows Flows of the daemon\n"
+		"# TYPE flowgrind_daemon_flows gauge\n"
+		"flowgrind_daemon_flows %u\n",
+		(long)s->timestamp.tv_sec, (long)s->timestamp.tv_nsec,
+		s->stats.loop_iterations, s->stats.select_time,
+		s->stats.prepare_time, s->stats.timer_time,
+		s->stats.process_time, s->stats.syscalls,
+		s->stats.write_eagain, s->stats.whole_blocks,
+		s->stats.split_blocks, s->pending_reports, s->dropped_reports,
+		s->num_flows);
+
+	for (unsigned int m = 0; m < num_metrics; m++) {
+		bool counter = flow_metrics[m].kind == KIND_COUNTER;
+
+		asprintf_append(&body, "# HELP %s %s\n# TYPE %s %s\n",
+				flow_metrics[m].name, flow_metrics[m].help,
+				flow_metrics[m].name,
+				counter ? "counter" : "gauge");
+
+		for (unsigned int i = 0; i < s->num_flows; i++) {
+			const struct _flow_metrics *f = &s->flows[i];
+			const char *label = endpoint_label(f->endpoint);
+
+			if (counter || flow_metrics[m].kind == KIND_GAUGE) {
+				asprintf_append(&body, "%s{flow=\"%d\","
+					"endpoint=\"%s\"} %llu\n",
+					flow_metrics[m].name, f->id, label,
+					*(const unsigned long long *)
+					((const char *)f + flow_metrics[m].offset));
+				continue;
+			}
+
+			if (!f->has_tcp_info)
+				continue;
+
+			int value = *(const int *)((const char *)&f->tcp_info +
+						   flow_metrics[m].offset);
+			if (flow_metrics[m].kind == KIND_TCP_INFO_USEC)
+				asprintf_append(&body, "%s{flow=\"%d\","
+					"endpoint=\"%s\"} %.6f\n",
+					flow_metrics[m].name, f->id, label,
+					value / 1e6);
+			else
+				asprintf_append(&body, "%s{flow=\"%d\","
+					"endpoint=\"%s\"} %d\n",
+					flow_metrics[m].name, f->id, label,
+					value);
+		}
+	}
+
+	asprintf_append(&body,
+		"# HELP flowgrind_flow_rtt_seconds Block round-trip time\n"
+		"# TYPE flowgrind_flow_rtt_seconds histogram\n");
+	for (unsigned int i = 0; i < s->num_flows; i++) {
+		const struct _flow_metrics *f = &s->flows[i];
+		const char *label = endpoint_label(f->endpoint);
+		unsigned long long count = 0;
+
+		for (unsigned int b = 0; b <= METRICS_RTT_BUCKETS; b++) {
+			count += f->rtt_buckets[b];
+			if (b < METRICS_RTT_BUCKETS)
+				asprintf_append(&body, "flowgrind_flow_rtt_"
+					"seconds_bucket{flow=\"%d\",endpoint="
+					"\"%s\",le=\"%g\"} %llu\n", f->id,
+					label, metrics_rtt_bounds[b], count);
+			else
+				asprintf_append(&body, "flowgrind_flow_rtt_"
+					"seconds_bucket{flow=\"%d\",endpoint="
+					"\"%s\",le=\"+Inf\"} %llu\n", f->id,
+					label, count);
+		}
+		asprintf_append(&body,
+			"flowgrind_flow_rtt_seconds_sum{flow=\"%d\","
+			"endpoint=\"%s\"} %.9f\n"
+			"flowgrind_flow_rtt_seconds_count{flow=\"%d\","
+			"endpoint=\"%s\"} %llu\n",
+			f->id, label, f->rtt_sum, f->id, label, count);
+	}
+
+	return body;
+}
+
+/* Write the whole buffer to the socket */
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t rc = write(fd, buf, len);
+		if (rc == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += rc;
+		len -= rc;
+	}
+	return 0;
+}
+
+/* Answer a single HTTP request. Any path is served the metrics */
+static void serve_request(int fd)
+{
+	char request[METRICS_REQUEST_SIZE];
+	char *header = NULL;
+	char *body;
+	ssize_t rc;
+
+	rc = read(fd, request, sizeof(request) - 1);
+	if (rc <= 0)
+		return;
+	request[rc] = '\0';
+
+	if (strncmp(request, "GET ", 4)) {
+		static const char response[] = "HTTP/1.0 405 Method Not "
+			"Allowed\r\nAllow: GET\r\nContent-Length: 0\r\n\r\n";
+		write_all(fd, response, sizeof(response) - 1);
+		return;
+	}
+
+	pthread_mutex_lock(&metrics_mutex);
+	body = format_metrics(&snapshot);
+	pthread_mutex_unlock(&metrics_mutex);
+
+	if (!body) {
+		logging_log(LOG_ALERT, "could not allocate memory for metrics");
+		return;
+	}
+
+	asprintf_append(&header, "HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: %zu\r\n\r\n", strlen(body));
+	if (header && write_all(fd, header, strlen(header)) == 0)
+		write_all(fd, body, strlen(body));
+
+	free_all(header, body);
+}
+
+static void *metrics_main(void *arg)
+{
+	UNUSED_ARGUMENT(arg);
+
+	for (;;) {
+		/* a scraper that never sends its request must not block
+		 * other scrapers forever */
+		struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+		int fd = accept(metrics_fd, NULL, NULL);
+
+		if (fd == -1) {
+			if (errno != EINTR)
+				logging_log(LOG_WARNING, "accept() on metrics "
+					    "socket failed: %s",
+					    strerror(errno));
+			continue;
+		}
+
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+			   sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+			   sizeof(timeout));
+		serve_request(fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+/**
+ * Start serving metrics on the given bound socket in a thread of its own
+ *
+ * @param[in] fd bound stream socket
+ * @return zero on success, -1 otherwise
+ */
+int metrics_init(int fd)
+{
+	if (listen(fd, 16) == -1) {
+		logging_log(LOG_ALERT, "listen() on metrics socket failed: %s",
+			    strerror(errno));
+		return -1;
+	}
+	metrics_fd = fd;
+
+	if (pthread_create(&metrics_thread, NULL, metrics_main, NULL)) {
+		logging_log(LOG_ALERT, "could not start metrics thread");
+		metrics_fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Return true if the daemon thread should take a new snapshot. A snapshot
+ * is due every METRICS_INTERVAL, and at once if the daemon got its first
+ * flow or lost its last one, since the event loop may block without flows.
+ * Other changes of the number of flows wait for the interval, with dynamic
+ * flow arrivals they happen far too often for a TCP_INFO of every flow
+ *
+ * @param[in] now current time
+ * @param[in] num_flows current number of flows of the daemon
+ */
+bool metrics_due(const struct timespec *now, unsigned int num_flows)
+{
+	if (metrics_fd == -1)
+		return false;
+
+	return !num_flows != !last_num_flows ||
+	       time_diff(&last_publish, now) >= METRICS_INTERVAL;
+}
+
+/**
+ * Lock the snapshot for writing by the daemon thread. Never blocks
+ *
+ * @return the snapshot, or NULL if it is being read by the metrics thread
+ */
+struct _metrics_snapshot *metrics_acquire(void)
+{
+	if (pthread_mutex_trylock(&metrics_mutex))
+		return NULL;
+
+	return &snapshot;
+}
+
+/**
+ * Unlock the snapshot after the daemon thread has filled it in
+ *
+ * @param[in] s snapshot returned by metrics_acquire()
+ */
+void metrics_release(struct _metrics_snapshot *s)
+{
+	last_publish = s->timestamp;
+	last_num_flows = s->num_flows;
+	pthread_mutex_unlock(&metrics_mutex);
+}
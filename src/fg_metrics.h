@@ -0,0 +1,102 @@
+/**
+ * @file fg_metrics.h
+ * @brief Exposition of live daemon metrics over HTTP in the Prometheus text
+ * format
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_METRICS_H_
+#define _FG_METRICS_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "common.h"
+
+/** Minimum time between two snapshots of the flow statistics, in seconds */
+#define METRICS_INTERVAL 1.0
+
+/** Number of finite buckets of the RTT histogram */
+#define METRICS_RTT_BUCKETS 12
+
+/** Upper bounds of the finite buckets of the RTT histogram, in seconds */
+extern const double metrics_rtt_bounds[METRICS_RTT_BUCKETS];
+
+/** Statistics of a single flow at the time of the snapshot */
+struct _flow_metrics {
+	int id;
+	enum flow_endpoint endpoint;
+
+	unsigned long long bytes_read;
+	unsigned long long bytes_written;
+	unsigned long long request_blocks_read;
+	unsigned long long request_blocks_written;
+	unsigned long long response_blocks_read;
+	unsigned long long response_blocks_written;
+	/** Number of response blocks waiting for the socket */
+	unsigned long long response_queue;
+
+	/** Number of RTT samples per bucket, the last bucket is +Inf */
+	unsigned long long rtt_buckets[METRICS_RTT_BUCKETS + 1];
+	/** Accumulated round-trip time */
+	double rtt_sum;
+
+	/** True if tcp_info holds the latest kernel metrics */
+	bool has_tcp_info;
+	struct _fg_tcp_info tcp_info;
+};
+
+/** Snapshot of the daemon state, written by the daemon thread and read by
+ * the metrics thread */
+struct _metrics_snapshot {
+	/** Point in time the snapshot was taken */
+	struct timespec timestamp;
+
+	struct _daemon_stats stats;
+	unsigned int pending_reports;
+	unsigned long long dropped_reports;
+
+	unsigned int num_flows;
+	struct _flow_metrics flows[MAX_FLOWS];
+};
+
+int metrics_init(int fd);
+bool metrics_due(const struct timespec *now, unsigned int num_flows);
+struct _metrics_snapshot *metrics_acquire(void);
+void metrics_release(struct _metrics_snapshot *snapshot);
+
+/**
+ * Return the bucket of the RTT histogram the given round-trip time falls
+ * into
+ *
+ * @param[in] rtt round-trip time in seconds
+ */
+static inline unsigned int metrics_rtt_bucket(double rtt)
+{
+	unsigned int i = 0;
+
+	while (i < METRICS_RTT_BUCKETS && rtt > metrics_rtt_bounds[i])
+		i++;
+
+	return i;
+}
+
+#endif /* _FG_METRICS_H_ */
@@ -0,0 +1,241 @@
+/**
+ * @file fg_payload.c
+ * @brief Pools of generated payload for request blocks
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/param.h>
+#include <sys/mman.h>
+
+#include "debug.h"
+#include "fg_stdlib.h"
+#include "fg_payload.h"
+
+/** Size of a huge page, the mapping of a pool is a multiple of it */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* All payload pools currently generated by the daemon. Only accessed from
+ * the daemon thread */
+static struct _payload_pool *pools = NULL;
+
+/* The payload only has to defeat compression and deduplication, not to be
+ * of statistical quality. A fixed seed keeps it the same across runs */
+static inline uint64_t xorshift64(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ULL;
+}
+
+static void fill_random(char *data, size_t n, uint64_t *state)
+{
+	uint64_t r;
+
+	for (; n >= sizeof(r); n -= sizeof(r), data += sizeof(r)) {
+		r = xorshift64(state);
+		memcpy(data, &r, sizeof(r));
+	}
+	if (n) {
+		r = xorshift64(state);
+		memcpy(data, &r, n);
+	}
+}
+
+/* Random bytes at the beginning of each segment, zeros after them.
+ * Compressors shrink the zeros to almost nothing, so the payload compresses
+ * by about the given ratio */
+static void fill_compressible(char *data, size_t n, double ratio,
+			      uint64_t *state)
+{
+	size_t random = PAYLOAD_SEGMENT_SIZE / ratio;
+
+	for (size_t pos = 0; pos < n; pos += PAYLOAD_SEGMENT_SIZE)
+		fill_random(data + pos, MIN(random, n - pos), state);
+}
+
+/* Read the beginning of the file, a short file is repeated */
+static int fill_file(char *data, size_t n, const char *path,
+		     const char **error)
+{
+	size_t len = 0;
+	ssize_t rc;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		*error = strerror(errno);
+		return -1;
+	}
+	while (len < n) {
+		rc = read(fd, data + len, n - len);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc == -1) {
+			*error = strerror(errno);
+			close(fd);
+			return -1;
+		}
+		if (!rc)
+			break;
+		len += rc;
+	}
+	close(fd);
+
+	if (!len) {
+		*error = "file is empty";
+		return -1;
+	}
+	while (len < n) {
+		size_t copy = MIN(len, n - len);
+
+		memcpy(data + len, data, copy);
+		len += copy;
+	}
+	return 0;
+}
+
+/* Map zeroed memory for a pool, preferably from the reserved huge pages */
+static char *map_pool(size_t length, int *huge)
+{
+	void *map;
+
+#ifdef MAP_HUGETLB
+	map = mmap(NULL, length, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (map != MAP_FAILED) {
+		*huge = 1;
+		return map;
+	}
+#endif /* MAP_HUGETLB */
+
+	map = mmap(NULL, length, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+	*huge = 0;
+#ifdef MADV_HUGEPAGE
+	/* no huge pages reserved, ask for transparent ones */
+	madvise(map, length, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+	return map;
+}
+
+struct _payload_pool *payload_pool_get(enum payload_type type, double ratio,
+				       const char *path, size_t block_size,
+				       const char **error)
+{
+	struct _payload_pool *pool;
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+	for (pool = pools; pool; pool = pool->next) {
+		if (pool->type == type && pool->block_size >= block_size &&
+		    (type != PAYLOAD_COMPRESSIBLE || pool->ratio == ratio) &&
+		    (type != PAYLOAD_FILE || !strcmp(pool->path, path))) {
+			pool->refcount++;
+			return pool;
+		}
+	}
+
+	pool = calloc(1, sizeof(struct _payload_pool));
+	if (!pool) {
+		*error = "out of memory";
+		return NULL;
+	}
+	pool->type = type;
+	pool->ratio = ratio;
+	pool->block_size = block_size;
+	pool->length = (PAYLOAD_POOL_SIZE + block_size + HUGE_PAGE_SIZE - 1) /
+		       HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+	if (type == PAYLOAD_FILE) {
+		pool->path = strdup(path);
+		if (!pool->path) {
+			*error = "out of memory";
+			goto error;
+		}
+	}
+
+	pool->data = map_pool(pool->length, &pool->huge);
+	if (!pool->data) {
+		*error = strerror(errno);
+		goto error;
+	}
+
+	switch (type) {
+	case PAYLOAD_RANDOM:
+		fill_random(pool->data, PAYLOAD_POOL_SIZE, &state);
+		break;
+	case PAYLOAD_COMPRESSIBLE:
+		fill_compressible(pool->data, PAYLOAD_POOL_SIZE, ratio, &state);
+		break;
+	case PAYLOAD_FILE:
+		if (fill_file(pool->data, PAYLOAD_POOL_SIZE, path, error) == -1)
+			goto error;
+		break;
+	default:
+		*error = "unknown payload type";
+		goto error;
+	}
+	/* blocks starting near the end continue at the beginning */
+	memcpy(pool->data + PAYLOAD_POOL_SIZE, pool->data, block_size);
+
+	pool->refcount = 1;
+	pool->next = pools;
+	pools = pool;
+
+	DEBUG_MSG(LOG_NOTICE, "generated payload pool of type %d, %zu bytes%s",
+		  type, pool->length, pool->huge ? " in huge pages" : "");
+
+	return pool;
+
+error:
+	if (pool->data)
+		munmap(pool->data, pool->length);
+	free_all(pool->path, pool);
+	return NULL;
+}
+
+void payload_pool_put(struct _payload_pool *pool)
+{
+	struct _payload_pool **p;
+
+	if (!pool || --pool->refcount)
+		return;
+
+	for (p = &pools; *p; p = &(*p)->next) {
+		if (*p == pool) {
+			*p = pool->next;
+			break;
+		}
+	}
+
+	munmap(pool->data, pool->length);
+	free_all(pool->path, pool);
+}
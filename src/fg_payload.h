@@ -0,0 +1,86 @@
+/**
+ * @file fg_payload.h
+ * @brief Pools of generated payload for request blocks
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_PAYLOAD_H_
+#define _FG_PAYLOAD_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stddef.h>
+
+#include "common.h"
+
+/** Amount of distinct payload of a pool, a single huge page on x86 */
+#define PAYLOAD_POOL_SIZE (2 * 1024 * 1024)
+
+/** Bytes of generated payload a compression ratio applies to */
+#define PAYLOAD_SEGMENT_SIZE 512
+
+/** Payload generated once for all flows of the daemon with the same
+ * payload settings. Shared read-only by these flows */
+struct _payload_pool {
+	/** Content of the payload */
+	enum payload_type type;
+	/** Compression ratio of PAYLOAD_COMPRESSIBLE */
+	double ratio;
+	/** Source file of PAYLOAD_FILE, NULL otherwise */
+	char *path;
+	/** Number of flows using this pool */
+	unsigned int refcount;
+	/** PAYLOAD_POOL_SIZE bytes of payload, followed by a copy of their
+	 * beginning, so that a block of up to @p block_size bytes can start
+	 * at any offset below PAYLOAD_POOL_SIZE */
+	char *data;
+	/** Length of the mapping of @p data */
+	size_t length;
+	/** Largest block the pool can provide payload for */
+	size_t block_size;
+	/** Set if @p data is backed by huge pages */
+	int huge;
+	/** Next pool of the daemon */
+	struct _payload_pool *next;
+};
+
+/**
+ * Generate a payload pool or reuse an existing one with the same settings
+ *
+ * @param[in] type content of the payload
+ * @param[in] ratio compression ratio of PAYLOAD_COMPRESSIBLE
+ * @param[in] path source file of PAYLOAD_FILE
+ * @param[in] block_size largest block the flow writes
+ * @param[out] error static error description if the pool could not be
+ * generated
+ * @return the shared pool, or NULL on error
+ */
+struct _payload_pool *payload_pool_get(enum payload_type type, double ratio,
+				       const char *path, size_t block_size,
+				       const char **error);
+
+/**
+ * Release a pool returned by payload_pool_get(). The pool is unmapped once
+ * the last flow released it
+ *
+ * @param[in] pool pool to release, may be NULL
+ */
+void payload_pool_put(struct _payload_pool *pool);
+
+#endif /* _FG_PAYLOAD_H_ */
@@ -0,0 +1,71 @@
+/**
+ * @file fg_probes.h
+ * @brief Static user-space tracepoints (USDT) of the Flowgrind daemon
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_PROBES_H_
+#define _FG_PROBES_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * The probes belong to the provider "flowgrind" and can be listed with
+ * 'perf list sdt_flowgrind:*' or 'bpftrace -l usdt:flowgrindd:*'. A probe
+ * compiles to a single nop and its arguments are only materialized for the
+ * tracer, so they cost nothing as long as no tracer is attached. Without
+ * <sys/sdt.h> the probes and their arguments vanish entirely.
+ *
+ * Timestamps are passed in nanoseconds, durations as signed nanoseconds,
+ * since tracers cannot read floating point arguments. All timestamps are
+ * taken on the monotonic clock, which perf and bpftrace use for the kernel
+ * events as well.
+ *
+ * flow_start(flow id, endpoint, scheduled start)
+ * flow_finish(flow id, bytes written, bytes read)
+ * block_written(flow id, block size, requested response size, timestamp)
+ * block_read(flow id, block size, requested response size, timestamp)
+ * response_sent(flow id, block size, timestamp)
+ * rtt(flow id, round-trip time)
+ * congestion(flow id, congestion counter)
+ * report(flow id, report type, bytes written, bytes read)
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define FG_PROBE(name, ...) STAP_PROBEV(flowgrind, name, ##__VA_ARGS__)
+#else /* HAVE_SYS_SDT_H */
+#define FG_PROBE(name, ...) do {} while (0)
+#endif /* HAVE_SYS_SDT_H */
+
+/** Convert a point in time to nanoseconds for a probe argument */
+static inline uint64_t probe_ns(const struct timespec *tp)
+{
+	return (uint64_t)tp->tv_sec * 1000000000ULL + tp->tv_nsec;
+}
+
+/** Convert a duration in seconds to nanoseconds for a probe argument */
+static inline int64_t probe_duration_ns(double seconds)
+{
+	return (int64_t)(seconds * 1e9);
+}
+
+#endif /* _FG_PROBES_H_ */
@@ -0,0 +1,189 @@
+/**
+ * @file fg_reports.c
+ * @brief XML-RPC method handing the reports of the daemon to the controller
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "daemon.h"
+#include "debug.h"
+#include "fg_reports.h"
+#include "fg_stdlib.h"
+#include "log.h"
+
+xmlrpc_value * method_get_reports(xmlrpc_env * const env,
+		   xmlrpc_value * const param_array,
+		   void * const user_data)
+{
+	int has_more;
+	xmlrpc_value *ret = 0, *item = 0;
+
+	UNUSED_ARGUMENT(param_array);
+	UNUSED_ARGUMENT(user_data);
+
+	DEBUG_MSG(LOG_NOTICE, "Method get_reports called");
+
+	struct _report *report = get_reports(&has_more);
+
+	ret = xmlrpc_array_new(env);
+
+	/* Add information if there's more reports pending */
+	item = xmlrpc_int_new(env, has_more);
+	xmlrpc_array_append_item(env, ret, item);
+	xmlrpc_DECREF(item);
+
+	while (report) {
+		xmlrpc_value *rv = xmlrpc_build_value(env,
+			"("
+			"{s:i,s:i,s:i,s:i,s:i,s:i}" /* timeval */
+			"{s:i,s:i,s:i,s:i}" /* bytes */
+			"{s:i,s:i,s:i,s:i}" /* block counts */
+			"{s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d}" /* RTT, IAT, Delay */
+			"{s:i,s:i}" /* MTU */
+			"{s:i,s:i,s:i,s:i,s:i}" /* TCP info */
+			"{s:i,s:i,s:i,s:i,s:i}" /* ...      */
+			"{s:i,s:i,s:i,s:i,s:i}" /* ...      */
+			"{s:i,s:d,s:d,s:d,s:i}" /* extended TCP info */
+			"{s:d,s:d,s:i,s:i,s:i}" /* ...               */
+			"{s:i,s:i}" /* completion */
+			"{s:d}" /* start skew */
+			"{s:d,s:d,s:d,s:d,s:d}" /* CPU */
+			"{s:i,s:d,s:d}" /* response queue */
+			"{s:i,s:i}" /* transactions */
+			"{s:i}" /* write calls */
+			"{s:i,s:i,s:i}" /* corruption */
+			"{s:i}" /* dropped completions */
+			"{s:i}"
+			")",
+
+			"id", report->id,
+			"type", report->type,
+			"begin_tv_sec", (int)report->begin.tv_sec,
+			"begin_tv_nsec", (int)report->begin.tv_nsec,
+			"end_tv_sec", (int)report->end.tv_sec,
+			"end_tv_nsec", (int)report->end.tv_nsec,
+
+			"bytes_read_high", (int32_t)(report->bytes_read >> 32),
+			"bytes_read_low", (int32_t)(report->bytes_read & 0xFFFFFFFF),
+			"bytes_written_high", (int32_t)(report->bytes_written >> 32),
+			"bytes_written_low", (int32_t)(report->bytes_written & 0xFFFFFFFF),
+
+			"request_blocks_read", report->request_blocks_read,
+			"request_blocks_written", report->request_blocks_written,
+			"response_blocks_read", report->response_blocks_read,
+			"response_blocks_written", report->response_blocks_written,
+
+			"rtt_min", report->rtt_min,
+			"rtt_max", report->rtt_max,
+			"rtt_sum", report->rtt_sum,
+			"iat_min", report->iat_min,
+			"iat_max", report->iat_max,
+			"iat_sum", report->iat_sum,
+			"delay_min", report->delay_min,
+			"delay_max", report->delay_max,
+			"delay_sum", report->delay_sum,
+
+			"pmtu", report->pmtu,
+			"imtu", report->imtu,
+
+/* Currently, not all members of the TCP_INFO socket option are used by the
+ * FreeBSD kernel. Other members will contain zeroes */
+			"tcpi_snd_cwnd", (int)report->tcp_info.tcpi_snd_cwnd,
+			"tcpi_snd_ssthresh", (int)report->tcp_info.tcpi_snd_ssthresh,
+			"tcpi_unacked", (int)report->tcp_info.tcpi_unacked,
+			"tcpi_sacked", (int)report->tcp_info.tcpi_sacked,
+			"tcpi_lost", (int)report->tcp_info.tcpi_lost,
+			"tcpi_retrans", (int)report->tcp_info.tcpi_retrans,
+			"tcpi_retransmits", (int)report->tcp_info.tcpi_retransmits,
+			"tcpi_fackets", (int)report->tcp_info.tcpi_fackets,
+			"tcpi_reordering", (int)report->tcp_info.tcpi_reordering,
+			"tcpi_rtt", (int)report->tcp_info.tcpi_rtt,
+			"tcpi_rttvar", (int)report->tcp_info.tcpi_rttvar,
+			"tcpi_rto", (int)report->tcp_info.tcpi_rto,
+			"tcpi_backoff", (int)report->tcp_info.tcpi_backoff,
+			"tcpi_ca_state", (int)report->tcp_info.tcpi_ca_state,
+			"tcpi_snd_mss", (int)report->tcp_info.tcpi_snd_mss,
+
+/* Only filled by newer Linux kernels, see tcpi_available */
+			"tcpi_available", report->tcp_info.tcpi_available,
+			"busy_time", report->busy_time,
+			"rwnd_limited", report->rwnd_limited,
+			"sndbuf_limited", report->sndbuf_limited,
+			"tcpi_min_rtt", report->tcp_info.tcpi_min_rtt,
+			"tcpi_pacing_rate", (double)report->tcp_info.tcpi_pacing_rate,
+			"tcpi_delivery_rate", (double)report->tcp_info.tcpi_delivery_rate,
+			"tcpi_bytes_acked_high", (int32_t)(report->tcp_info.tcpi_bytes_acked >> 32),
+			"tcpi_bytes_acked_low", (int32_t)(report->tcp_info.tcpi_bytes_acked & 0xFFFFFFFF),
+			"tcpi_notsent_bytes", report->tcp_info.tcpi_notsent_bytes,
+
+			"completion_tv_sec", (int)report->completion.tv_sec,
+			"completion_tv_nsec", (int)report->completion.tv_nsec,
+
+			"start_skew", report->start_skew,
+
+			"cpu_flow", report->cpu_flow,
+			"cpu_user", report->cpu_user,
+			"cpu_system", report->cpu_system,
+			"cpu_softirq", report->cpu_softirq,
+			"cpu_hz", report->cpu_hz,
+
+			"response_queue_max", report->response_queue_max,
+			"response_delay_max", report->response_delay_max,
+			"response_delay_sum", report->response_delay_sum,
+
+			"outstanding_max", report->outstanding_max,
+			"transactions_lost", report->transactions_lost,
+
+			"write_calls", report->write_calls,
+
+			"corrupted_blocks", report->corrupted_blocks,
+			"corruption_offset_high", (int32_t)(report->corruption_offset >> 32),
+			"corruption_offset_low", (int32_t)(report->corruption_offset & 0xFFFFFFFF),
+
+			"dropped_completions", report->dropped_completions,
+
+			"status", report->status
+		);
+
+		xmlrpc_array_append_item(env, ret, rv);
+
+		xmlrpc_DECREF(rv);
+
+		struct _report *next = report->next;
+		free(report);
+		report = next;
+	}
+
+	if (env->fault_occurred)
+		logging_log(LOG_WARNING, "Method get_reports failed: %s", env->fault_string);
+	else {
+		DEBUG_MSG(LOG_WARNING, "Method get_reports successful");
+	}
+
+	return ret;
+}
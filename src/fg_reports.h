@@ -0,0 +1,35 @@
+/**
+ * @file fg_reports.h
+ * @brief XML-RPC method handing the reports of the daemon to the controller
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_REPORTS_H_
+#define _FG_REPORTS_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <xmlrpc-c/base.h>
+
+/** Hands out the pending reports of the daemon, see get_reports() */
+xmlrpc_value * method_get_reports(xmlrpc_env * const env,
+				  xmlrpc_value * const param_array,
+				  void * const user_data);
+
+#endif /* _FG_REPORTS_H_ */
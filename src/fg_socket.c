@@ -314,6 +314,26 @@ int set_ip_mtu_discover(int fd)
 
 }
 
+int set_so_max_pacing_rate(int fd, unsigned int rate)
+{
+#ifdef __LINUX__
+#ifndef SO_MAX_PACING_RATE
+#define SO_MAX_PACING_RATE 47
+#endif /* SO_MAX_PACING_RATE */
+	DEBUG_MSG(LOG_WARNING, "Setting SO_MAX_PACING_RATE to %u B/s on fd %d",
+		  rate, fd);
+	return setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate,
+			  sizeof(rate));
+#else
+	UNUSED_ARGUMENT(fd);
+	UNUSED_ARGUMENT(rate);
+	DEBUG_MSG(LOG_ERR, "Cannot set SO_MAX_PACING_RATE for OS other than "
+		  "Linux");
+	errno = ENOPROTOOPT;
+	return -1;
+#endif /* __LINUX__ */
+}
+
 int set_tcp_cork(int fd)
 {
 #ifdef __LINUX__
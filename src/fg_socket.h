@@ -41,6 +41,7 @@ int set_route_record(int fd);
 int set_so_dscp(int fd, uint8_t);
 int set_so_elcn(int fd, int val);
 int set_so_lcd(int fd);
+int set_so_max_pacing_rate(int fd, unsigned int rate);
 int set_tcp_mtcp(int fd);
 int set_tcp_nodelay(int fd);
 int set_dscp(int fd, int dscp);
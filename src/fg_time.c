@@ -30,6 +30,13 @@
 #include <string.h>
 #include <time.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif /* defined __GNUC__ && (defined __x86_64__ || defined __i386__) */
 
 #include "fg_error.h"
 #include "fg_time.h"
@@ -126,3 +133,148 @@ int gettime(struct timespec *tp)
 	/* Get wall-clock time */
 	return clock_gettime(CLOCK_REALTIME, tp);
 }
+
+int gettime_monotonic(struct timespec *tp)
+{
+	return clock_gettime(CLOCK_MONOTONIC, tp);
+}
+
+/** Clocks cached by update_clock() */
+static struct {
+	/** Wall-clock time of the last update */
+	struct timespec wall;
+	/** Monotonic time of the last update */
+	struct timespec mono;
+	/** Wall-clock time minus monotonic time at the last sync */
+	struct timespec offset;
+	/** Monotonic time of the last sync */
+	struct timespec sync;
+#ifdef HAVE_TSC
+	/** TSC is invariant and calibrated */
+	bool tsc;
+	/** TSC at the last sync */
+	uint64_t sync_tsc;
+	/** Length of a TSC tick in nanoseconds */
+	double tsc_period;
+#endif /* HAVE_TSC */
+} clk;
+
+#ifdef HAVE_TSC
+/* Returns true if the TSC runs at a constant rate in all power states,
+ * hence can be used as clock source */
+static bool tsc_invariant(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) ||
+	    eax < 0x80000007)
+		return false;
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+		return false;
+	return edx & (1 << 8);
+}
+#endif /* HAVE_TSC */
+
+/* Synchronize the cached clocks with the system clocks. Calibrates the TSC
+ * against the monotonic clock since the previous sync */
+static void sync_clock(struct timespec *mono)
+{
+	struct timespec wall;
+
+	gettime_monotonic(mono);
+	gettime(&wall);
+#ifdef HAVE_TSC
+	uint64_t tsc = __rdtsc();
+	static int invariant = -1;
+
+	if (invariant == -1)
+		invariant = tsc_invariant();
+	if (invariant && clk.sync_tsc && tsc > clk.sync_tsc) {
+		clk.tsc_period = time_diff(&clk.sync, mono) * NSEC_PER_SEC /
+				 (tsc - clk.sync_tsc);
+		clk.tsc = true;
+	}
+	clk.sync_tsc = tsc;
+#endif /* HAVE_TSC */
+	clk.offset.tv_sec = wall.tv_sec - mono->tv_sec;
+	clk.offset.tv_nsec = wall.tv_nsec - mono->tv_nsec;
+	normalize_tp(&clk.offset);
+	clk.sync = *mono;
+}
+
+void update_clock(void)
+{
+	struct timespec mono;
+
+#ifdef HAVE_TSC
+	if (clk.tsc) {
+		int64_t elapsed = (__rdtsc() - clk.sync_tsc) * clk.tsc_period;
+
+		if (elapsed >= CLOCK_SYNC_INTERVAL * NSEC_PER_SEC) {
+			sync_clock(&mono);
+		} else {
+			mono.tv_sec = clk.sync.tv_sec;
+			mono.tv_nsec = clk.sync.tv_nsec + elapsed;
+			normalize_tp(&mono);
+		}
+	} else
+#endif /* HAVE_TSC */
+	{
+		gettime_monotonic(&mono);
+		/* first call syncs as well */
+		if (time_diff(&clk.sync, &mono) >= CLOCK_SYNC_INTERVAL)
+			sync_clock(&mono);
+	}
+
+	/* calibration errors of the TSC must not turn back time */
+	if (time_is_after(&clk.mono, &mono))
+		mono = clk.mono;
+	clk.mono = mono;
+
+	clk.wall.tv_sec = mono.tv_sec + clk.offset.tv_sec;
+	clk.wall.tv_nsec = mono.tv_nsec + clk.offset.tv_nsec;
+	normalize_tp(&clk.wall);
+}
+
+void gettime_monotonic_fast(struct timespec *tp)
+{
+#ifdef HAVE_TSC
+	if (clk.tsc) {
+		int64_t elapsed = (__rdtsc() - clk.sync_tsc) * clk.tsc_period;
+
+		tp->tv_sec = clk.sync.tv_sec;
+		tp->tv_nsec = clk.sync.tv_nsec + elapsed;
+		normalize_tp(tp);
+		return;
+	}
+#endif /* HAVE_TSC */
+	gettime_monotonic(tp);
+}
+
+void gettime_cached(struct timespec *tp)
+{
+	*tp = clk.wall;
+}
+
+void gettime_monotonic_cached(struct timespec *tp)
+{
+	*tp = clk.mono;
+}
+
+bool clock_uses_tsc(void)
+{
+#ifdef HAVE_TSC
+	return clk.tsc;
+#else
+	return false;
+#endif /* HAVE_TSC */
+}
+
+double clock_tsc_hz(void)
+{
+#ifdef HAVE_TSC
+	if (clk.tsc)
+		return NSEC_PER_SEC / clk.tsc_period;
+#endif /* HAVE_TSC */
+	return 0.0;
+}
@@ -36,6 +36,10 @@
 /** Number of nanoseconds per second */
 #define NSEC_PER_SEC	1000000000L
 
+/** Interval the cached clocks are synchronized with the system clocks, in
+ * seconds */
+#define CLOCK_SYNC_INTERVAL 1.0
+
 /**
  * Converts timespec struct @p tp into a null-terminated string and stores the
  * string in a user-supplied buffer @p buf
@@ -118,4 +122,68 @@ void time_add(struct timespec *tp, double seconds);
  */
 int gettime(struct timespec *tp);
 
+/**
+ * Returns monotonic time with nanosecond precision
+ *
+ * Get time from 'MONOTONIC' clock. The clock is not affected by
+ * discontinuous jumps in the system time and thus suited for measuring
+ * local intervals like RTT and IAT. Its time is only meaningful on the
+ * local host
+ *
+ * @param[out] tp current time in seconds and nanoseconds since an
+ * unspecified point in the past
+ * @return return 0 for success, or -1 for failure
+ */
+int gettime_monotonic(struct timespec *tp);
+
+/**
+ * Takes the timestamps returned by gettime_cached() and
+ * gettime_monotonic_cached()
+ *
+ * Called once per event loop iteration, so all blocks processed in the
+ * iteration share one timestamp. On x86 CPUs with an invariant TSC the
+ * monotonic time is derived from the TSC, calibrated against the
+ * 'MONOTONIC' clock every CLOCK_SYNC_INTERVAL. The wall-clock time is
+ * derived from the monotonic time and its offset to the 'REALTIME' clock,
+ * taken at the same interval. Not thread-safe
+ */
+void update_clock(void);
+
+/**
+ * Returns the current monotonic time without updating the cached clocks
+ *
+ * Derived from the TSC like update_clock() does if possible, which is
+ * cheaper than gettime_monotonic(). Successive calls may go back in time by
+ * the calibration error of the TSC at a sync. Not thread-safe
+ *
+ * @param[out] tp point in time in seconds and nanoseconds since an
+ * unspecified point in the past
+ */
+void gettime_monotonic_fast(struct timespec *tp);
+
+/**
+ * Returns the wall-clock time of the last update_clock() call
+ *
+ * @param[out] tp point in time in seconds and nanoseconds since the Epoch
+ */
+void gettime_cached(struct timespec *tp);
+
+/**
+ * Returns the monotonic time of the last update_clock() call
+ *
+ * @param[out] tp point in time in seconds and nanoseconds since an
+ * unspecified point in the past
+ */
+void gettime_monotonic_cached(struct timespec *tp);
+
+/**
+ * Returns true if update_clock() derives the time from the TSC
+ */
+bool clock_uses_tsc(void);
+
+/**
+ * Returns the calibrated rate of the TSC in Hz, 0 if the TSC is not used
+ */
+double clock_tsc_hz(void);
+
 #endif /* _FG_TIME_H_ */
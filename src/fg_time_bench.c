@@ -0,0 +1,94 @@
+/**
+ * @file fg_time_bench.c
+ * @brief Microbenchmark of the clocks used by the Flowgrind daemon
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "fg_progname.h"
+#include "fg_stdlib.h"
+#include "fg_time.h"
+
+/** Number of timestamps taken per benchmark */
+#define TIMESTAMPS 10000000
+
+/* Keeps the compiler from optimizing the timestamps away */
+static volatile long sink;
+
+static void report(const char *name, const struct timespec *start)
+{
+	struct timespec now;
+
+	gettime_monotonic(&now);
+	printf("%-32s %8.2f ns/timestamp\n", name,
+	       time_diff(start, &now) * 1e9 / TIMESTAMPS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec start, tp;
+	unsigned int i;
+
+	UNUSED_ARGUMENT(argc);
+	set_progname(argv[0]);
+
+	gettime_monotonic(&start);
+	for (i = 0; i < TIMESTAMPS; i++) {
+		gettime(&tp);
+		sink = tp.tv_nsec;
+	}
+	report("gettime", &start);
+
+	gettime_monotonic(&start);
+	for (i = 0; i < TIMESTAMPS; i++) {
+		gettime_monotonic(&tp);
+		sink = tp.tv_nsec;
+	}
+	report("gettime_monotonic", &start);
+
+	/* the TSC is calibrated at the second sync */
+	gettime_monotonic(&start);
+	do {
+		update_clock();
+		gettime_monotonic(&tp);
+	} while (time_diff(&start, &tp) <= CLOCK_SYNC_INTERVAL);
+
+	gettime_monotonic(&start);
+	for (i = 0; i < TIMESTAMPS; i++) {
+		update_clock();
+		gettime_monotonic_cached(&tp);
+		sink = tp.tv_nsec;
+	}
+	report(clock_uses_tsc() ? "update_clock (tsc)" : "update_clock",
+	       &start);
+
+	gettime_monotonic(&start);
+	for (i = 0; i < TIMESTAMPS; i++) {
+		gettime_monotonic_cached(&tp);
+		sink = tp.tv_nsec;
+	}
+	report("gettime_monotonic_cached", &start);
+
+	exit(EXIT_SUCCESS);
+}
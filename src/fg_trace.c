@@ -0,0 +1,157 @@
+/**
+ * @file fg_trace.c
+ * @brief Replay of recorded workloads from memory-mapped trace files
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
+#include "debug.h"
+#include "fg_math.h"
+#include "fg_stdlib.h"
+#include "fg_trace.h"
+
+/* All traces currently mapped by the daemon. Only accessed from the daemon
+ * thread */
+static struct _trace *traces = NULL;
+
+static inline uint64_t join_u32(uint32_t high, uint32_t low)
+{
+	return ((uint64_t)ntohl(high) << 32) + ntohl(low);
+}
+
+struct _trace *trace_open(const char *path, const char **error)
+{
+	struct _trace *trace;
+	const struct _trace_header *header;
+	struct stat st;
+	void *map;
+	int fd;
+
+	for (trace = traces; trace; trace = trace->next) {
+		if (!strcmp(trace->path, path)) {
+			trace->refcount++;
+			return trace;
+		}
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		*error = strerror(errno);
+		return NULL;
+	}
+	if (fstat(fd, &st) == -1) {
+		*error = strerror(errno);
+		close(fd);
+		return NULL;
+	}
+	if ((size_t)st.st_size < sizeof(struct _trace_header)) {
+		*error = "file too short";
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		*error = strerror(errno);
+		return NULL;
+	}
+
+	header = map;
+	if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic))) {
+		*error = "not a trace file";
+		goto error;
+	}
+
+	trace = calloc(1, sizeof(struct _trace));
+	if (!trace) {
+		*error = "out of memory";
+		goto error;
+	}
+	trace->num_records = join_u32(header->num_records_high,
+				      header->num_records_low);
+	if (!trace->num_records ||
+	    trace->num_records > (st.st_size - sizeof(struct _trace_header)) /
+				 sizeof(struct _trace_record)) {
+		*error = "number of records does not match the file size";
+		free(trace);
+		goto error;
+	}
+	trace->path = strdup(path);
+	if (!trace->path) {
+		*error = "out of memory";
+		free(trace);
+		goto error;
+	}
+	trace->map = map;
+	trace->length = st.st_size;
+	trace->records = (const struct _trace_record *)(header + 1);
+	trace->refcount = 1;
+	trace->next = traces;
+	traces = trace;
+
+	DEBUG_MSG(LOG_NOTICE, "mapped trace %s with %llu records", path,
+		  (unsigned long long)trace->num_records);
+
+	return trace;
+
+error:
+	munmap(map, st.st_size);
+	return NULL;
+}
+
+void trace_close(struct _trace *trace)
+{
+	struct _trace **p;
+
+	if (!trace || --trace->refcount)
+		return;
+
+	for (p = &traces; *p; p = &(*p)->next) {
+		if (*p == trace) {
+			*p = trace->next;
+			break;
+		}
+	}
+
+	DEBUG_MSG(LOG_NOTICE, "unmapped trace %s", trace->path);
+	munmap(trace->map, trace->length);
+	if (trace->size_table)
+		alias_table_free(trace->size_table);
+	free_all(trace->path, trace->size_pairs, trace->size_table, trace);
+}
+
+double trace_offset(const struct _trace *trace, uint64_t i)
+{
+	return join_u32(trace->records[i].offset_high,
+			trace->records[i].offset_low) / 1e6;
+}
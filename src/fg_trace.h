@@ -0,0 +1,106 @@
+/**
+ * @file fg_trace.h
+ * @brief Replay of recorded workloads from memory-mapped trace files
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_TRACE_H_
+#define _FG_TRACE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Magic number at the beginning of each trace file */
+#define TRACE_MAGIC "FGTRACE1"
+
+/**
+ * Header of a trace file. The header is followed by the records. All
+ * integers are in network byte order
+ */
+struct _trace_header {
+	/** Always TRACE_MAGIC, not null-terminated */
+	char magic[8];
+	/** Number of records in the file @{ */
+	uint32_t num_records_high;
+	uint32_t num_records_low;				/** @} */
+};
+
+/** A single request of a trace file, in network byte order */
+struct _trace_record {
+	/** Point in time the request was sent, in microseconds since the
+	 * start of the trace @{ */
+	uint32_t offset_high;
+	uint32_t offset_low;					/** @} */
+	/** Size of the request block, in bytes */
+	uint32_t request_size;
+	/** Size of the requested response block, in bytes. 0 for none */
+	uint32_t response_size;
+};
+
+/** A trace file mapped into memory. Shared read-only by all flows of the
+ * daemon replaying the same file */
+struct _trace {
+	/** Path of the trace file */
+	char *path;
+	/** Number of flows replaying this trace */
+	unsigned int refcount;
+	/** Mapping of the whole file */
+	void *map;
+	/** Length of the mapping */
+	size_t length;
+	/** First record of the trace */
+	const struct _trace_record *records;
+	/** Number of records of the trace */
+	uint64_t num_records;
+	/** Distinct pairs of request size (upper half) and response size
+	 * (lower half) of the records, built by the first flow sampling the
+	 * trace */
+	uint64_t *size_pairs;
+	/** Empirical distribution of the size pairs */
+	struct _alias_table *size_table;
+	/** Next mapped trace */
+	struct _trace *next;
+};
+
+/**
+ * Map the trace file @p path or reuse an existing mapping of it
+ *
+ * @param[in] path trace file
+ * @param[out] error static error description if the file is not a valid
+ * trace
+ * @return the shared trace, or NULL on error
+ */
+struct _trace *trace_open(const char *path, const char **error);
+
+/**
+ * Release a trace returned by trace_open(). The file is unmapped once the
+ * last flow released it
+ *
+ * @param[in] trace trace to release, may be NULL
+ */
+void trace_close(struct _trace *trace);
+
+/**
+ * Time offset of record @p i, in seconds since the start of the trace
+ */
+double trace_offset(const struct _trace *trace, uint64_t i);
+
+#endif /* _FG_TRACE_H_ */
@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -59,6 +60,7 @@
 #include "flowgrind.h"
 #include "common.h"
 #include "fg_error.h"
+#include "fg_payload.h"
 #include "fg_progname.h"
 #include "fg_time.h"
 #include "fg_stdlib.h"
@@ -84,6 +86,9 @@ static FILE *log_stream = NULL;
 /** Name of logfile */
 static char *log_filename = NULL;
 
+/** Measurement output, written by a dedicated thread */
+static struct _output output;
+
 /** SIGINT (CTRL-C) received? */
 static bool sigint_caught = false;
 
@@ -105,6 +110,39 @@ static struct _cflow cflow[MAX_FLOWS];
 /** Number of currently active flows */
 static int active_flows = 0;
 
+/** Completion times of all finished flows */
+static struct _fct_sample *fct_samples = NULL;
+
+/** Number of stored flow completion times */
+static unsigned int num_fct_samples = 0;
+
+/** Capacity of the flow completion time storage */
+static unsigned int max_fct_samples = 0;
+
+/** Completion times the daemons dropped instead of reporting them */
+static unsigned int num_fct_dropped = 0;
+
+/** Kernel RTT samples of the current ramp step, in milliseconds */
+static double *ramp_rtt_samples = NULL;
+
+/** Number of kernel RTT samples of the current ramp step */
+static unsigned int num_ramp_rtt_samples = 0;
+
+/** Capacity of ramp_rtt_samples */
+static unsigned int max_ramp_rtt_samples = 0;
+
+/** Accumulated retransmitted segments of the current ramp step */
+static double ramp_retr_sum = 0.0;
+
+/** Number of interval reports of the current ramp step */
+static unsigned int num_ramp_reports = 0;
+
+/** Results of the ramp steps (option --ramp) */
+static struct _ramp_step ramp_steps[RAMP_MAX_STEPS];
+
+/** Number of finished ramp steps */
+static unsigned int num_ramp_steps = 0;
+
 /* To cover a gcc bug (http://gcc.gnu.org/bugzilla/show_bug.cgi?id=36446) */
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
@@ -120,6 +158,12 @@ static struct _column column_info[] = {
 	 .header.unit = " [Mbit/s]", .state.visible = true},
 	{.type = COL_TRANSAC, .header.name = " transac",
 	 .header.unit = " [#/s]", .state.visible = true},
+	{.type = COL_PACING, .header.name = " pacing",
+	 .header.unit = " [%]", .state.visible = false},
+	{.type = COL_CPU, .header.name = " cpu",
+	 .header.unit = " [%]", .state.visible = false},
+	{.type = COL_CPB, .header.name = " cpb",
+	 .header.unit = " [#/B]", .state.visible = false},
 	{.type = COL_BLOCK_REQU, .header.name = " requ",
 	 .header.unit = " [#]", .state.visible = false},
 	{.type = COL_BLOCK_RESP, .header.name = " resp",
@@ -174,6 +218,18 @@ static struct _column column_info[] = {
 	 .header.unit = "[B]", .state.visible = true},
 	{.type = COL_PMTU, .header.name = " pmtu",
 	 .header.unit = "[B]", .state.visible = true},
+	{.type = COL_TCP_BUSY, .header.name = " busy",
+	 .header.unit = " [%]", .state.visible = false},
+	{.type = COL_TCP_LIMIT, .header.name = " limit",
+	 .header.unit = " ", .state.visible = false},
+	{.type = COL_TCP_DLVR, .header.name = " dlvr",
+	 .header.unit = " [Mbit/s]", .state.visible = false},
+	{.type = COL_TCP_PRATE, .header.name = " prate",
+	 .header.unit = " [Mbit/s]", .state.visible = false},
+	{.type = COL_TCP_MINRTT, .header.name = " minrtt",
+	 .header.unit = " [ms]", .state.visible = false},
+	{.type = COL_TCP_NOTSENT, .header.name = " notsent",
+	 .header.unit = " [B]", .state.visible = false},
 #ifdef DEBUG
 	{.type = COL_STATUS, .header.name = " status",
 	 .header.unit = " ", .state.visible = false}
@@ -193,7 +249,9 @@ static void fetch_reports(xmlrpc_client *);
 static void set_column_visibility(bool visibility, unsigned int nargs, ...);
 static void set_column_unit(const char *unit, unsigned int nargs, ...);
 static void report_flow(const struct _daemon* daemon, struct _report* report);
-static void print_report(int id, int endpoint, struct _report* report);
+static const char *format_report(const struct _queued_report *q);
+static void add_fct_sample(double size, double fct);
+static void add_ramp_sample(struct _report *report);
 
 /**
  * Print flowgrind usage and exit
@@ -225,14 +283,19 @@ static void usage(short status)
 		"                 Allowed values for TYPE are: 'interval', 'through', 'transac',\n"
 		"                 'iat', 'kernel' (all show per default), and 'blocks', 'rtt',\n"
 #ifdef DEBUG
-		"                 'delay', 'status' (optional)\n"
+		"                 'delay', 'pacing', 'cpu', 'limit', 'status' (optional)\n"
 #else
-		"                 'delay' (optional)\n"
+		"                 'delay', 'pacing', 'cpu', 'limit' (optional)\n"
 #endif /* DEBUG */
 #ifdef DEBUG
 		"  -d, --debug    increase debugging verbosity. Add option multiple times to\n"
 		"                 increase the verbosity\n"
 #endif /* DEBUG */
+		"      --daemon-stats\n"
+		"                 report how the daemons spent their time during the test:\n"
+		"                 event loop iterations and time, system calls, writes that\n"
+		"                 hit the send buffer limit, and blocks read whole versus\n"
+		"                 split across several receive calls\n"
 #ifdef HAVE_LIBPCAP
 		"  -e, --dump-prefix=PRE\n"
 		"                 prepend prefix PRE to dump filename (default: \"%2$s\")\n"
@@ -249,7 +312,18 @@ static void usage(short status)
 		"  -s, --tcp-stack=TYPE\n"
 		"                 don't determine unit of source TCP stacks automatically. Force\n"
 		"                 unit to TYPE, where TYPE is 'segment' or 'byte'\n"
-		"  -w             write output to logfile (same as --log-file)\n\n"
+		"  -w             write output to logfile (same as --log-file)\n"
+		"      --ramp=(linear|binary),#.#[,#]\n"
+		"                 run the test repeatedly and raise the rate of all flows given\n"
+		"                 by -R up to #.# times the given rate, in equidistant steps or\n"
+		"                 by binary search for the saturation point. Optional # is the\n"
+		"                 maximum number of steps (default: linear 10, binary 8)\n"
+		"      --ramp-limit=#.#[,#.#]\n"
+		"                 a ramp step is saturated if the 95th percentile of the kernel\n"
+		"                 RTT exceeds #.# ms (default: twice the RTT of the first step)\n"
+		"                 or the average number of retransmitted segments exceeds the\n"
+		"                 second value (default: not checked). Steps achieving less\n"
+		"                 than 90%% of their rate are always saturated\n\n"
 
 		"Flow options:\n"
 		"  Some of these options take the flow endpoint as argument, denoted by 'x' in\n"
@@ -263,16 +337,13 @@ static void usage(short status)
 		"  -B x=#         set requested sending buffer, in bytes\n"
 		"  -C x           stop flow if it is experiencing local congestion\n"
 		"  -D x=DSCP      DSCP value for TOS byte\n"
-		"  -E             enumerate bytes in payload instead of sending zeros\n"
+		"  -E             enumerate bytes in payload instead of sending zeros and\n"
+		"                 verify the payload of received blocks\n"
 		"  -F #[,#]...    flow options following this option apply only to the given flow \n"
 		"                 IDs. Useful in combination with -n to set specific options\n"
 		"                 for certain flows. Numbering starts with 0, so -F 1 refers\n"
 		"                 to the second flow\n"
-#ifdef HAVE_LIBGSL
 		"  -G x=(q|p|g),(C|U|E|N|L|P|W),#1,[#2]\n"
-#else
-		"  -G x=(q|p|g),(C|U),#1,[#2]\n"
-#endif /* HAVE_LIBGSL */
 		"                 activate stochastic traffic generation and set parameters\n"
 		"                 according to the used distribution. For additional information \n"
 		"                 see 'flowgrind --help=traffic'\n"
@@ -281,7 +352,8 @@ static void usage(short status)
 		"                 for the CONTROL connection to the same host.\n"
 		"                 An endpoint that isn't specified is assumed to be localhost\n"
 		"  -J #           use random seed # (default: read /dev/urandom)\n"
-		"  -I             enable one-way delay calculation (no clock synchronization)\n"
+		"  -I             enable one-way delay calculation, corrected by the estimated\n"
+		"                 clock offset between the daemons\n"
 		"  -L             call connect() on test socket immediately before starting to\n"
 		"                 send data (late connect). If not specified the test connection\n"
 		"                 is established in the preparation phase before the test starts\n"
@@ -305,8 +377,39 @@ static void usage(short status)
 		"                 truncates values if used with stochastic traffic generation\n"
 		"  -W x=#         set requested receiver buffer (advertised window), in bytes\n"
 		"  -Y x=#.#       set initial delay before the host starts to send, in seconds\n"
-/*		"  -Z x=#.#       set amount of data to be send, in bytes (instead of -t)\n"*/,
-		progname, copt.dump_prefix, MIN_BLOCK_SIZE);
+		"  -Z x=#.#[z|k|M|G][B|o]\n"
+		"                 stop flow after sending the given amount of data instead of\n"
+		"                 after a fixed duration, where: z = 2**0, k = 2**10, M = 2**20,\n"
+		"                 G = 2**30, B = bytes (default), o = blocks. An amount in\n"
+		"                 bytes must be at least one block header (%3$d bytes) and is\n"
+		"                 sent exactly, shortening the last two blocks if needed. A\n"
+		"                 following -T additionally limits the flow duration\n"
+		"      --pacing-burst=x=#\n"
+		"                 burst size of the rate pacer used with -R, in bytes (default:\n"
+		"                 one millisecond worth of the rate, at least one block)\n"
+		"      --kernel-pacing=x\n"
+		"                 let the kernel pace the rate given by -R (SO_MAX_PACING_RATE,\n"
+		"                 requires the fq qdisc on Linux) instead of the daemon\n"
+		"      --pipeline=x=#\n"
+		"                 keep at most # transactions awaiting their response block\n"
+		"                 (default: no limit, requires a response size, see -G p)\n"
+		"      --write-batch=x=#\n"
+		"                 write up to # request blocks that are due with a single\n"
+		"                 call (default: 1, max: %4$d)\n"
+		"      --trace=x=FILE[:(#.#|spread)][:loop]|FILE:sample\n"
+		"                 replay request sizes, response sizes and timing from the\n"
+		"                 binary trace FILE on the daemon host. Replay starts at the\n"
+		"                 given fraction of the trace (default: 0), 'spread' starts the\n"
+		"                 flows at equidistant positions. 'loop' repeats the trace.\n"
+		"                 'sample' draws the sizes of each block from all records and\n"
+		"                 takes the timing from -G g or -R instead\n"
+		"                 Block sizes are truncated to the application buffer size (-U)\n"
+		"      --payload=x=(zero|random|compress:#.#|file:FILE)\n"
+		"                 payload of the request blocks: zeros (default), random\n"
+		"                 (incompressible) data, random data compressible by the given\n"
+		"                 ratio, or the content of FILE on the daemon host. Can not be\n"
+		"                 combined with -E\n",
+		progname, copt.dump_prefix, MIN_BLOCK_SIZE, MAX_WRITE_BATCH);
 	exit(EXIT_SUCCESS);
 }
 
@@ -400,47 +503,51 @@ static void usage_trafgenopt(void)
 		"separate them by comma.\n\n"
 
 		"Stochastic traffic generation:\n"
-#ifdef HAVE_LIBGSL
-		"  -G x=(q|p|g),(C|U|E|N|L|P|W),#1,[#2]\n"
-#else
-		"  -G x=(q|p|g),(C|U),#1,[#2]\n"
-#endif /* HAVE_LIBGSL */
+		"  -G x=(q|p|g|a|f),(C|U|E|N|L|P|W),#1,[#2]\n"
 		"               Flow parameter:\n"
 		"                 q = request size (in bytes)\n"
 		"                 p = response size (in bytes)\n"
-		"                 g = request interpacket gap (in seconds)\n\n"
+		"                 g = request interpacket gap (in seconds)\n"
+		"                 a = flow inter-arrival time (in seconds, source only)\n"
+		"                 f = flow size (in bytes, source only)\n\n"
 
 		"               Distributions:\n"
 		"                 C = constant (#1: value, #2: not used)\n"
 		"                 U = uniform (#1: min, #2: max)\n"
-#ifdef HAVE_LIBGSL
 		"                 E = exponential (#1: lamba - lifetime, #2: not used)\n"
-		"                 N = normal (#1: mu - mean value, #2: sigma_square - variance)\n"
+		"                 N = normal (#1: mu - mean value, #2: sigma - std dev)\n"
 		"                 L = lognormal (#1: zeta - mean, #2: sigma - std dev)\n"
 		"                 P = pareto (#1: k - shape, #2 x_min - scale)\n"
 		"                 W = weibull (#1: lambda - scale, #2: k - shape)\n"
-#else
-		"               advanced distributions are only available if compiled with libgsl\n"
-#endif /* HAVE_LIBGSL */
 		"  -U #         specify a cap for the calculated values for request and response\n"
 		"               size (not needed for constant values or uniform distribution),\n"
-		"               values over this cap are recalculated\n\n"
+		"               request and response sizes are drawn from the distribution\n"
+		"               truncated to this cap\n\n"
 
 		"Examples:\n"
 		"  -G s=q,C,40\n"
 		"               use contant request size of 40 bytes\n"
 		"  -G s=p,N,2000,50\n"
 		"               use normal distributed response size with mean 2000 bytes and\n"
-		"               variance 50\n"
+		"               standard deviation 50\n"
 		"  -G s=g,U,0.005,0.01\n"
 		"               use uniform distributed interpacket gap with minimum 0.005s and\n"
-		"               maximum 0.01s\n\n"
+		"               maximum 0.01s\n"
+		"  -G s=a,E,0.01 -G s=f,P,1.2,10000\n"
+		"               spawn new flows during the test with exponential distributed\n"
+		"               inter-arrival time (mean 10ms) and pareto distributed size\n"
+		"               (shape 1.2, minimum 10000 bytes). Each spawned flow ends after\n"
+		"               its size is transferred, the final report shows the flow\n"
+		"               completion times per flow size\n\n"
 
 		"Notes: \n"
 		"  - The man page contains more explained examples\n"
 		"  - Using bidirectional traffic generation can lead to unexpected results\n"
 		"  - Usage of -G in conjunction with -A, -R, -S is not recommended, as they\n"
-		"    overwrite each other. -A, -R and -S exist as shortcut only\n",
+		"    overwrite each other. -A, -R and -S exist as shortcut only\n"
+		"  - Flow arrival (a) and flow size (f) need to be given together. The\n"
+		"    number of simultaneously spawned flows is only limited by the\n"
+		"    capacity of the daemons\n",
 		progname);
 	exit(EXIT_SUCCESS);
 }
@@ -476,6 +583,12 @@ static void init_controller_options(void)
 	copt.mbyte = false;
 	copt.symbolic = true;
 	copt.force_unit = INT_MAX;
+	copt.ramp_mode = RAMP_NONE;
+	copt.ramp_max = 0.0;
+	copt.ramp_steps = 0;
+	copt.ramp_rtt_limit = 0.0;
+	copt.ramp_retr_limit = -1.0;
+	copt.daemon_stats = false;
 }
 
 static void init_flow_options(void)
@@ -525,6 +638,8 @@ static void init_flow_options(void)
 		cflow[id].finished[1] = 0;
 		cflow[id].final_report[0] = NULL;
 		cflow[id].final_report[1] = NULL;
+		cflow[id].ramp_base_rate[0] = 0;
+		cflow[id].ramp_base_rate[1] = 0;
 
 		cflow[id].summarize_only = 0;
 		cflow[id].late_connect = 0;
@@ -584,18 +699,173 @@ static void close_logfile(void)
 	free(log_filename);
 }
 
-inline static void log_output(const char *msg)
+static void write_output(const char *buf, size_t len)
 {
 	if (copt.log_to_stdout) {
-		printf("%s", msg);
+		fwrite(buf, 1, len, stdout);
 		fflush(stdout);
 	}
 	if (copt.log_to_file) {
-		fprintf(log_stream, "%s", msg);
+		fwrite(buf, 1, len, log_stream);
 		fflush(log_stream);
 	}
 }
 
+/* Append msg to the output collected in buf, write out buf first if msg
+ * does not fit anymore */
+static void collect_output(char *buf, size_t *len, const char *msg)
+{
+	size_t n = strlen(msg);
+
+	if (*len + n > OUTPUT_BUFFER_SIZE) {
+		write_output(buf, *len);
+		*len = 0;
+	}
+	if (n > OUTPUT_BUFFER_SIZE) {
+		write_output(msg, n);
+		return;
+	}
+	memcpy(buf + *len, msg, n);
+	*len += n;
+}
+
+/* Format the queued reports and write them out together with the queued
+ * text. All items queued meanwhile are written with a single call */
+static void *output_thread(void *arg)
+{
+	static char buf[OUTPUT_BUFFER_SIZE];
+	struct _output_item *item, *next;
+	size_t len = 0;
+
+	UNUSED_ARGUMENT(arg);
+
+	pthread_mutex_lock(&output.mutex);
+	for (;;) {
+		while (!output.head && !output.stop)
+			pthread_cond_wait(&output.cond, &output.mutex);
+		if (!output.head)
+			break;
+
+		/* take over the whole queue */
+		item = output.head;
+		output.head = output.tail = NULL;
+		output.queued = 0;
+		pthread_cond_broadcast(&output.cond);
+		pthread_mutex_unlock(&output.mutex);
+
+		for (; item; item = next) {
+			next = item->next;
+			collect_output(buf, &len, item->text ? item->text :
+				       format_report(&item->report));
+			free(item->text);
+			free(item);
+		}
+		write_output(buf, len);
+		len = 0;
+
+		pthread_mutex_lock(&output.mutex);
+	}
+	pthread_mutex_unlock(&output.mutex);
+
+	return NULL;
+}
+
+/* Write out all pending output and stop the output thread */
+static void stop_output_thread(void)
+{
+	if (!output.running)
+		return;
+
+	pthread_mutex_lock(&output.mutex);
+	output.stop = true;
+	pthread_cond_broadcast(&output.cond);
+	pthread_mutex_unlock(&output.mutex);
+
+	pthread_join(output.thread, NULL);
+	output.running = false;
+}
+
+/* Formatting the reports and writing them out is decoupled from polling
+ * the daemons, so that neither delays the reports */
+static void start_output_thread(void)
+{
+	pthread_mutex_init(&output.mutex, NULL);
+	pthread_cond_init(&output.cond, NULL);
+
+	if (pthread_create(&output.thread, NULL, output_thread, NULL)) {
+		warnx("could not start output thread, writing synchronously");
+		return;
+	}
+	output.running = true;
+
+	/* output pending on exit() is written out, too */
+	atexit(stop_output_thread);
+}
+
+/* Append an item to the output queue. Blocks while the queue is full */
+static void queue_output(struct _output_item *item)
+{
+	item->next = NULL;
+
+	pthread_mutex_lock(&output.mutex);
+	while (output.queued == OUTPUT_QUEUE_SIZE)
+		pthread_cond_wait(&output.cond, &output.mutex);
+
+	if (output.tail)
+		output.tail->next = item;
+	else
+		output.head = item;
+	output.tail = item;
+	/* the thread only waits while the queue is empty */
+	if (!output.queued++)
+		pthread_cond_broadcast(&output.cond);
+	pthread_mutex_unlock(&output.mutex);
+}
+
+static void log_output(const char *msg)
+{
+	struct _output_item *item;
+
+	if (!output.running) {
+		write_output(msg, strlen(msg));
+		return;
+	}
+
+	item = malloc(sizeof(struct _output_item));
+	if (!item || !(item->text = strdup(msg)))
+		critx("could not allocate memory for the output");
+	queue_output(item);
+}
+
+/* Hand an interval report to the output thread, together with the values
+ * of its flow as of now */
+static void print_report(int id, int endpoint, const struct _report *report)
+{
+	struct _output_item *item;
+	struct _queued_report *r;
+
+	item = malloc(sizeof(struct _output_item));
+	if (!item)
+		critx("could not allocate memory for the output");
+	item->text = NULL;
+	r = &item->report;
+	r->id = id;
+	r->endpoint = endpoint;
+	r->start = cflow[id].start_timestamp[endpoint];
+	r->write_rate = cflow[id].settings[endpoint].write_rate;
+	r->finished = cflow[id].finished[endpoint];
+	r->report = *report;
+
+	if (output.running) {
+		queue_output(item);
+	} else {
+		const char *line = format_report(r);
+
+		write_output(line, strlen(line));
+		free(item);
+	}
+}
+
 inline static void die_if_fault_occurred(xmlrpc_env *env)
 {
     if (env->fault_occurred)
@@ -758,7 +1028,9 @@ static void prepare_grinding(xmlrpc_client *rpc_client)
 	if (!has_linux)
 		HIDE_COLUMNS(COL_TCP_UACK, COL_TCP_SACK, COL_TCP_RETR,
 			     COL_TCP_TRET, COL_TCP_FACK, COL_TCP_REOR,
-			     COL_TCP_BKOF, COL_TCP_CA_STATE);
+			     COL_TCP_BKOF, COL_TCP_CA_STATE, COL_TCP_BUSY,
+			     COL_TCP_LIMIT, COL_TCP_DLVR, COL_TCP_PRATE,
+			     COL_TCP_MINRTT, COL_TCP_NOTSENT);
 	if (!has_freebsd)
 		HIDE_COLUMNS(COL_TCP_CWND, COL_TCP_SSTH, COL_TCP_RTT,
 			     COL_TCP_RTTVAR, COL_TCP_RTO, COL_SMSS);
@@ -801,13 +1073,21 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"("
 		"{s:s}"
 		"{s:d,s:d,s:d,s:d,s:d}"
+		"{s:i,s:i,s:i}"
 		"{s:i,s:i}"
 		"{s:i}"
 		"{s:b,s:b,s:b,s:b,s:b}"
 		"{s:i,s:i}"
+		"{s:i,s:i}" /* pacing */
+		"{s:i}" /* pipeline */
+		"{s:i}" /* write batch */
 		"{s:i,s:d,s:d}" /* request */
 		"{s:i,s:d,s:d}" /* response */
 		"{s:i,s:d,s:d}" /* interpacket_gap */
+		"{s:i,s:d,s:d}" /* flow_arrival */
+		"{s:i,s:d,s:d}" /* flow_size */
+		"{s:s,s:d,s:i,s:i}" /* trace */
+		"{s:i,s:d,s:s}" /* payload */
 		"{s:b,s:b,s:i,s:i}"
 		"{s:s}"
 		"{s:i,s:i,s:i,s:i,s:i}"
@@ -826,6 +1106,10 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"read_duration", cflow[id].settings[SOURCE].duration[WRITE],
 		"reporting_interval", cflow[id].summarize_only ? 0 : copt.reporting_interval,
 
+		"write_bytes_high", (int32_t)(cflow[id].settings[DESTINATION].write_bytes >> 32),
+		"write_bytes_low", (int32_t)(cflow[id].settings[DESTINATION].write_bytes & 0xFFFFFFFF),
+		"write_blocks", (int)cflow[id].settings[DESTINATION].write_blocks,
+
 		"requested_send_buffer_size", cflow[id].settings[DESTINATION].requested_send_buffer_size,
 		"requested_read_buffer_size", cflow[id].settings[DESTINATION].requested_read_buffer_size,
 
@@ -840,6 +1124,12 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"write_rate", cflow[id].settings[DESTINATION].write_rate,
 		"random_seed",cflow[id].random_seed,
 
+		"pacing_burst", cflow[id].settings[DESTINATION].pacing_burst,
+		"kernel_pacing", cflow[id].settings[DESTINATION].kernel_pacing,
+
+		"pipeline_depth", cflow[id].settings[DESTINATION].pipeline_depth,
+		"write_batch", cflow[id].settings[DESTINATION].write_batch,
+
 		"traffic_generation_request_distribution", cflow[id].settings[DESTINATION].request_trafgen_options.distribution,
 		"traffic_generation_request_param_one", cflow[id].settings[DESTINATION].request_trafgen_options.param_one,
 		"traffic_generation_request_param_two", cflow[id].settings[DESTINATION].request_trafgen_options.param_two,
@@ -852,6 +1142,23 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"traffic_generation_gap_param_one", cflow[id].settings[DESTINATION].interpacket_gap_trafgen_options.param_one,
 		"traffic_generation_gap_param_two", cflow[id].settings[DESTINATION].interpacket_gap_trafgen_options.param_two,
 
+		"traffic_generation_flow_arrival_distribution", cflow[id].settings[SOURCE].flow_arrival_trafgen_options.distribution,
+		"traffic_generation_flow_arrival_param_one", cflow[id].settings[SOURCE].flow_arrival_trafgen_options.param_one,
+		"traffic_generation_flow_arrival_param_two", cflow[id].settings[SOURCE].flow_arrival_trafgen_options.param_two,
+
+		"traffic_generation_flow_size_distribution", cflow[id].settings[SOURCE].flow_size_trafgen_options.distribution,
+		"traffic_generation_flow_size_param_one", cflow[id].settings[SOURCE].flow_size_trafgen_options.param_one,
+		"traffic_generation_flow_size_param_two", cflow[id].settings[SOURCE].flow_size_trafgen_options.param_two,
+
+		"trace_file", cflow[id].settings[DESTINATION].trace_file,
+		"trace_start", cflow[id].settings[DESTINATION].trace_start,
+		"trace_loop", cflow[id].settings[DESTINATION].trace_loop,
+		"trace_sample", cflow[id].settings[DESTINATION].trace_sample,
+
+		"payload", cflow[id].settings[DESTINATION].payload,
+		"payload_ratio", cflow[id].settings[DESTINATION].payload_ratio,
+		"payload_file", cflow[id].settings[DESTINATION].payload_file,
+
 	"flow_control", cflow[id].settings[DESTINATION].flow_control,
 		"byte_counting", cflow[id].byte_counting,
 		"cork", (int)cflow[id].settings[DESTINATION].cork,
@@ -907,13 +1214,21 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"("
 		"{s:s}"
 		"{s:d,s:d,s:d,s:d,s:d}"
+		"{s:i,s:i,s:i}"
 		"{s:i,s:i}"
 		"{s:i}"
 		"{s:b,s:b,s:b,s:b,s:b}"
 		"{s:i,s:i}"
+		"{s:i,s:i}" /* pacing */
+		"{s:i}" /* pipeline */
+		"{s:i}" /* write batch */
 		"{s:i,s:d,s:d}" /* request */
 		"{s:i,s:d,s:d}" /* response */
 		"{s:i,s:d,s:d}" /* interpacket_gap */
+		"{s:i,s:d,s:d}" /* flow_arrival */
+		"{s:i,s:d,s:d}" /* flow_size */
+		"{s:s,s:d,s:i,s:i}" /* trace */
+		"{s:i,s:d,s:s}" /* payload */
 		"{s:b,s:b,s:i,s:i}"
 		"{s:s}"
 		"{s:i,s:i,s:i,s:i,s:i}"
@@ -933,6 +1248,10 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"read_duration", cflow[id].settings[DESTINATION].duration[WRITE],
 		"reporting_interval", cflow[id].summarize_only ? 0 : copt.reporting_interval,
 
+		"write_bytes_high", (int32_t)(cflow[id].settings[SOURCE].write_bytes >> 32),
+		"write_bytes_low", (int32_t)(cflow[id].settings[SOURCE].write_bytes & 0xFFFFFFFF),
+		"write_blocks", (int)cflow[id].settings[SOURCE].write_blocks,
+
 		"requested_send_buffer_size", cflow[id].settings[SOURCE].requested_send_buffer_size,
 		"requested_read_buffer_size", cflow[id].settings[SOURCE].requested_read_buffer_size,
 
@@ -947,6 +1266,12 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"write_rate", cflow[id].settings[SOURCE].write_rate,
 		"random_seed",cflow[id].random_seed,
 
+		"pacing_burst", cflow[id].settings[SOURCE].pacing_burst,
+		"kernel_pacing", cflow[id].settings[SOURCE].kernel_pacing,
+
+		"pipeline_depth", cflow[id].settings[SOURCE].pipeline_depth,
+		"write_batch", cflow[id].settings[SOURCE].write_batch,
+
 		"traffic_generation_request_distribution", cflow[id].settings[SOURCE].request_trafgen_options.distribution,
 		"traffic_generation_request_param_one", cflow[id].settings[SOURCE].request_trafgen_options.param_one,
 		"traffic_generation_request_param_two", cflow[id].settings[SOURCE].request_trafgen_options.param_two,
@@ -959,6 +1284,23 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"traffic_generation_gap_param_one", cflow[id].settings[SOURCE].interpacket_gap_trafgen_options.param_one,
 		"traffic_generation_gap_param_two", cflow[id].settings[SOURCE].interpacket_gap_trafgen_options.param_two,
 
+		"traffic_generation_flow_arrival_distribution", cflow[id].settings[SOURCE].flow_arrival_trafgen_options.distribution,
+		"traffic_generation_flow_arrival_param_one", cflow[id].settings[SOURCE].flow_arrival_trafgen_options.param_one,
+		"traffic_generation_flow_arrival_param_two", cflow[id].settings[SOURCE].flow_arrival_trafgen_options.param_two,
+
+		"traffic_generation_flow_size_distribution", cflow[id].settings[SOURCE].flow_size_trafgen_options.distribution,
+		"traffic_generation_flow_size_param_one", cflow[id].settings[SOURCE].flow_size_trafgen_options.param_one,
+		"traffic_generation_flow_size_param_two", cflow[id].settings[SOURCE].flow_size_trafgen_options.param_two,
+
+		"trace_file", cflow[id].settings[SOURCE].trace_file,
+		"trace_start", cflow[id].settings[SOURCE].trace_start,
+		"trace_loop", cflow[id].settings[SOURCE].trace_loop,
+		"trace_sample", cflow[id].settings[SOURCE].trace_sample,
+
+		"payload", cflow[id].settings[SOURCE].payload,
+		"payload_ratio", cflow[id].settings[SOURCE].payload_ratio,
+		"payload_file", cflow[id].settings[SOURCE].payload_file,
+
 
 		"flow_control", cflow[id].settings[SOURCE].flow_control,
 		"byte_counting", cflow[id].byte_counting,
@@ -998,6 +1340,217 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 }
 
 /* start flows */
+/* Estimates the offset of the clock of each daemon to our clock. Each daemon
+ * is asked CLOCK_PROBES times for its time. For the request with the
+ * shortest round-trip time the daemon's time is assumed to be taken in the
+ * middle of the request, hence the error is at most half the RTT */
+static void estimate_clock_offsets(xmlrpc_client *rpc_client,
+				   enum clock_sync sync)
+{
+	xmlrpc_value * resultP = 0;
+
+	for (unsigned int j = 0; j < num_unique_servers; j++) {
+		struct _daemon *daemon = &unique_servers[j];
+		double min_rtt = INFINITY;
+
+		daemon->clock_sync[sync].tv_sec = 0;
+		daemon->clock_sync[sync].tv_nsec = 0;
+
+		for (int i = 0; i < CLOCK_PROBES && !sigint_caught; i++) {
+			struct timespec sent, received, remote;
+			int sec, nsec;
+			double rtt;
+
+			gettime(&sent);
+			xmlrpc_client_call2f(&rpc_env, rpc_client,
+					     daemon->server_url, "get_time",
+					     &resultP, "()");
+			gettime(&received);
+
+			/* daemon does not support the method */
+			if (rpc_env.fault_occurred) {
+				DEBUG_MSG(LOG_WARNING, "unable to get time of "
+					  "node %s: %s", daemon->server_url,
+					  rpc_env.fault_string);
+				xmlrpc_env_clean(&rpc_env);
+				xmlrpc_env_init(&rpc_env);
+				break;
+			}
+
+			xmlrpc_decompose_value(&rpc_env, resultP, "{s:i,s:i,*}",
+					       "sec", &sec, "nsec", &nsec);
+			die_if_fault_occurred(&rpc_env);
+			xmlrpc_DECREF(resultP);
+
+			rtt = time_diff(&sent, &received);
+			if (rtt >= min_rtt)
+				continue;
+			min_rtt = rtt;
+
+			remote.tv_sec = sec;
+			remote.tv_nsec = nsec;
+			time_add(&sent, rtt / 2);
+			daemon->clock_offset[sync] = time_diff(&sent, &remote);
+			daemon->clock_error[sync] = rtt / 2;
+			daemon->clock_sync[sync] = sent;
+		}
+
+		DEBUG_MSG(LOG_WARNING, "clock offset of node %s is %.6fs "
+			  "(error %.6fs)", daemon->server_url,
+			  daemon->clock_offset[sync], daemon->clock_error[sync]);
+	}
+}
+
+/* Clock offset of the daemon at the given point in time of our clock. The
+ * drift between the estimates at start and end of the test is
+ * interpolated. Returns false if the offset is unknown */
+static bool daemon_clock_offset(const struct _daemon *daemon,
+				const struct timespec *at, double *offset,
+				double *error)
+{
+	const struct timespec *start = &daemon->clock_sync[SYNC_START];
+	const struct timespec *end = &daemon->clock_sync[SYNC_END];
+
+	if (!start->tv_sec)
+		return false;
+
+	*offset = daemon->clock_offset[SYNC_START];
+	*error = daemon->clock_error[SYNC_START];
+
+	if (end->tv_sec && time_diff(start, end) > 0) {
+		*offset += (daemon->clock_offset[SYNC_END] - *offset) *
+			   time_diff(start, at) / time_diff(start, end);
+		ASSIGN_MAX(*error, daemon->clock_error[SYNC_END]);
+	}
+
+	return true;
+}
+
+/* Offset of the receiver's clock to the sender's clock for one-way delays
+ * measured by the given endpoint of the flow */
+static bool flow_clock_offset(int id, int endpoint, const struct timespec *at,
+			      double *offset, double *error)
+{
+	const struct _daemon *receiver = cflow[id].endpoint[endpoint].daemon;
+	const struct _daemon *sender = cflow[id].endpoint[1 - endpoint].daemon;
+	double sender_offset, sender_error;
+
+	/* same host, same clock */
+	if (receiver == sender) {
+		*offset = *error = 0.0;
+		return true;
+	}
+
+	if (!daemon_clock_offset(receiver, at, offset, error) ||
+	    !daemon_clock_offset(sender, at, &sender_offset, &sender_error))
+		return false;
+
+	*offset -= sender_offset;
+	*error += sender_error;
+	return true;
+}
+
+/* Corrects the one-way delays of a report by the clock offset between the
+ * daemons at the given point in time of our clock */
+static void correct_delay(int id, int endpoint, struct _report *report,
+			  const struct timespec *at)
+{
+	double offset, error;
+
+	if (!report->request_blocks_read ||
+	    !flow_clock_offset(id, endpoint, at, &offset, &error))
+		return;
+
+	report->delay_min -= offset;
+	report->delay_max -= offset;
+	report->delay_sum -= offset * report->request_blocks_read;
+}
+
+/* Fetch the event loop counters of the daemon. Returns false if the daemon
+ * does not support them */
+static bool fetch_daemon_stats(xmlrpc_client *rpc_client,
+			       const struct _daemon *daemon,
+			       struct _daemon_stats *stats)
+{
+	xmlrpc_value * resultP = 0;
+	double loop_iterations, syscalls, write_eagain;
+	double whole_blocks, split_blocks;
+
+	xmlrpc_client_call2f(&rpc_env, rpc_client, daemon->server_url,
+			     "get_daemon_stats", &resultP, "()");
+	if (rpc_env.fault_occurred) {
+		warnx("node %s does not provide daemon statistics: %s",
+		      daemon->server_url, rpc_env.fault_string);
+		xmlrpc_env_clean(&rpc_env);
+		xmlrpc_env_init(&rpc_env);
+		return false;
+	}
+
+	xmlrpc_decompose_value(&rpc_env, resultP,
+			       "{s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,*}",
+			       "loop_iterations", &loop_iterations,
+			       "select_time", &stats->select_time,
+			       "prepare_time", &stats->prepare_time,
+			       "timer_time", &stats->timer_time,
+			       "process_time", &stats->process_time,
+			       "syscalls", &syscalls,
+			       "write_eagain", &write_eagain,
+			       "whole_blocks", &whole_blocks,
+			       "split_blocks", &split_blocks);
+	die_if_fault_occurred(&rpc_env);
+	xmlrpc_DECREF(resultP);
+
+	stats->loop_iterations = loop_iterations;
+	stats->syscalls = syscalls;
+	stats->write_eagain = write_eagain;
+	stats->whole_blocks = whole_blocks;
+	stats->split_blocks = split_blocks;
+
+	return true;
+}
+
+/* Print how the daemons spent their time since the flows started (option
+ * --daemon-stats) */
+static void report_daemon_stats(xmlrpc_client *rpc_client)
+{
+	char buffer[1000];
+
+	log_output("\n# daemon statistics\n");
+
+	for (unsigned int j = 0; j < num_unique_servers; j++) {
+		const struct _daemon *daemon = &unique_servers[j];
+		const struct _daemon_stats *begin = &daemon->stats;
+		struct _daemon_stats end;
+
+		if (!daemon->has_stats ||
+		    !fetch_daemon_stats(rpc_client, daemon, &end))
+			continue;
+
+		unsigned long long iterations =
+			end.loop_iterations - begin->loop_iterations;
+		unsigned long long syscalls = end.syscalls - begin->syscalls;
+		double prepare = end.prepare_time - begin->prepare_time;
+		double timer = end.timer_time - begin->timer_time;
+		double process = end.process_time - begin->process_time;
+		double blocked = end.select_time - begin->select_time;
+		double total = prepare + timer + process + blocked;
+
+		snprintf(buffer, sizeof(buffer), "# %s: %llu loop iterations, "
+			 "%.1f%% busy (prepare %.3fs, timers %.3fs, process "
+			 "%.3fs, select %.3fs), %llu syscalls (%.1f per "
+			 "iteration), %llu writes hit send buffer limit, "
+			 "%llu/%llu whole/split blocks read\n",
+			 daemon->server_name, iterations,
+			 total > 0 ? 100 * (total - blocked) / total : 0.0,
+			 prepare, timer, process, blocked, syscalls,
+			 iterations ? (double)syscalls / iterations : 0.0,
+			 end.write_eagain - begin->write_eagain,
+			 end.whole_blocks - begin->whole_blocks,
+			 end.split_blocks - begin->split_blocks);
+		log_output(buffer);
+	}
+}
+
 static void grind_flows(xmlrpc_client *rpc_client)
 {
 	xmlrpc_value * resultP = 0;
@@ -1005,20 +1558,54 @@ static void grind_flows(xmlrpc_client *rpc_client)
 	struct timespec lastreport_end;
 	struct timespec lastreport_begin;
 	struct timespec now;
+	struct timespec start;
+
+	/* the drift is estimated at the end of the test */
+	for (unsigned int j = 0; j < num_unique_servers; j++)
+		unique_servers[j].clock_sync[SYNC_END].tv_sec = 0;
+	estimate_clock_offsets(rpc_client, SYNC_START);
+
+	if (copt.daemon_stats)
+		for (unsigned int j = 0; j < num_unique_servers; j++)
+			unique_servers[j].has_stats =
+				fetch_daemon_stats(rpc_client,
+						   &unique_servers[j],
+						   &unique_servers[j].stats);
+
+	/* All flows start at a common point in time, late enough for the
+	 * start command to reach every daemon. Allow for a few round trips
+	 * per daemon */
+	double lead = START_LEAD;
+	for (unsigned int j = 0; j < num_unique_servers; j++)
+		if (unique_servers[j].clock_sync[SYNC_START].tv_sec)
+			lead += 8 * unique_servers[j].clock_error[SYNC_START];
+
+	gettime(&now);
+	start = now;
+	time_add(&start, lead);
 
 	gettime(&lastreport_end);
 	gettime(&lastreport_begin);
-	gettime(&now);
 
 	for (unsigned int j = 0; j < num_unique_servers; j++) {
+		struct timespec remote_start = start;
+
 		if (sigint_caught)
 			return;
 
+		/* common start in the clock of the daemon. Without estimate
+		 * the clocks are assumed to be synchronized */
+		if (unique_servers[j].clock_sync[SYNC_START].tv_sec)
+			time_add(&remote_start,
+				 unique_servers[j].clock_offset[SYNC_START]);
+
 		DEBUG_MSG(LOG_ERR, "starting flow on server %d", j);
 		xmlrpc_client_call2f(&rpc_env, rpc_client,
 				     unique_servers[j].server_url,
-				     "start_flows", &resultP, "({s:i})",
-				     "start_timestamp", now.tv_sec + 2);
+				     "start_flows", &resultP, "({s:i,s:i})",
+				     "start_timestamp", (int)remote_start.tv_sec,
+				     "start_timestamp_nsec",
+				     (int)remote_start.tv_nsec);
 		die_if_fault_occurred(&rpc_env);
 		if (resultP)
 			xmlrpc_DECREF(resultP);
@@ -1037,8 +1624,10 @@ static void grind_flows(xmlrpc_client *rpc_client)
 
 		/* All flows have ended */
 		if (active_flows < 1)
-			return;
+			break;
 	}
+
+	estimate_clock_offsets(rpc_client, SYNC_END);
 }
 
 /* Poll the daemons for reports */
@@ -1086,6 +1675,7 @@ has_more_reports:
 			if (rv) {
 				struct _report report;
 				int begin_sec, begin_nsec, end_sec, end_nsec;
+				int completion_sec, completion_nsec;
 				int tcpi_snd_cwnd;
 				int tcpi_snd_ssthresh;
 				int tcpi_unacked;
@@ -1103,6 +1693,9 @@ has_more_reports:
 				int tcpi_snd_mss;
 				int bytes_read_low, bytes_read_high;
 				int bytes_written_low, bytes_written_high;
+				int corruption_offset_low, corruption_offset_high;
+				int tcpi_bytes_acked_low, tcpi_bytes_acked_high;
+				double tcpi_pacing_rate, tcpi_delivery_rate;
 
 				xmlrpc_decompose_value(&rpc_env, rv,
 					"("
@@ -1114,6 +1707,16 @@ has_more_reports:
 					"{s:i,s:i,s:i,s:i,s:i,*}" /* TCP info */
 					"{s:i,s:i,s:i,s:i,s:i,*}" /* ...      */
 					"{s:i,s:i,s:i,s:i,s:i,*}" /* ...      */
+					"{s:i,s:d,s:d,s:d,s:i,*}" /* extended TCP info */
+					"{s:d,s:d,s:i,s:i,s:i,*}" /* ...               */
+					"{s:i,s:i,*}" /* completion */
+					"{s:d,*}" /* start skew */
+					"{s:d,s:d,s:d,s:d,s:d,*}" /* CPU */
+					"{s:i,s:d,s:d,*}" /* response queue */
+					"{s:i,s:i,*}" /* transactions */
+					"{s:i,*}" /* write calls */
+					"{s:i,s:i,s:i,*}" /* corruption */
+					"{s:i,*}" /* dropped completions */
 					"{s:i,*}"
 					")",
 
@@ -1165,15 +1768,57 @@ has_more_reports:
 					"tcpi_ca_state", &tcpi_ca_state,
 					"tcpi_snd_mss", &tcpi_snd_mss,
 
+					"tcpi_available", &report.tcp_info.tcpi_available,
+					"busy_time", &report.busy_time,
+					"rwnd_limited", &report.rwnd_limited,
+					"sndbuf_limited", &report.sndbuf_limited,
+					"tcpi_min_rtt", &report.tcp_info.tcpi_min_rtt,
+
+					"tcpi_pacing_rate", &tcpi_pacing_rate,
+					"tcpi_delivery_rate", &tcpi_delivery_rate,
+					"tcpi_bytes_acked_high", &tcpi_bytes_acked_high,
+					"tcpi_bytes_acked_low", &tcpi_bytes_acked_low,
+					"tcpi_notsent_bytes", &report.tcp_info.tcpi_notsent_bytes,
+
+					"completion_tv_sec", &completion_sec,
+					"completion_tv_nsec", &completion_nsec,
+
+					"start_skew", &report.start_skew,
+
+					"cpu_flow", &report.cpu_flow,
+					"cpu_user", &report.cpu_user,
+					"cpu_system", &report.cpu_system,
+					"cpu_softirq", &report.cpu_softirq,
+					"cpu_hz", &report.cpu_hz,
+
+					"response_queue_max", &report.response_queue_max,
+					"response_delay_max", &report.response_delay_max,
+					"response_delay_sum", &report.response_delay_sum,
+
+					"outstanding_max", &report.outstanding_max,
+					"transactions_lost", &report.transactions_lost,
+
+					"write_calls", &report.write_calls,
+
+					"corrupted_blocks", &report.corrupted_blocks,
+					"corruption_offset_high", &corruption_offset_high,
+					"corruption_offset_low", &corruption_offset_low,
+
+					"dropped_completions", &report.dropped_completions,
+
 					"status", &report.status
 				);
 				xmlrpc_DECREF(rv);
 #ifdef HAVE_UNSIGNED_LONG_LONG_INT
 				report.bytes_read = ((long long)bytes_read_high << 32) + (uint32_t)bytes_read_low;
 				report.bytes_written = ((long long)bytes_written_high << 32) + (uint32_t)bytes_written_low;
+				report.corruption_offset = ((long long)corruption_offset_high << 32) + (uint32_t)corruption_offset_low;
+				report.tcp_info.tcpi_bytes_acked = ((long long)tcpi_bytes_acked_high << 32) + (uint32_t)tcpi_bytes_acked_low;
 #else
 				report.bytes_read = (uint32_t)bytes_read_low;
 				report.bytes_written = (uint32_t)bytes_written_low;
+				report.corruption_offset = (uint32_t)corruption_offset_low;
+				report.tcp_info.tcpi_bytes_acked = (uint32_t)tcpi_bytes_acked_low;
 #endif /* HAVE_UNSIGNED_LONG_LONG_INT */
 
 				/* FIXME Kernel metrics (tcp_info). Other OS than
@@ -1196,11 +1841,18 @@ has_more_reports:
 				report.tcp_info.tcpi_backoff = tcpi_backoff;
 				report.tcp_info.tcpi_ca_state = tcpi_ca_state;
 				report.tcp_info.tcpi_snd_mss = tcpi_snd_mss;
+				/* ~0 is an unlimited pacing rate */
+				report.tcp_info.tcpi_pacing_rate =
+					tcpi_pacing_rate < (double)ULLONG_MAX ?
+					tcpi_pacing_rate : ULLONG_MAX;
+				report.tcp_info.tcpi_delivery_rate = tcpi_delivery_rate;
 
 				report.begin.tv_sec = begin_sec;
 				report.begin.tv_nsec = begin_nsec;
 				report.end.tv_sec = end_sec;
 				report.end.tv_nsec = end_nsec;
+				report.completion.tv_sec = completion_sec;
+				report.completion.tv_nsec = completion_nsec;
 
 				report_flow(&unique_servers[j], &report);
 			}
@@ -1220,6 +1872,7 @@ static void report_flow(const struct _daemon* daemon, struct _report* report)
 	int endpoint;
 	int id;
 	struct _cflow *f = NULL;
+	struct timespec now;
 
 	/* Get matching flow for report */
 	/* TODO Maybe just use compare daemon pointers? */
@@ -1234,11 +1887,24 @@ static void report_flow(const struct _daemon* daemon, struct _report* report)
 	}
 exit_outer_loop:
 
+	/* Completion of a flow spawned by the dynamic flow arrival process */
+	if (report->type == COMPLETION) {
+		add_fct_sample(report->bytes_written,
+			       time_diff(&report->begin, &report->completion));
+		return;
+	}
+
 	if (f->start_timestamp[endpoint].tv_sec == 0)
 		f->start_timestamp[endpoint] = report->begin;
 
+	/* Interval reports of rate limited flows rate a ramp step */
+	if (copt.ramp_mode && report->type == INTERVAL &&
+	    f->settings[endpoint].write_rate)
+		add_ramp_sample(report);
+
 	if (report->type == FINAL) {
 		DEBUG_MSG(LOG_DEBUG, "received final report for flow %d", id);
+		num_fct_dropped += report->dropped_completions;
 		/* Final report, keep it for later */
 		free(f->final_report[endpoint]);
 		f->final_report[endpoint] = malloc(sizeof(struct _report));
@@ -1257,6 +1923,8 @@ exit_outer_loop:
 		}
 		return;
 	}
+	gettime(&now);
+	correct_delay(id, endpoint, report, &now);
 	print_report(id, endpoint, report);
 }
 
@@ -1349,41 +2017,94 @@ static void set_column_unit(const char *unit, unsigned int nargs, ...)
         va_end(ap);
 }
 
-/* New output determines the number of digits before the comma */
-static int det_column_size(double value)
+/* New output determines the number of digits before the comma. The range
+ * of values with the same number of digits is kept, so that the digits are
+ * only counted again if a value leaves it */
+static int det_column_size(struct _column_state *state, double value)
 {
 	int i = 1;
 	double dez = 10.0;
+	int v = abs(value);
+
+	if (!state->digits || v < state->digits_min ||
+	    v > state->digits_max) {
+		while ((v / (dez - 1.0)) > 1.0) {
+			i++;
+			dez *= 10;
+		}
+		state->digits = i;
+		state->digits_min = i == 1 ? -INFINITY : dez / 10;
+		state->digits_max = dez - 1;
+	}
+
+	return state->digits + (value < 0);
+}
+
+/* Adapt the width of the column to the width of its current value. A column
+ * only shrinks if it was too wide for a while */
+static void update_column_width(struct _column *column,
+				unsigned int columnSize,
+				int *columnWidthChanged)
+{
+	unsigned int maxTooLongColumns = copt.num_flows * 5;
 
-	if (value < 0)
-		i++;
-	while ((abs(value) / (dez - 1.0)) > 1.0) {
-		i++;
-		dez *= 10;
+	if (column->state.last_width < columnSize) {
+		/* column too small */
+		*columnWidthChanged = 1;
+		column->state.last_width = columnSize;
+		column->state.oversized = 0;
+	} else if (column->state.last_width > 1 + columnSize) {
+		/* column too big */
+		if (column->state.oversized >= maxTooLongColumns) {
+			/* column too big for quite a while */
+			*columnWidthChanged = 1;
+			column->state.last_width = columnSize;
+			column->state.oversized = 0;
+		} else {
+			(column->state.oversized)++;
+		}
+	} else {
+		/* This size was needed, keep it */
+		column->state.oversized = 0;
 	}
-	return i;
 }
 
-/* produces the string command for printf for the right number of digits and decimal part */
-static char *create_output_str(int digits, int decimalPart)
+/* Append to the row. Text that does not fit is cut off */
+static void append_row(struct _row *row, const char *fmt, ...)
 {
-	static char outstr[30] = {0};
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(row->pos, row->left, fmt, ap);
+	va_end(ap);
+
+	if (n < 0)
+		return;
+	n = MIN((size_t)n, row->left - 1);
+	row->pos += n;
+	row->left -= n;
+}
 
-	sprintf(outstr, "%%%d.%df", digits, decimalPart);
-	return outstr;
+/* Terminate the row with a newline, even if it was cut off */
+static void end_row(struct _row *row)
+{
+	if (row->left == 1) {
+		row->pos--;
+		row->left++;
+	}
+	append_row(row, "\n");
 }
 
-static void create_column(char *strHead1Row, char *strHead2Row,
-			  char *strDataRow, int column_id, double value,
+/* Append a numeric column to the data row */
+static void create_column(struct _row *row, int column_id, double value,
 			  int numDigitsDecimalPart, int *columnWidthChanged)
 {
-	unsigned int maxTooLongColumns = copt.num_flows * 5;
 	int lengthData = 0;
 	int lengthHead = 0;
 	unsigned int columnSize = 0;
-	char tempBuffer[50];
 	struct _column *column = &column_info[column_id];
-	char* number_formatstring;
+	const char *symbol = NULL;
 
 	if (!column->state.visible)
 		return;
@@ -1392,22 +2113,21 @@ static void create_column(char *strHead1Row, char *strHead2Row,
 	if (copt.symbolic) {
 		switch ((unsigned int)value) {
 		case INT_MAX:
-			lengthData = strlen("INT_MAX");
+			symbol = "INT_MAX";
 			break;
 		case USHRT_MAX:
-			lengthData = strlen("USHRT_MAX");
+			symbol = "USHRT_MAX";
 			break;
 		case UINT_MAX:
-			lengthData = strlen("UINT_MAX");
+			symbol = "UINT_MAX";
 			break;
-		default:
-			lengthData = det_column_size(value) +
-					numDigitsDecimalPart + 1;
 		}
-	} else {
-		lengthData = det_column_size(value) +
-				numDigitsDecimalPart + 1;
 	}
+	if (symbol)
+		lengthData = strlen(symbol);
+	else
+		lengthData = det_column_size(&column->state, value) +
+				numDigitsDecimalPart + 1;
 	/* leading space */
 	lengthData++;
 
@@ -1419,82 +2139,22 @@ static void create_column(char *strHead1Row, char *strHead2Row,
 			 strlen(column->header.unit));
 	columnSize = MAX(lengthData, lengthHead);
 
-	/* check if columnsize has changed */
-	if (column->state.last_width < columnSize) {
-		/* column too small */
-		*columnWidthChanged = 1;
-		column->state.last_width = columnSize;
-		column->state.oversized = 0;
-	} else if (column->state.last_width > 1 + columnSize) {
-		/* column too big */
-		if (column->state.oversized >= maxTooLongColumns) {
-			/* column too big for quite a while */
-			*columnWidthChanged = 1;
-			column->state.last_width = columnSize;
-			column->state.oversized = 0;
-		} else {
-			(column->state.oversized)++;
-		}
-	} else {
-		/* This size was needed, keep it */
-		column->state.oversized = 0;
-	}
-	number_formatstring = create_output_str(column->state.last_width,
-						numDigitsDecimalPart);
-
-	/* create columns */
+	update_column_width(column, columnSize, columnWidthChanged);
 
 	/* output text for symbolic numbers */
-	if (copt.symbolic) {
-		switch ((int)value) {
-		case INT_MAX:
-			for (unsigned int a = lengthData;
-			     a < MAX(columnSize, column->state.last_width);
-			     a++)
-				strcat(strDataRow, " ");
-			strcat(strDataRow, " INT_MAX");
-			break;
-		case USHRT_MAX:
-			for (unsigned int a = lengthData;
-			     a < MAX(columnSize, column->state.last_width);
-			     a++)
-				strcat(strDataRow, " ");
-			strcat(strDataRow, " USHRT_MAX");
-			break;
-		case UINT_MAX:
-			for (unsigned int a = lengthData;
-			     a < MAX(columnSize, column->state.last_width);
-			     a++)
-				strcat(strDataRow, " ");
-			strcat(strDataRow, " UINT_MAX");
-			break;
-		default: /* number */
-			sprintf(tempBuffer, number_formatstring, value);
-			strcat(strDataRow, tempBuffer);
-		}
-	} else {
-		sprintf(tempBuffer, number_formatstring, value);
-		strcat(strDataRow, tempBuffer);
-	}
-	/* 1st header row */
-	for (unsigned int a = column->state.last_width;
-	     a > strlen(column->header.name); a--)
-		strcat(strHead1Row, " ");
-	strcat(strHead1Row, column->header.name);
-
-	/* 2nd header row */
-	for (unsigned int a = column->state.last_width;
-	     a > strlen(column->header.unit); a--)
-		strcat(strHead2Row, " ");
-	strcat(strHead2Row, column->header.unit);
-}
-
-static void create_column_str(char *strHead1Row, char *strHead2Row,
-			      char *strDataRow, int column_id,
-			      char* value, int *columnWidthChanged)
-{
+	if (symbol)
+		append_row(row, "%*s %s",
+			   (int)MAX(columnSize, column->state.last_width) -
+			   lengthData, "", symbol);
+	else
+		append_row(row, "%*.*f", column->state.last_width,
+			   numDigitsDecimalPart, value);
+}
 
-	unsigned int maxTooLongColumns = copt.num_flows * 5;
+/* Append a text column to the data row */
+static void create_column_str(struct _row *row, int column_id,
+			      const char *value, int *columnWidthChanged)
+{
 	int lengthData = 0;
 	int lengthHead = 0;
 	unsigned int columnSize = 0;
@@ -1509,49 +2169,48 @@ static void create_column_str(char *strHead1Row, char *strHead2Row,
 			 strlen(column->header.unit));
 	columnSize = MAX(lengthData, lengthHead) + 1;
 
-	/* check if columnsize has changed */
-	if (column->state.last_width < columnSize) {
-		/* column too small */
-		*columnWidthChanged = 1;
-		column->state.last_width = columnSize;
-		column->state.oversized = 0;
-	} else if (column->state.last_width > 1 + columnSize) {
-		/* column too big */
-		if (column->state.oversized >= maxTooLongColumns) {
-			/* column too big for quite a while */
-			*columnWidthChanged = 1;
-			column->state.last_width = columnSize;
-			column->state.oversized = 0;
-		} else {
-			(column->state.oversized)++;
-		}
-	} else {
-		/* This size was needed, keep it */
-		column->state.oversized = 0;
-	}
+	update_column_width(column, columnSize, columnWidthChanged);
+
+	append_row(row, "%*s", (int)columnSize - 1, value);
+}
+
+/* Build both header rows from the current widths of the visible columns */
+static void create_header(struct _row *head1, struct _row *head2)
+{
+	const unsigned int num_columns =
+		sizeof(column_info) / sizeof(column_info[0]);
+
+	append_row(head1, "%s", column_info[COL_FLOW_ID].header.name);
+	append_row(head2, "%s", column_info[COL_FLOW_ID].header.unit);
 
-	/* create columns */
-	for (unsigned int a = lengthData+1; a < columnSize; a++)
-		strcat(strDataRow, " ");
-	strcat(strDataRow, value);
+	for (unsigned int i = COL_FLOW_ID + 1; i < num_columns; i++) {
+		const struct _column *column = &column_info[i];
+		int width = column->state.last_width;
 
-	/* 1st header row */
-	for (unsigned int a = column->state.last_width;
-	     a > strlen(column->header.name) + 1; a--)
-		strcat(strHead1Row, " ");
-	strcat(strHead1Row, column->header.name);
+		if (!column->state.visible)
+			continue;
 
-	/* 2nd header Row */
-	for (unsigned int a = column->state.last_width;
-	     a > strlen(column->header.unit) + 1; a--)
-		strcat(strHead2Row, " ");
-	strcat(strHead2Row, column->header.unit);
+		/* text columns include the leading space in their width */
+		if (column->type == COL_TCP_CA_STATE ||
+		    column->type == COL_TCP_LIMIT)
+			width--;
+#ifdef DEBUG
+		if (column->type == COL_STATUS)
+			width--;
+#endif /* DEBUG */
+
+		append_row(head1, "%*s", width, column->header.name);
+		append_row(head2, "%*s", width, column->header.unit);
+	}
+
+	end_row(head1);
+	end_row(head2);
 }
 
 /* Output a single report (with header if width has changed */
-static char *create_output(char hash, int id, int type, double begin, double end,
-		   double throughput, double transac,
-		   unsigned int request_blocks, unsigned int response_blocks,
+static const char *create_output(char hash, int id, int type, double begin, double end,
+		   double throughput, double transac, double pacing,
+		   double cpu, double cpb, unsigned int request_blocks, unsigned int response_blocks,
 		   double rttmin, double rttavg, double rttmax,
 		   double iatmin, double iatavg, double iatmax,
 		   double delaymin, double delayavg, double delaymax,
@@ -1560,122 +2219,100 @@ static char *create_output(char hash, int id, int type, double begin, double end
 		   unsigned int retr, unsigned int tret, unsigned int fack,
 		   double linrtt, double linrttvar, double linrto,
 		   unsigned int backoff, int ca_state, int snd_mss,  int pmtu,
+		   double busy, const char *limit, double delivery_rate,
+		   double pacing_rate, double min_rtt, double notsent,
 		   char* status)
 {
 	int columnWidthChanged = 0;
 	static int counter = 0;
 
 	/* Create Row + Header */
-	char dataString[250];
-	char headerString1[250];
-	char headerString2[250];
-	static char outputString[1000];
-	char tmp[100];
+	static char outputString[3 * REPORT_ROW_SIZE];
+	char dataString[REPORT_ROW_SIZE];
+	struct _row data = { dataString, sizeof(dataString) };
+	const char *tmp;
 
 	/* output string
 	param # + flow_id */
-	if (hash)
-		sprintf(dataString, "#");
-
-	if (type)
-		sprintf(dataString, "D%3d", id);
-	else
-		sprintf(dataString, "S%3d", id);
-
-	strcpy(headerString1, column_info[COL_FLOW_ID].header.name);
-	strcpy(headerString2, column_info[COL_FLOW_ID].header.unit);
+	UNUSED_ARGUMENT(hash);
+	append_row(&data, "%c%3d", type ? 'D' : 'S', id);
 
 	if (ca_state == TCP_CA_Open)
-		strcpy(tmp, "open");
+		tmp = "open";
 	else if (ca_state == TCP_CA_Disorder)
-		strcpy(tmp, "disorder");
+		tmp = "disorder";
 	else if (ca_state == TCP_CA_CWR)
-		strcpy(tmp, "cwr");
+		tmp = "cwr";
 	else if (ca_state == TCP_CA_Recovery)
-		strcpy(tmp, "recover");
+		tmp = "recover";
 	else if (ca_state == TCP_CA_Loss)
-		strcpy(tmp, "loss");
+		tmp = "loss";
 	else
-		strcpy(tmp, "unknown");
-
-	create_column(headerString1, headerString2, dataString, COL_BEGIN,
-		      begin, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_END,
-		      end, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_THROUGH,
-		      throughput, 6, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TRANSAC,
-		      transac, 2, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_BLOCK_REQU,
-		      request_blocks, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_BLOCK_RESP,
-		      response_blocks, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_RTT_MIN,
-		      rttmin, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_RTT_AVG,
-		      rttavg, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_RTT_MAX,
-		      rttmax, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_IAT_MIN,
-		      iatmin, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_IAT_AVG,
-		      iatavg, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_IAT_MAX,
-		      iatmax, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_DLY_MIN,
-		      delaymin, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_DLY_AVG,
-		      delayavg, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_DLY_MAX,
-		      delaymax, 3, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_CWND,
-		      cwnd, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_SSTH,
-		      ssth, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_UACK,
-		      uack, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_SACK,
-		      sack, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_LOST,
-		      lost, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_RETR,
-		      retr, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_TRET,
-		      tret, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_FACK,
-		      fack, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_REOR,
-		      reor, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_BKOF,
-		      backoff, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_RTT,
-		      linrtt, 1, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_RTTVAR,
-		      linrttvar, 1, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_TCP_RTO,
-		      linrto, 1, &columnWidthChanged);
-	create_column_str(headerString1, headerString2, dataString,
-			  COL_TCP_CA_STATE, tmp, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_SMSS,
-		      snd_mss, 0, &columnWidthChanged);
-	create_column(headerString1, headerString2, dataString, COL_PMTU,
-		      pmtu, 0, &columnWidthChanged);
+		tmp = "unknown";
+
+	create_column(&data, COL_BEGIN, begin, 3, &columnWidthChanged);
+	create_column(&data, COL_END, end, 3, &columnWidthChanged);
+	create_column(&data, COL_THROUGH, throughput, 6, &columnWidthChanged);
+	create_column(&data, COL_TRANSAC, transac, 2, &columnWidthChanged);
+	create_column(&data, COL_PACING, pacing, 1, &columnWidthChanged);
+	create_column(&data, COL_CPU, cpu, 1, &columnWidthChanged);
+	create_column(&data, COL_CPB, cpb, 2, &columnWidthChanged);
+	create_column(&data, COL_BLOCK_REQU, request_blocks, 0,
+		      &columnWidthChanged);
+	create_column(&data, COL_BLOCK_RESP, response_blocks, 0,
+		      &columnWidthChanged);
+	create_column(&data, COL_RTT_MIN, rttmin, 3, &columnWidthChanged);
+	create_column(&data, COL_RTT_AVG, rttavg, 3, &columnWidthChanged);
+	create_column(&data, COL_RTT_MAX, rttmax, 3, &columnWidthChanged);
+	create_column(&data, COL_IAT_MIN, iatmin, 3, &columnWidthChanged);
+	create_column(&data, COL_IAT_AVG, iatavg, 3, &columnWidthChanged);
+	create_column(&data, COL_IAT_MAX, iatmax, 3, &columnWidthChanged);
+	create_column(&data, COL_DLY_MIN, delaymin, 3, &columnWidthChanged);
+	create_column(&data, COL_DLY_AVG, delayavg, 3, &columnWidthChanged);
+	create_column(&data, COL_DLY_MAX, delaymax, 3, &columnWidthChanged);
+	create_column(&data, COL_TCP_CWND, cwnd, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_SSTH, ssth, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_UACK, uack, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_SACK, sack, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_LOST, lost, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_RETR, retr, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_TRET, tret, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_FACK, fack, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_REOR, reor, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_BKOF, backoff, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_RTT, linrtt, 1, &columnWidthChanged);
+	create_column(&data, COL_TCP_RTTVAR, linrttvar, 1,
+		      &columnWidthChanged);
+	create_column(&data, COL_TCP_RTO, linrto, 1, &columnWidthChanged);
+	create_column_str(&data, COL_TCP_CA_STATE, tmp, &columnWidthChanged);
+	create_column(&data, COL_SMSS, snd_mss, 0, &columnWidthChanged);
+	create_column(&data, COL_PMTU, pmtu, 0, &columnWidthChanged);
+	create_column(&data, COL_TCP_BUSY, busy, 1, &columnWidthChanged);
+	create_column_str(&data, COL_TCP_LIMIT, limit, &columnWidthChanged);
+	create_column(&data, COL_TCP_DLVR, delivery_rate, 3,
+		      &columnWidthChanged);
+	create_column(&data, COL_TCP_PRATE, pacing_rate, 3,
+		      &columnWidthChanged);
+	create_column(&data, COL_TCP_MINRTT, min_rtt, 3, &columnWidthChanged);
+	create_column(&data, COL_TCP_NOTSENT, notsent, 0, &columnWidthChanged);
 #ifdef DEBUG
-	create_column_str(headerString1, headerString2, dataString, COL_STATUS,
-			  status, &columnWidthChanged);
+	create_column_str(&data, COL_STATUS, status, &columnWidthChanged);
 #else
 	UNUSED_ARGUMENT(status);
 #endif /* DEBUG */
 
-	/* newline */
-	strcat(headerString1, "\n");
-	strcat(headerString2, "\n");
-	strcat(dataString, "\n");
-	/* output string end */
+	end_row(&data);
+
+	/* the header is only built if it is printed */
 	if (columnWidthChanged > 0 || (counter % 25) == 0) {
-		strcpy(outputString, headerString1);
-		strcat(outputString, headerString2);
-		strcat(outputString, dataString);
+		char headerString1[REPORT_ROW_SIZE];
+		char headerString2[REPORT_ROW_SIZE];
+		struct _row head1 = { headerString1, sizeof(headerString1) };
+		struct _row head2 = { headerString2, sizeof(headerString2) };
+
+		create_header(&head1, &head2);
+		snprintf(outputString, sizeof(outputString), "%s%s%s",
+			 headerString1, headerString2, dataString);
 	} else {
 		strcpy(outputString, dataString);
 	}
@@ -1691,9 +2328,56 @@ inline static double scale_thruput(double thruput)
         return thruput / 1e6 * (1<<3);
 }
 
-static void print_report(int id, int endpoint, struct _report* r)
+/* CPU cycles the daemon spent on reading and writing a byte of the flow */
+static double cycles_per_byte(const struct _report *r)
 {
+	double bytes = (double)r->bytes_read + r->bytes_written;
 
+	if (!r->cpu_hz || !bytes)
+		return INFINITY;
+
+	return r->cpu_flow * r->cpu_hz / bytes;
+}
+
+/* Names of the sender limits in the reports */
+static const char *sender_limit_names[NUM_LIMITS] = {
+	[LIMIT_APP] = "app",
+	[LIMIT_RWND] = "rwnd",
+	[LIMIT_SNDBUF] = "sndbuf",
+	[LIMIT_CWND] = "cwnd",
+};
+
+/* Split the duration of a report into the parts the sender was limited by
+ * the application, the receive window, the send buffer and the congestion
+ * window, as fractions of the duration. Returns the largest part, or -1 if
+ * the kernel of the daemon has no chrono statistics or nothing was sent */
+static int sender_limits(const struct _report *r, double share[NUM_LIMITS])
+{
+	double duration = time_diff(&r->begin, &r->end);
+	int limit = LIMIT_APP;
+
+	if (!(r->tcp_info.tcpi_available & TCP_INFO_CHRONO) || duration <= 0 ||
+	    (!r->bytes_written && !r->busy_time))
+		return -1;
+
+	/* the kernel counts in jiffies, the busy time may exceed the
+	 * duration of a report by one */
+	share[LIMIT_APP] = MAX(duration - r->busy_time, 0) / duration;
+	share[LIMIT_RWND] = r->rwnd_limited / duration;
+	share[LIMIT_SNDBUF] = r->sndbuf_limited / duration;
+	share[LIMIT_CWND] = MAX(r->busy_time - r->rwnd_limited -
+				r->sndbuf_limited, 0) / duration;
+
+	for (int i = LIMIT_APP + 1; i < NUM_LIMITS; i++)
+		if (share[i] > share[limit])
+			limit = i;
+	return limit;
+}
+
+/* Format an interval report, returns the line with a header if due */
+static const char *format_report(const struct _queued_report *q)
+{
+	const struct _report *r = &q->report;
 	double min_rtt = r->rtt_min;
 	double max_rtt = r->rtt_max;
 	double avg_rtt;
@@ -1705,7 +2389,6 @@ static void print_report(int id, int endpoint, struct _report* r)
 	double avg_delay;
 
 	char comment_buffer[100] = " (";
-	char report_buffer[4000] = "";
 
 	#define COMMENT_CAT(s) do { if (strlen(comment_buffer) > 2) \
 		strncat(comment_buffer, "/", sizeof(comment_buffer)-1); \
@@ -1727,7 +2410,7 @@ static void print_report(int id, int endpoint, struct _report* r)
 		min_delay = max_delay = avg_delay = INFINITY;
 
 #ifdef DEBUG
-	if (cflow[id].finished[endpoint]) {
+	if (q->finished) {
 		COMMENT_CAT("stopped")
 	} else {
 		char tmp[2];
@@ -1771,19 +2454,47 @@ static void print_report(int id, int endpoint, struct _report* r)
 	if (strlen(comment_buffer) == 2)
 		comment_buffer[0] = '\0';
 
-	char rep_string[4000];
 	double diff_first_last =
-		time_diff(&cflow[id].start_timestamp[endpoint], &r->begin);
+		time_diff(&q->start, &r->begin);
 	double diff_first_now =
-		time_diff(&cflow[id].start_timestamp[endpoint], &r->end);
+		time_diff(&q->start, &r->end);
 	double thruput = scale_thruput((double)r->bytes_written /
 				       (diff_first_now - diff_first_last));
 	double transac = (double)r->response_blocks_read /
 			 (diff_first_now - diff_first_last);
-
-	strcpy(rep_string,
-	       create_output(0, id, endpoint, diff_first_last, diff_first_now,
-		             thruput, transac,
+	/* achieved rate in percent of the target rate (option -R) */
+	double pacing = INFINITY;
+	if (q->write_rate)
+		pacing = 100 * (double)r->request_blocks_written /
+			 (diff_first_now - diff_first_last) /
+			 q->write_rate;
+	double cpu = 100 * (r->cpu_user + r->cpu_system + r->cpu_softirq);
+	double cpb = cycles_per_byte(r);
+
+	/* TCP metrics of newer Linux kernels */
+	double share[NUM_LIMITS];
+	int limit = sender_limits(r, share);
+	double busy = INFINITY;
+	if (limit != -1)
+		busy = 100 * (1 - share[LIMIT_APP]);
+	double delivery_rate = INFINITY;
+	if (r->tcp_info.tcpi_available & TCP_INFO_DELIVERY_RATE)
+		delivery_rate = scale_thruput(r->tcp_info.tcpi_delivery_rate);
+	double pacing_rate = INFINITY;
+	if (r->tcp_info.tcpi_available & TCP_INFO_PACING_RATE &&
+	    r->tcp_info.tcpi_pacing_rate != ULLONG_MAX)
+		pacing_rate = scale_thruput(r->tcp_info.tcpi_pacing_rate);
+	/* the kernel reports ~0 before the first RTT sample */
+	double min_rtt_kernel = INFINITY;
+	if (r->tcp_info.tcpi_available & TCP_INFO_NOTSENT_BYTES &&
+	    r->tcp_info.tcpi_min_rtt != -1)
+		min_rtt_kernel = (double)r->tcp_info.tcpi_min_rtt / 1e3;
+	double notsent = INFINITY;
+	if (r->tcp_info.tcpi_available & TCP_INFO_NOTSENT_BYTES)
+		notsent = (unsigned int)r->tcp_info.tcpi_notsent_bytes;
+
+	return create_output(0, q->id, q->endpoint, diff_first_last,
+			     diff_first_now, thruput, transac, pacing, cpu, cpb,
 			     (unsigned int)r->request_blocks_written,
 			     (unsigned int)r->response_blocks_written,
 			     min_rtt * 1e3, avg_rtt * 1e3, max_rtt * 1e3,
@@ -1804,10 +2515,10 @@ static void print_report(int id, int endpoint, struct _report* r)
 			     (unsigned int)r->tcp_info.tcpi_backoff,
 			     r->tcp_info.tcpi_ca_state,
 			     (unsigned int)r->tcp_info.tcpi_snd_mss,
-			     r->pmtu, comment_buffer));
-	strncpy(report_buffer, rep_string, sizeof(report_buffer));
-	report_buffer[sizeof(report_buffer) - 1] = 0;
-	log_output(report_buffer);
+			     r->pmtu, busy,
+			     limit == -1 ? "-" : sender_limit_names[limit],
+			     delivery_rate, pacing_rate, min_rtt_kernel, notsent,
+			     comment_buffer);
 }
 
 static char *guess_topology (int mtu)
@@ -1844,12 +2555,116 @@ static char *guess_topology (int mtu)
 	return "unknown";
 }
 
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile p (0 < p <= 100) of n sorted values */
+static double percentile(const double *sorted, int n, double p)
+{
+	int rank = (int)ceil(p / 100.0 * n);
+
+	if (rank < 1)
+		rank = 1;
+	return sorted[rank - 1];
+}
+
+/* Remember the completion time of a flow for the final report */
+static void add_fct_sample(double size, double fct)
+{
+	if (num_fct_samples == max_fct_samples) {
+		max_fct_samples = max_fct_samples ? 2 * max_fct_samples : 1024;
+		fct_samples = realloc(fct_samples, max_fct_samples *
+				      sizeof(struct _fct_sample));
+		if (!fct_samples)
+			critx("could not allocate memory for flow completion "
+			      "times");
+	}
+	fct_samples[num_fct_samples].size = size;
+	fct_samples[num_fct_samples++].fct = fct;
+}
+
+/* Print the distribution of the completion times of all flows with a size
+ * in [min_size, max_size) */
+static void report_fct_bucket(const char *label, double min_size,
+			      double max_size)
+{
+	char buffer[300];
+	double sum = 0.0;
+	double *fct;
+	int n = 0;
+
+	fct = malloc(num_fct_samples * sizeof(double));
+	if (!fct)
+		critx("could not allocate memory for flow completion times");
+
+	for (unsigned int i = 0; i < num_fct_samples; i++) {
+		if (fct_samples[i].size < min_size ||
+		    fct_samples[i].size >= max_size)
+			continue;
+		fct[n++] = fct_samples[i].fct;
+		sum += fct_samples[i].fct;
+	}
+
+	if (n) {
+		qsort(fct, n, sizeof(double), cmp_double);
+		snprintf(buffer, sizeof(buffer), "# %-15s n = %d, "
+			 "%.3f/%.3f/%.3fs (min/avg/max), "
+			 "%.3f/%.3f/%.3fs (p50/p90/p99)\n", label, n, fct[0],
+			 sum / n, fct[n - 1], percentile(fct, n, 50),
+			 percentile(fct, n, 90), percentile(fct, n, 99));
+		log_output(buffer);
+	}
+	free(fct);
+}
+
+/* Print the distribution of flow completion times across all flows of the
+ * test, in total and per flow size */
+static void report_fct(void)
+{
+	static const struct {
+		const char *label;
+		double min_size;
+		double max_size;
+	} buckets[] = {
+		{"size < 10kB:",		0,	1e4},
+		{"size < 100kB:",	1e4,	1e5},
+		{"size < 1MB:",		1e5,	1e6},
+		{"size < 10MB:",		1e6,	1e7},
+		{"size >= 10MB:",	1e7,	INFINITY},
+	};
+
+	char buffer[100];
+
+	if (!num_fct_samples && !num_fct_dropped)
+		return;
+
+	log_output("\n# flow completion time\n");
+	if (num_fct_samples) {
+		report_fct_bucket("all flows:", 0, INFINITY);
+		for (unsigned int i = 0;
+		     i < sizeof(buckets) / sizeof(buckets[0]); i++)
+			report_fct_bucket(buckets[i].label, buckets[i].min_size,
+					  buckets[i].max_size);
+	}
+	if (num_fct_dropped) {
+		snprintf(buffer, sizeof(buffer), "# %-15s n = %u, not "
+			 "included above\n", "dropped:", num_fct_dropped);
+		log_output(buffer);
+	}
+}
+
 static void report_final(void)
 {
 	char header_buffer[600] = "";
 	char header_nibble[600] = "";
 
 	for (int id = 0; id < copt.num_flows; id++) {
+		/* completion time of flow, destination view preferred */
+		double flow_fct = -1.0, flow_size = 0.0;
 
 #define CAT(fmt, args...) do {\
 	snprintf(header_nibble, sizeof(header_nibble), fmt, ##args); \
@@ -1910,10 +2725,35 @@ static void report_final(void)
 				duration_write = cflow[id].settings[endpoint].duration[WRITE] + report_delta_write;
 				duration_read = cflow[id].settings[endpoint].duration[READ] + report_delta_read;
 
-				if (cflow[id].settings[endpoint].duration[WRITE])
+				if (cflow[id].settings[endpoint].duration[WRITE] > 0)
 					CATC("flow duration = %.3fs/%.3fs (real/req)",
 						duration_write,
 						cflow[id].settings[endpoint].duration[WRITE]);
+				else if (cflow[id].settings[endpoint].duration[WRITE] < 0)
+					CATC("flow duration = %.3fs (real)",
+						duration_write);
+
+				if (cflow[id].settings[endpoint].write_bytes)
+					CATC("amount = %llu bytes",
+					     (unsigned long long)cflow[id].settings[endpoint].write_bytes);
+				if (cflow[id].settings[endpoint].write_blocks)
+					CATC("amount = %u blocks",
+					     cflow[id].settings[endpoint].write_blocks);
+
+				/* flow completion time (option -Z) */
+				if (cflow[id].final_report[endpoint]->completion.tv_sec ||
+				    cflow[id].final_report[endpoint]->completion.tv_nsec) {
+					int direction = (cflow[id].settings[endpoint].write_bytes ||
+							 cflow[id].settings[endpoint].write_blocks) ?
+							WRITE : READ;
+					flow_fct = time_diff(&cflow[id].final_report[endpoint]->begin,
+							     &cflow[id].final_report[endpoint]->completion) -
+						   cflow[id].settings[endpoint].delay[direction];
+					CATC("completion time = %.6fs", flow_fct);
+					flow_size = endpoint == SOURCE ?
+						cflow[id].final_report[endpoint]->bytes_written :
+						cflow[id].final_report[endpoint]->bytes_read;
+				}
 
 				if (cflow[id].settings[endpoint].delay[WRITE])
 				       CATC("write delay = %.3fs", cflow[id].settings[endpoint].delay[WRITE]);
@@ -1938,6 +2778,47 @@ static void report_final(void)
 				else
 					CATC("through = %.6f/%.6fMbit/s (out/in)", thruput_written, thruput_read);
 
+				/* deviation from the common start */
+				if (cflow[id].final_report[endpoint]->bytes_written)
+					CATC("start skew = %.3fms",
+					     cflow[id].final_report[endpoint]->start_skew * 1e3);
+
+				/* CPU cost of the flow */
+				{
+					const struct _report *r = cflow[id].final_report[endpoint];
+					double cpb = cycles_per_byte(r);
+
+					CATC("cpu = %.1f%% (user %.1f%%, sys %.1f%%, softirq %.1f%%)",
+					     100 * (r->cpu_user + r->cpu_system + r->cpu_softirq),
+					     100 * r->cpu_user, 100 * r->cpu_system,
+					     100 * r->cpu_softirq);
+					if (!isinf(cpb))
+						CATC("%.2f cycles/byte", cpb);
+				}
+
+				/* what limited the sender, newer Linux kernels only */
+				{
+					double share[NUM_LIMITS];
+					int limit = sender_limits(cflow[id].final_report[endpoint],
+								  share);
+
+					if (limit != -1)
+						CATC("limited by %s (app %.1f%%, rwnd %.1f%%, "
+						     "sndbuf %.1f%%, cwnd %.1f%%)",
+						     sender_limit_names[limit],
+						     100 * share[LIMIT_APP],
+						     100 * share[LIMIT_RWND],
+						     100 * share[LIMIT_SNDBUF],
+						     100 * share[LIMIT_CWND]);
+				}
+
+				/* achieved vs. target rate (option -R) */
+				if (cflow[id].settings[endpoint].write_rate &&
+				    duration_write > 0)
+					CATC("pacing = %.1f%% of rate",
+					     100 * cflow[id].final_report[endpoint]->request_blocks_written /
+					     duration_write / cflow[id].settings[endpoint].write_rate);
+
 				/* transactions */
 				transactions_per_sec = cflow[id].final_report[endpoint]->response_blocks_read / MAX(duration_read, duration_write);
 				if (isnan(transactions_per_sec))
@@ -1954,6 +2835,35 @@ static void report_final(void)
 					CATC("response blocks = %u/%u (out/in)",
 					cflow[id].final_report[endpoint]->response_blocks_written,
 					cflow[id].final_report[endpoint]->response_blocks_read);
+
+				/* responses waiting for the socket */
+				if (cflow[id].final_report[endpoint]->response_blocks_written)
+					CATC("response queue = %u, delay = %.3f/%.3fms (max/avg)",
+					     cflow[id].final_report[endpoint]->response_queue_max,
+					     cflow[id].final_report[endpoint]->response_delay_max * 1e3,
+					     cflow[id].final_report[endpoint]->response_delay_sum * 1e3 /
+					     cflow[id].final_report[endpoint]->response_blocks_written);
+
+				/* payload verification (option -E) */
+				if (cflow[id].final_report[endpoint]->corrupted_blocks)
+					CATC("corrupted blocks = %u (first bad byte %llu)",
+					     cflow[id].final_report[endpoint]->corrupted_blocks,
+					     (unsigned long long)cflow[id].final_report[endpoint]->corruption_offset);
+
+				/* request blocks per write call (option --write-batch) */
+				if (cflow[id].final_report[endpoint]->write_calls)
+					CATC("blocks/syscall = %.2f",
+					     (double)cflow[id].final_report[endpoint]->request_blocks_written /
+					     cflow[id].final_report[endpoint]->write_calls);
+
+				/* transactions awaiting their response (option --pipeline) */
+				if (cflow[id].settings[endpoint].pipeline_depth)
+					CATC("pipeline = %u/%d (max/depth)",
+					     cflow[id].final_report[endpoint]->outstanding_max,
+					     cflow[id].settings[endpoint].pipeline_depth);
+				if (cflow[id].final_report[endpoint]->transactions_lost)
+					CATC("lost transactions = %u",
+					     cflow[id].final_report[endpoint]->transactions_lost);
 				/* rtt */
 				if (cflow[id].final_report[endpoint]->response_blocks_read) {
 					double min_rtt = cflow[id].final_report[endpoint]->rtt_min;
@@ -1972,7 +2882,24 @@ static void report_final(void)
 					CATC("IAT = %.3f/%.3f/%.3f (min/avg/max)",
 					     min_iat*1e3, avg_iat*1e3, max_iat*1e3);
 				}
-				/* delay */
+				/* delay, corrected by the clock offset in the
+				 * middle of the test */
+				if (cflow[id].final_report[endpoint]->request_blocks_read) {
+					const struct _daemon *daemon = cflow[id].endpoint[endpoint].daemon;
+					struct timespec at = daemon->clock_sync[SYNC_START];
+					double offset, error;
+
+					if (daemon->clock_sync[SYNC_END].tv_sec)
+						time_add(&at, time_diff(&at, &daemon->clock_sync[SYNC_END]) / 2);
+					if (daemon != cflow[id].endpoint[1 - endpoint].daemon) {
+						if (flow_clock_offset(id, endpoint, &at, &offset, &error))
+							CATC("clock offset = %.3fms (error %.3fms)",
+							     offset*1e3, error*1e3);
+						else
+							CATC("clock offset unknown");
+					}
+					correct_delay(id, endpoint, cflow[id].final_report[endpoint], &at);
+				}
 				if (cflow[id].final_report[endpoint]->request_blocks_read) {
 					double min_delay = cflow[id].final_report[endpoint]->delay_min;
 					double max_delay = cflow[id].final_report[endpoint]->delay_max;
@@ -2009,7 +2936,232 @@ static void report_final(void)
 			CAT("\n");
 			log_output(header_buffer);
 		}
+		if (flow_fct >= 0)
+			add_fct_sample(flow_size, flow_fct);
 	}
+
+	report_fct();
+}
+
+/* Remember latency and loss of an interval report for the current ramp
+ * step */
+static void add_ramp_sample(struct _report *report)
+{
+	if (num_ramp_rtt_samples == max_ramp_rtt_samples) {
+		max_ramp_rtt_samples = max_ramp_rtt_samples ?
+				       2 * max_ramp_rtt_samples : 1024;
+		ramp_rtt_samples = realloc(ramp_rtt_samples,
+					   max_ramp_rtt_samples *
+					   sizeof(double));
+		if (!ramp_rtt_samples)
+			critx("could not allocate memory for ramp samples");
+	}
+
+	/* kernel reports no RTT before the first ACK */
+	if (report->tcp_info.tcpi_rtt)
+		ramp_rtt_samples[num_ramp_rtt_samples++] =
+			(double)report->tcp_info.tcpi_rtt / 1e3;
+	ramp_retr_sum += report->tcp_info.tcpi_retrans;
+	num_ramp_reports++;
+}
+
+/* Reset the state of all flows for the next ramp step and scale the rate
+ * given by option -R */
+static void init_ramp_step(double factor)
+{
+	for (unsigned int id = 0; id < copt.num_flows; id++) {
+		for (int i = 0; i < 2; i++) {
+			if (cflow[id].ramp_base_rate[i])
+				cflow[id].settings[i].write_rate =
+					MAX(1, (int)(cflow[id].ramp_base_rate[i] *
+						     factor + 0.5));
+
+			cflow[id].endpoint_id[i] = -1;
+			cflow[id].start_timestamp[i].tv_sec = 0;
+			cflow[id].start_timestamp[i].tv_nsec = 0;
+			cflow[id].finished[i] = 0;
+			free(cflow[id].final_report[i]);
+			cflow[id].final_report[i] = NULL;
+		}
+	}
+
+	active_flows = 0;
+	num_fct_samples = 0;
+	num_ramp_rtt_samples = 0;
+	ramp_retr_sum = 0.0;
+	num_ramp_reports = 0;
+}
+
+/* Rate a finished ramp step by the final reports and the samples of its
+ * interval reports */
+static void finish_ramp_step(struct _ramp_step *step)
+{
+	double rtt_limit = copt.ramp_rtt_limit;
+
+	step->target = step->achieved = 0.0;
+	for (unsigned int id = 0; id < copt.num_flows; id++) {
+		for (int i = 0; i < 2; i++) {
+			struct _report *r = cflow[id].final_report[i];
+			double duration;
+
+			if (!cflow[id].settings[i].write_rate || !r)
+				continue;
+
+			step->target += (double)cflow[id].settings[i].write_rate *
+					cflow[id].settings[i].maximum_block_size;
+			duration = time_diff(&r->begin, &r->end) -
+				   cflow[id].settings[i].delay[WRITE];
+			if (duration > 0)
+				step->achieved += r->bytes_written / duration;
+		}
+	}
+
+	step->rtt_p50 = step->rtt_p95 = 0.0;
+	if (num_ramp_rtt_samples) {
+		qsort(ramp_rtt_samples, num_ramp_rtt_samples, sizeof(double),
+		      cmp_double);
+		step->rtt_p50 = percentile(ramp_rtt_samples,
+					   num_ramp_rtt_samples, 50);
+		step->rtt_p95 = percentile(ramp_rtt_samples,
+					   num_ramp_rtt_samples, 95);
+	}
+	step->retr = num_ramp_reports ? ramp_retr_sum / num_ramp_reports : 0;
+
+	/* without an explicit limit, latency may double compared to the
+	 * first step */
+	if (!rtt_limit && num_ramp_steps)
+		rtt_limit = 2 * ramp_steps[0].rtt_p95;
+
+	step->saturated = step->achieved < RAMP_MIN_ACHIEVED * step->target ||
+			  (rtt_limit > 0 && step->rtt_p95 > rtt_limit) ||
+			  (copt.ramp_retr_limit >= 0 &&
+			   step->retr > copt.ramp_retr_limit);
+}
+
+static int cmp_ramp_step(const void *a, const void *b)
+{
+	return cmp_double(&((const struct _ramp_step *)a)->factor,
+			  &((const struct _ramp_step *)b)->factor);
+}
+
+/* Print the rate vs. latency curve of the ramp and its saturation point */
+static void report_ramp(void)
+{
+	char buffer[300];
+	struct _ramp_step *knee = NULL, *sustainable = NULL;
+	const char *unit = copt.mbyte ? "MB/s" : "Mbit/s";
+
+	if (!num_ramp_steps)
+		return;
+
+	qsort(ramp_steps, num_ramp_steps, sizeof(struct _ramp_step),
+	      cmp_ramp_step);
+
+	log_output("\n# ramp\n");
+	snprintf(buffer, sizeof(buffer), "# %8s %12s %12s %9s %9s %8s\n",
+		 "factor", "target", "achieved", "RTT p50", "RTT p95", "retr");
+	log_output(buffer);
+	snprintf(buffer, sizeof(buffer), "# %8s %12s %12s %9s %9s %8s\n",
+		 "[x]", unit, unit, "[ms]", "[ms]", "[#]");
+	log_output(buffer);
+
+	for (unsigned int i = 0; i < num_ramp_steps; i++) {
+		struct _ramp_step *step = &ramp_steps[i];
+
+		snprintf(buffer, sizeof(buffer),
+			 "# %8.3f %12.6f %12.6f %9.3f %9.3f %8.2f%s\n",
+			 step->factor, scale_thruput(step->target),
+			 scale_thruput(step->achieved), step->rtt_p50,
+			 step->rtt_p95, step->retr,
+			 step->saturated ? " (saturated)" : "");
+		log_output(buffer);
+
+		if (step->saturated && !knee)
+			knee = step;
+		else if (!step->saturated && !knee)
+			sustainable = step;
+	}
+
+	if (!knee)
+		snprintf(buffer, sizeof(buffer), "# no saturation up to "
+			 "%.3f x given rate (achieved %.6f %s)\n",
+			 ramp_steps[num_ramp_steps - 1].factor,
+			 scale_thruput(ramp_steps[num_ramp_steps - 1].achieved),
+			 unit);
+	else if (!sustainable)
+		snprintf(buffer, sizeof(buffer), "# saturated already at the "
+			 "given rate (achieved %.6f %s)\n",
+			 scale_thruput(knee->achieved), unit);
+	else
+		snprintf(buffer, sizeof(buffer), "# saturation point between "
+			 "%.3f and %.3f x given rate, maximum sustainable rate "
+			 "= %.6f %s\n", sustainable->factor, knee->factor,
+			 scale_thruput(sustainable->achieved), unit);
+	log_output(buffer);
+}
+
+/* Run the test once for every step of the ramp. The rate of all rate
+ * limited flows is raised until latency or loss cross their threshold */
+static void run_ramp(xmlrpc_client *rpc_client)
+{
+	double lo = 1.0, hi = copt.ramp_max;
+	char headline[100];
+
+	for (unsigned int id = 0; id < copt.num_flows; id++)
+		for (int i = 0; i < 2; i++)
+			cflow[id].ramp_base_rate[i] =
+				cflow[id].settings[i].write_rate;
+
+	for (unsigned int s = 0; s < copt.ramp_steps && !sigint_caught; s++) {
+		struct _ramp_step *step = &ramp_steps[num_ramp_steps];
+
+		if (copt.ramp_mode == RAMP_LINEAR)
+			step->factor = copt.ramp_steps > 1 ?
+				1.0 + (hi - 1.0) * s / (copt.ramp_steps - 1) :
+				1.0;
+		else
+			step->factor = !s ? lo : (s == 1 ? hi : (lo + hi) / 2);
+
+		init_ramp_step(step->factor);
+		snprintf(headline, sizeof(headline), "# ramp step %u: rate = "
+			 "%.3f x given rate\n", s + 1, step->factor);
+		log_output(headline);
+
+		DEBUG_MSG(LOG_WARNING, "prepare flows");
+		prepare_grinding(rpc_client);
+
+		DEBUG_MSG(LOG_WARNING, "start flows");
+		if (!sigint_caught)
+			grind_flows(rpc_client);
+
+		DEBUG_MSG(LOG_WARNING, "close flows");
+		close_flows();
+
+		DEBUG_MSG(LOG_WARNING, "report final");
+		fetch_reports(rpc_client);
+		finish_ramp_step(step);
+		num_ramp_steps++;
+		report_final();
+		if (copt.daemon_stats)
+			report_daemon_stats(rpc_client);
+
+		if (copt.ramp_mode == RAMP_LINEAR) {
+			if (step->saturated)
+				break;
+			continue;
+		}
+
+		/* binary search: the given rate must be sustainable and the
+		 * maximum rate must saturate, otherwise there is no knee */
+		if ((!s && step->saturated) || (s == 1 && !step->saturated))
+			break;
+		if (step->saturated)
+			hi = step->factor;
+		else
+			lo = step->factor;
+	}
+
+	report_ramp();
 }
 
 /* Finds the daemon (or creating a new one) for a given server_url,
@@ -2077,6 +3229,11 @@ static void parse_trafgen_option(char *params, int current_flow_ids[], int id)
 			errx("malformed traffic generation parameters");
 			usage(EXIT_FAILURE);
 		}
+		if (!strchr("qpgaf", typechar)) {
+			errx("syntax error in traffic generation option: %c "
+			     "is not a flow parameter", typechar);
+			usage(EXIT_FAILURE);
+		}
 
 		switch (distchar) {
 		case 'N':
@@ -2160,7 +3317,20 @@ static void parse_trafgen_option(char *params, int current_flow_ids[], int id)
 						cflow[id].settings[i].interpacket_gap_trafgen_options.param_one = param1;
 						cflow[id].settings[i].interpacket_gap_trafgen_options.param_two = param2;
 						break;
+					case 'a':
+						cflow[id].settings[i].flow_arrival_trafgen_options.distribution = distr;
+						cflow[id].settings[i].flow_arrival_trafgen_options.param_one = param1;
+						cflow[id].settings[i].flow_arrival_trafgen_options.param_two = param2;
+						break;
+					case 'f':
+						cflow[id].settings[i].flow_size_trafgen_options.distribution = distr;
+						cflow[id].settings[i].flow_size_trafgen_options.param_one = param1;
+						cflow[id].settings[i].flow_size_trafgen_options.param_two = param2;
+						break;
 					}
+					/* flow arrival and flow size are no block sizes */
+					if (typechar == 'a' || typechar == 'f')
+						continue;
 					/* sanity check for max block size */
 					for (int i = 0; i < 2; i++) {
 						if (distr == CONSTANT && cflow[id].settings[i].maximum_block_size < param1)
@@ -2188,8 +3358,21 @@ static void parse_trafgen_option(char *params, int current_flow_ids[], int id)
 					cflow[current_flow_ids[id]].settings[i].interpacket_gap_trafgen_options.param_one = param1;
 					cflow[current_flow_ids[id]].settings[i].interpacket_gap_trafgen_options.param_two = param2;
 					break;
+				case 'a':
+					cflow[current_flow_ids[id]].settings[i].flow_arrival_trafgen_options.distribution = distr;
+					cflow[current_flow_ids[id]].settings[i].flow_arrival_trafgen_options.param_one = param1;
+					cflow[current_flow_ids[id]].settings[i].flow_arrival_trafgen_options.param_two = param2;
+					break;
+				case 'f':
+					cflow[current_flow_ids[id]].settings[i].flow_size_trafgen_options.distribution = distr;
+					cflow[current_flow_ids[id]].settings[i].flow_size_trafgen_options.param_one = param1;
+					cflow[current_flow_ids[id]].settings[i].flow_size_trafgen_options.param_two = param2;
+					break;
 				}
 			}
+			/* flow arrival and flow size are no block sizes */
+			if (typechar == 'a' || typechar == 'f')
+				continue;
 			/* sanity check for max block size */
 			for (int i = 0; i < 2; i++) {
 				if (distr == CONSTANT && cflow[id].settings[i].maximum_block_size < param1)
@@ -2209,6 +3392,7 @@ static void parse_flow_option(int ch, char* optarg, int current_flow_ids[], int
 	int rc = 0;
 	unsigned optunsigned = 0;
 	double optdouble = 0.0;
+	char unit = 0, amount_type = 0;
 	/* only for validity check of addresses */
 	struct sockaddr_in6 source_in6;
 	source_in6.sin6_family = AF_INET6;
@@ -2465,6 +3649,7 @@ static void parse_flow_option(int ch, char* optarg, int current_flow_ids[], int
 				     "endpoint");
 				usage(EXIT_FAILURE);
 			}
+			SHOW_COLUMNS(COL_PACING);
 			ASSIGN_UNI_FLOW_SETTING(write_rate_str, arg)
 			break;
 		case 'S':
@@ -2512,6 +3697,187 @@ static void parse_flow_option(int ch, char* optarg, int current_flow_ids[], int
 			}
 			ASSIGN_UNI_FLOW_SETTING(delay[WRITE], optdouble)
 			break;
+		case 'Z':
+			rc = sscanf(arg, "%lf%c%c", &optdouble, &unit,
+				    &amount_type);
+			if (rc < 1 || optdouble <= 0) {
+				errx("amount of data must be a positive number");
+				usage(EXIT_FAILURE);
+			}
+			/* the unit is optional, e.g. 8200B or 100o */
+			if (unit == 'B' || unit == 'o') {
+				if (rc == 3) {
+					errx("illegal unit specifier in amount "
+					     "of data");
+					usage(EXIT_FAILURE);
+				}
+				amount_type = unit;
+				unit = 0;
+			}
+			switch (unit) {
+			case 0:
+			case 'z':
+				break;
+			case 'k':
+				optdouble *= 1<<10;
+				break;
+			case 'M':
+				optdouble *= 1<<20;
+				break;
+			case 'G':
+				optdouble *= 1<<30;
+				break;
+			default:
+				errx("illegal unit specifier in amount of data");
+				usage(EXIT_FAILURE);
+			}
+			switch (amount_type) {
+			case 0:
+			case 'B':
+				if (optdouble < MIN_BLOCK_SIZE) {
+					errx("amount of data must be at least "
+					     "the %d bytes of a block header",
+					     MIN_BLOCK_SIZE);
+					usage(EXIT_FAILURE);
+				}
+				ASSIGN_UNI_FLOW_SETTING(write_bytes, optdouble)
+				ASSIGN_UNI_FLOW_SETTING(write_blocks, 0)
+				break;
+			case 'o':
+				ASSIGN_UNI_FLOW_SETTING(write_blocks, optdouble)
+				ASSIGN_UNI_FLOW_SETTING(write_bytes, 0)
+				break;
+			default:
+				errx("illegal type specifier (either byte or "
+				     "block) in amount of data");
+				usage(EXIT_FAILURE);
+			}
+			/* flow is limited by amount, not by time */
+			ASSIGN_UNI_FLOW_SETTING(duration[WRITE], -1)
+			break;
+		case PACING_BURST_OPTION:
+			rc = sscanf(arg, "%u", &optunsigned);
+			if (rc != 1 || !optunsigned || optunsigned > INT_MAX) {
+				errx("pacing burst must be a positive integer "
+				     "(in bytes)");
+				usage(EXIT_FAILURE);
+			}
+			ASSIGN_UNI_FLOW_SETTING(pacing_burst, optunsigned)
+			break;
+		case KERNEL_PACING_OPTION:
+			ASSIGN_UNI_FLOW_SETTING(kernel_pacing, 1)
+			break;
+		case PIPELINE_OPTION:
+			rc = sscanf(arg, "%u", &optunsigned);
+			if (rc != 1 || !optunsigned || optunsigned > INT_MAX) {
+				errx("pipeline depth must be a positive "
+				     "integer");
+				usage(EXIT_FAILURE);
+			}
+			ASSIGN_UNI_FLOW_SETTING(pipeline_depth, optunsigned)
+			break;
+		case WRITE_BATCH_OPTION:
+			rc = sscanf(arg, "%u", &optunsigned);
+			if (rc != 1 || !optunsigned ||
+			    optunsigned > MAX_WRITE_BATCH) {
+				errx("write batch must be an integer between 1 "
+				     "and %d", MAX_WRITE_BATCH);
+				usage(EXIT_FAILURE);
+			}
+			ASSIGN_UNI_FLOW_SETTING(write_batch, optunsigned)
+			break;
+		case TRACE_OPTION:
+			{
+			char *file = strtok_r(arg, ":", &arg);
+			char *pos = strtok_r(NULL, ":", &arg);
+			char *loop = strtok_r(NULL, ":", &arg);
+			int sample = pos && !strcmp(pos, "sample");
+
+			if (!file || strlen(file) >=
+			    sizeof(cflow[0].settings[0].trace_file)) {
+				errx("malformed trace file name");
+				usage(EXIT_FAILURE);
+			}
+			/* sampling has no start position and never ends */
+			if (sample) {
+				if (loop) {
+					errx("malformed option '--trace'");
+					usage(EXIT_FAILURE);
+				}
+				pos = NULL;
+			}
+			/* 'loop' may be given without a start position */
+			if (pos && !loop && !strcmp(pos, "loop")) {
+				loop = pos;
+				pos = NULL;
+			}
+			if (!pos) {
+				optdouble = 0.0;
+			} else if (!strcmp(pos, "spread")) {
+				/* resolved in the sanity checks */
+				optdouble = -1.0;
+			} else {
+				rc = sscanf(pos, "%lf", &optdouble);
+				if (rc != 1 || optdouble < 0 || optdouble >= 1) {
+					errx("trace start position must be "
+					     "within [0,1) or 'spread'");
+					usage(EXIT_FAILURE);
+				}
+			}
+			if (loop && strcmp(loop, "loop")) {
+				errx("malformed option '--trace'");
+				usage(EXIT_FAILURE);
+			}
+			ASSIGN_UNI_FLOW_SETTING_STR(trace_file, file)
+			ASSIGN_UNI_FLOW_SETTING(trace_start, optdouble)
+			ASSIGN_UNI_FLOW_SETTING(trace_loop, loop ? 1 : 0)
+			ASSIGN_UNI_FLOW_SETTING(trace_sample, sample)
+			break;
+			}
+		case PAYLOAD_OPTION:
+			{
+			char *kind = strtok_r(arg, ":", &arg);
+			char *param = arg;
+			enum payload_type payload;
+
+			optdouble = 0.0;
+			if (!kind) {
+				errx("malformed option '--payload'");
+				usage(EXIT_FAILURE);
+			} else if (!strcmp(kind, "zero")) {
+				payload = PAYLOAD_ZERO;
+			} else if (!strcmp(kind, "random")) {
+				payload = PAYLOAD_RANDOM;
+			} else if (!strcmp(kind, "compress")) {
+				payload = PAYLOAD_COMPRESSIBLE;
+				rc = param ? sscanf(param, "%lf", &optdouble) : 0;
+				if (rc != 1 || optdouble < 1) {
+					errx("compression ratio must be at "
+					     "least 1");
+					usage(EXIT_FAILURE);
+				}
+				param = NULL;
+			} else if (!strcmp(kind, "file")) {
+				payload = PAYLOAD_FILE;
+				if (!param || !*param || strlen(param) >=
+				    sizeof(cflow[0].settings[0].payload_file)) {
+					errx("malformed payload file name");
+					usage(EXIT_FAILURE);
+				}
+				ASSIGN_UNI_FLOW_SETTING_STR(payload_file, param)
+				param = NULL;
+			} else {
+				errx("unknown payload '%s'", kind);
+				usage(EXIT_FAILURE);
+			}
+			if (param && *param) {
+				errx("malformed option '--payload'");
+				usage(EXIT_FAILURE);
+			}
+			ASSIGN_UNI_FLOW_SETTING(payload, payload)
+			ASSIGN_UNI_FLOW_SETTING(payload_ratio, optdouble)
+			break;
+			}
 		}
 	}
 }
@@ -2526,13 +3892,15 @@ static void parse_colon_option(char *optarg)
 {
 	/* To make it easy (independed of default values), hide all colons */
 	HIDE_COLUMNS(COL_BEGIN, COL_END, COL_THROUGH, COL_TRANSAC,
-		     COL_BLOCK_REQU, COL_BLOCK_RESP, COL_RTT_MIN, COL_RTT_AVG,
+		     COL_PACING, COL_CPU, COL_CPB, COL_BLOCK_REQU, COL_BLOCK_RESP, COL_RTT_MIN, COL_RTT_AVG,
 		     COL_RTT_MAX, COL_IAT_MIN, COL_IAT_AVG, COL_IAT_MAX,
 		     COL_DLY_MIN, COL_DLY_AVG, COL_DLY_MAX, COL_TCP_CWND,
 		     COL_TCP_SSTH, COL_TCP_UACK, COL_TCP_SACK, COL_TCP_LOST,
 		     COL_TCP_RETR, COL_TCP_TRET, COL_TCP_FACK, COL_TCP_REOR,
 		     COL_TCP_BKOF, COL_TCP_RTT, COL_TCP_RTTVAR, COL_TCP_RTO,
-		     COL_TCP_CA_STATE, COL_SMSS, COL_PMTU);
+		     COL_TCP_CA_STATE, COL_SMSS, COL_PMTU, COL_TCP_BUSY,
+		     COL_TCP_LIMIT, COL_TCP_DLVR, COL_TCP_PRATE, COL_TCP_MINRTT,
+		     COL_TCP_NOTSENT);
 #ifdef DEBUG
 	HIDE_COLUMNS(COL_STATUS);
 #endif /* DEBUG */
@@ -2546,6 +3914,10 @@ static void parse_colon_option(char *optarg)
 			SHOW_COLUMNS(COL_THROUGH);
 		} else if (!strcmp(token, "transac")) {
 			SHOW_COLUMNS(COL_TRANSAC);
+		} else if (!strcmp(token, "pacing")) {
+			SHOW_COLUMNS(COL_PACING);
+		} else if (!strcmp(token, "cpu")) {
+			SHOW_COLUMNS(COL_CPU, COL_CPB);
 		} else if (!strcmp(token, "blocks")) {
 			SHOW_COLUMNS(COL_BLOCK_REQU, COL_BLOCK_RESP);
 		} else if (!strcmp(token, "rtt")) {
@@ -2561,6 +3933,10 @@ static void parse_colon_option(char *optarg)
 				     COL_TCP_BKOF, COL_TCP_RTT, COL_TCP_RTTVAR,
 				     COL_TCP_RTO, COL_TCP_CA_STATE, COL_SMSS,
 				     COL_PMTU);
+		} else if (!strcmp(token, "limit")) {
+			SHOW_COLUMNS(COL_TCP_BUSY, COL_TCP_LIMIT, COL_TCP_DLVR,
+				     COL_TCP_PRATE, COL_TCP_MINRTT,
+				     COL_TCP_NOTSENT);
 #ifdef DEBUG
 		} else if (!strcmp(token, "status")) {
 			SHOW_COLUMNS(COL_STATUS);
@@ -2605,6 +3981,15 @@ static void parse_cmdline(int argc, char *argv[]) {
 		{"dump-prefix", required_argument, 0, 'e'},
 		{"report-interval", required_argument, 0, 'i'},
 		{"log-file", optional_argument, 0, LOG_FILE_OPTION},
+		{"ramp", required_argument, 0, RAMP_OPTION},
+		{"trace", required_argument, 0, TRACE_OPTION},
+		{"payload", required_argument, 0, PAYLOAD_OPTION},
+		{"ramp-limit", required_argument, 0, RAMP_LIMIT_OPTION},
+		{"daemon-stats", no_argument, 0, DAEMON_STATS_OPTION},
+		{"pacing-burst", required_argument, 0, PACING_BURST_OPTION},
+		{"kernel-pacing", required_argument, 0, KERNEL_PACING_OPTION},
+		{"pipeline", required_argument, 0, PIPELINE_OPTION},
+		{"write-batch", required_argument, 0, WRITE_BATCH_OPTION},
 		{"flows", required_argument, 0, 'n'},
 		{"quite",no_argument, 0, 'q'},
 		{"tcp-stack", required_argument, 0, 's'},
@@ -2614,10 +3999,10 @@ static void parse_cmdline(int argc, char *argv[]) {
 	/* short options */
 #ifdef DEBUG
 	static const char *short_opt = "hvc:de:i:mn:opqs:w"
-		"A:B:CD:EF:G:H:IJ:LNM:O:P:QR:S:T:U:W:Y:";
+		"A:B:CD:EF:G:H:IJ:LNM:O:P:QR:S:T:U:W:Y:Z:";
 #else
 	static const char *short_opt = "hvc:e:i:mn:opqs:w"
-		"A:B:CD:EF:G:H:IJ:LNM:O:P:QR:S:T:U:W:Y:";
+		"A:B:CD:EF:G:H:IJ:LNM:O:P:QR:S:T:U:W:Y:Z:";
 #endif /* DEBUG */
 
 	/* variables from getopt() */
@@ -2670,6 +4055,9 @@ static void parse_cmdline(int argc, char *argv[]) {
 				usage(EXIT_FAILURE);
 			}
 			break;
+		case DAEMON_STATS_OPTION:
+			copt.daemon_stats = true;
+			break;
 		case LOG_FILE_OPTION:
 			copt.log_to_file = true;
 			if (optarg)
@@ -2716,6 +4104,44 @@ static void parse_cmdline(int argc, char *argv[]) {
 		case 'w':
 			copt.log_to_file = true;
 			break;
+		case RAMP_OPTION:
+			{
+			char mode[10];
+
+			rc = sscanf(optarg, "%9[^,],%lf,%u", mode,
+				    &copt.ramp_max, &copt.ramp_steps);
+			if (rc < 2 || copt.ramp_max <= 1.0) {
+				errx("malformed option '--ramp'");
+				usage(EXIT_FAILURE);
+			}
+			if (!strcmp(mode, "linear")) {
+				copt.ramp_mode = RAMP_LINEAR;
+			} else if (!strcmp(mode, "binary")) {
+				copt.ramp_mode = RAMP_BINARY;
+			} else {
+				errx("invalid ramp mode '%s'", mode);
+				usage(EXIT_FAILURE);
+			}
+			if (rc == 2)
+				copt.ramp_steps =
+					copt.ramp_mode == RAMP_LINEAR ? 10 : 8;
+			if (!copt.ramp_steps ||
+			    copt.ramp_steps > RAMP_MAX_STEPS) {
+				errx("number of ramp steps must be within "
+				     "[1..%d]", RAMP_MAX_STEPS);
+				usage(EXIT_FAILURE);
+			}
+			break;
+			}
+		case RAMP_LIMIT_OPTION:
+			rc = sscanf(optarg, "%lf,%lf", &copt.ramp_rtt_limit,
+				    &copt.ramp_retr_limit);
+			if (rc < 1 || copt.ramp_rtt_limit < 0 ||
+			    (rc == 2 && copt.ramp_retr_limit < 0)) {
+				errx("malformed option '--ramp-limit'");
+				usage(EXIT_FAILURE);
+			}
+			break;
 
 		/* flow options w/o endpoint identifier */
 		case 'E':
@@ -2781,6 +4207,13 @@ static void parse_cmdline(int argc, char *argv[]) {
 		case 'U':
 		case 'W':
 		case 'Y':
+		case 'Z':
+		case PACING_BURST_OPTION:
+		case KERNEL_PACING_OPTION:
+		case PIPELINE_OPTION:
+		case WRITE_BATCH_OPTION:
+		case TRACE_OPTION:
+		case PAYLOAD_OPTION:
 			parse_flow_option(ch, optarg, current_flow_ids, id-1);
 			break;
 
@@ -2862,6 +4295,29 @@ static void parse_cmdline(int argc, char *argv[]) {
 			      "for flow %d", id);
 			sanity_err = true;
 		}
+		if (cflow[id].settings[DESTINATION].flow_arrival_trafgen_options.param_one ||
+		    cflow[id].settings[DESTINATION].flow_size_trafgen_options.param_one) {
+			warnx("dynamic flow arrival is only supported at the "
+			      "source of flow %d", id);
+			sanity_err = true;
+		}
+		if (!cflow[id].settings[SOURCE].flow_arrival_trafgen_options.param_one !=
+		    !cflow[id].settings[SOURCE].flow_size_trafgen_options.param_one) {
+			warnx("flow %d needs both flow arrival and flow size "
+			      "for dynamic flow arrival", id);
+			sanity_err = true;
+		}
+		if (cflow[id].settings[SOURCE].flow_arrival_trafgen_options.param_one &&
+		    cflow[id].settings[SOURCE].duration[WRITE] <= 0) {
+			warnx("dynamic flow arrival of flow %d needs a positive "
+			      "flow duration", id);
+			sanity_err = true;
+		}
+		if (cflow[id].settings[SOURCE].flow_arrival_trafgen_options.param_one < 0) {
+			warnx("dynamic flow arrival of flow %d needs a positive "
+			      "interarrival time", id);
+			sanity_err = true;
+		}
 
 		cflow[id].settings[SOURCE].duration[READ] = cflow[id].settings[DESTINATION].duration[WRITE];
 		cflow[id].settings[DESTINATION].duration[READ] = cflow[id].settings[SOURCE].duration[WRITE];
@@ -2949,6 +4405,48 @@ static void parse_cmdline(int argc, char *argv[]) {
 				cflow[id].settings[i].write_rate = optdouble;
 
 			}
+			if ((cflow[id].settings[i].pacing_burst ||
+			     cflow[id].settings[i].kernel_pacing) &&
+			    !cflow[id].settings[i].write_rate_str) {
+				warnx("flow %d has pacing options but no "
+				      "rate.", id);
+				sanity_err = true;
+			}
+			if (cflow[id].settings[i].pipeline_depth &&
+			    !cflow[id].settings[i].response_trafgen_options.param_one &&
+			    !*cflow[id].settings[i].trace_file) {
+				warnx("flow %d has a pipeline depth but "
+				      "requests no responses.", id);
+				sanity_err = true;
+			}
+			if (*cflow[id].settings[i].trace_file) {
+				if ((cflow[id].settings[i].write_rate_str &&
+				     !cflow[id].settings[i].trace_sample) ||
+				    cflow[id].settings[i].flow_arrival_trafgen_options.param_one) {
+					warnx("trace replay of flow %d can not "
+					      "be combined with a rate or "
+					      "dynamic flow arrival", id);
+					sanity_err = true;
+				}
+				/* flows start at equidistant positions */
+				if (cflow[id].settings[i].trace_start < 0)
+					cflow[id].settings[i].trace_start =
+						(double)id / copt.num_flows;
+			}
+			if (cflow[id].settings[i].payload != PAYLOAD_ZERO &&
+			    cflow[id].byte_counting) {
+				warnx("flow %d can not enumerate bytes with a "
+				      "generated payload.", id);
+				sanity_err = true;
+			}
+			if (cflow[id].settings[i].payload != PAYLOAD_ZERO &&
+			    cflow[id].settings[i].maximum_block_size >
+			    PAYLOAD_POOL_SIZE) {
+				warnx("flow %d has blocks larger than the %d "
+				      "bytes of a generated payload.", id,
+				      PAYLOAD_POOL_SIZE);
+				sanity_err = true;
+			}
 			if (cflow[id].settings[i].flow_control && !cflow[id].settings[i].write_rate_str) {
 				warnx("flow %d has flow control enabled but no "
 				      "rate.", id);
@@ -2962,6 +4460,11 @@ static void parse_cmdline(int argc, char *argv[]) {
 		}
 	}
 
+	if (copt.ramp_mode && !max_flow_rate) {
+		warnx("ramp mode requires a rate limited flow (option -R)");
+		sanity_err = true;
+	}
+
 	if (sanity_err) {
 #ifdef DEBUG
 		DEBUG_MSG(LOG_ERR, "Skipping errors discovered by sanity checks.");
@@ -2990,6 +4493,7 @@ int main(int argc, char *argv[])
 	init_flow_options();
 	parse_cmdline(argc, argv);
 	open_logfile();
+	start_output_thread();
 	prepare_xmlrpc_client(&rpc_client);
 
 	DEBUG_MSG(LOG_WARNING, "check flowgrindds versions");
@@ -3000,21 +4504,29 @@ int main(int argc, char *argv[])
 	if (!sigint_caught)
 		check_idle(rpc_client);
 
-	DEBUG_MSG(LOG_WARNING, "prepare flows");
-	if (!sigint_caught)
-		prepare_grinding(rpc_client);
+	if (copt.ramp_mode) {
+		if (!sigint_caught)
+			run_ramp(rpc_client);
+	} else {
+		DEBUG_MSG(LOG_WARNING, "prepare flows");
+		if (!sigint_caught)
+			prepare_grinding(rpc_client);
 
-	DEBUG_MSG(LOG_WARNING, "start flows");
-	if (!sigint_caught)
-		grind_flows(rpc_client);
+		DEBUG_MSG(LOG_WARNING, "start flows");
+		if (!sigint_caught)
+			grind_flows(rpc_client);
 
-	DEBUG_MSG(LOG_WARNING, "close flows");
-	close_flows();
+		DEBUG_MSG(LOG_WARNING, "close flows");
+		close_flows();
 
-	DEBUG_MSG(LOG_WARNING, "report final");
-	fetch_reports(rpc_client);
-	report_final();
+		DEBUG_MSG(LOG_WARNING, "report final");
+		fetch_reports(rpc_client);
+		report_final();
+		if (copt.daemon_stats)
+			report_daemon_stats(rpc_client);
+	}
 
+	stop_output_thread();
 	close_logfile();
 
 	xmlrpc_client_destroy(rpc_client);
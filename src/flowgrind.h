@@ -31,6 +31,7 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <limits.h>
 
@@ -59,6 +60,48 @@ enum tcp_stack {
 	BYTE_BASED
 };
 
+/** Size of the buffer the output thread collects output in, in bytes */
+#define OUTPUT_BUFFER_SIZE 65536
+
+/** Maximum number of reports and messages queued for the output thread */
+#define OUTPUT_QUEUE_SIZE 4096
+
+/** Size of a row of an interval report, in bytes. Longer rows are cut off */
+#define REPORT_ROW_SIZE 4096
+
+/** Number of time requests per daemon to estimate its clock offset. The
+ * request with the shortest round-trip time is used */
+#define CLOCK_PROBES 8
+
+/** Minimum time in seconds between the start command and the common start
+ * of the flows on all daemons */
+#define START_LEAD 0.5
+
+/** Points in time the clock offset of the daemons is estimated at */
+enum clock_sync {
+	/** Before the flows start */
+	SYNC_START = 0,
+	/** After the flows ended, to estimate the drift */
+	SYNC_END
+};
+
+/** Maximum number of steps of the ramp (option --ramp) */
+#define RAMP_MAX_STEPS 64
+
+/** A ramp step is saturated if the flows achieve less than this fraction of
+ * their target rate */
+#define RAMP_MIN_ACHIEVED 0.9
+
+/** How the rate of the flows is raised in ramp mode (option --ramp) */
+enum ramp_mode {
+	/** Ramp mode disabled */
+	RAMP_NONE = 0,
+	/** Raise the rate in equidistant steps */
+	RAMP_LINEAR,
+	/** Binary search for the saturation point */
+	RAMP_BINARY
+};
+
 #ifndef __LINUX__
 /** Values for Linux tcpi_state, if not compiled on Linux */
 enum tcp_ca_state {
@@ -86,6 +129,12 @@ enum column_id {
         COL_THROUGH,
         /** Transactions per second */
         COL_TRANSAC,
+        /** Achieved vs. target rate of rate limited flows */
+        COL_PACING,
+        /** CPU utilization of the daemon */
+        COL_CPU,
+        /** CPU cycles per byte of the flow */
+        COL_CPB,
         /** Blocks per second @{ */
         COL_BLOCK_REQU,
         COL_BLOCK_RESP,                                     /** @} */
@@ -118,18 +167,58 @@ enum column_id {
         COL_TCP_CA_STATE,
         COL_SMSS,
         COL_PMTU,                                           /** @} */
+        /** What limited the sender, from newer Linux kernels @{ */
+        COL_TCP_BUSY,
+        COL_TCP_LIMIT,
+        COL_TCP_DLVR,
+        COL_TCP_PRATE,
+        COL_TCP_MINRTT,
+        COL_TCP_NOTSENT,                                    /** @} */
 #ifdef DEBUG
         /** Read / write status */
         COL_STATUS
 #endif /* DEBUG */
 };
 
+/** What limited the sender of a flow endpoint, from the TCP chrono
+ * statistics of the Linux kernel */
+enum sender_limit {
+	/** The application did not give the kernel data to send */
+	LIMIT_APP = 0,
+	/** The receive window of the peer was full */
+	LIMIT_RWND,
+	/** The send buffer was full */
+	LIMIT_SNDBUF,
+	/** Sending data otherwise, limited by the congestion window */
+	LIMIT_CWND,
+	/** Number of limits */
+	NUM_LIMITS
+};
+
 /** For long options with no equivalent short option, use a pseudo short option */
 enum long_opt_only {
 	/** Pseudo short option for option --help */
 	HELP_OPTION = CHAR_MAX + 1,
 	/** Pseudo short option for option --log-file */
-	LOG_FILE_OPTION
+	LOG_FILE_OPTION,
+	/** Pseudo short option for option --pacing-burst */
+	PACING_BURST_OPTION,
+	/** Pseudo short option for option --kernel-pacing */
+	KERNEL_PACING_OPTION,
+	/** Pseudo short option for option --pipeline */
+	PIPELINE_OPTION,
+	/** Pseudo short option for option --write-batch */
+	WRITE_BATCH_OPTION,
+	/** Pseudo short option for option --trace */
+	TRACE_OPTION,
+	/** Pseudo short option for option --payload */
+	PAYLOAD_OPTION,
+	/** Pseudo short option for option --ramp */
+	RAMP_OPTION,
+	/** Pseudo short option for option --ramp-limit */
+	RAMP_LIMIT_OPTION,
+	/** Pseudo short option for option --daemon-stats */
+	DAEMON_STATS_OPTION
 };
 
 /** Controller options */
@@ -154,6 +243,21 @@ struct _controller_options {
 	bool symbolic;
 	/** Force kernel output to specific unit  (option -s) */
 	enum tcp_stack force_unit;
+	/** Raise the rate of the flows step by step (option --ramp) */
+	enum ramp_mode ramp_mode;
+	/** Highest rate of the ramp as multiple of the given rate */
+	double ramp_max;
+	/** Maximum number of steps of the ramp */
+	unsigned int ramp_steps;
+	/** Saturation threshold for the 95th percentile of the RTT, in
+	 * milliseconds. 0 for twice the RTT of the first step */
+	double ramp_rtt_limit;
+	/** Saturation threshold for the average number of retransmitted
+	 * segments, negative if not checked (option --ramp-limit) */
+	double ramp_retr_limit;
+	/** Report the event loop counters of the daemons (option
+	 * --daemon-stats) */
+	bool daemon_stats;
 };
 
 /** Infos about a flowgrind daemon */
@@ -171,6 +275,19 @@ struct _daemon {
 	char os_name[257];
 	/** Release number of the OS */
 	char os_release[257];
+	/** Offset of the daemon's clock to the clock of the controller, in
+	 * seconds */
+	double clock_offset[2];
+	/** Error bound of the clock offset, in seconds */
+	double clock_error[2];
+	/** Point in time the clock offset was estimated at, zero if the
+	 * offset is unknown */
+	struct timespec clock_sync[2];
+	/** True if the event loop counters at the start of the flows are
+	 * known (option --daemon-stats) */
+	bool has_stats;
+	/** Event loop counters of the daemon at the start of the flows */
+	struct _daemon_stats stats;
 };
 
 /** Infos about the flow endpoint */
@@ -220,6 +337,34 @@ struct _cflow {
 	char finished[2];
 	/** Final report from the daemon */
 	struct _report *final_report[2];
+	/** Rate given by option -R, scaled at each step of the ramp */
+	int ramp_base_rate[2];
+};
+
+/** Completion time of a flow (option -Z or dynamic flow arrival) */
+struct _fct_sample {
+	/** Amount of data transferred by the flow, in bytes */
+	double size;
+	/** Flow completion time, in seconds */
+	double fct;
+};
+
+/** Result of a single step of the ramp (option --ramp) */
+struct _ramp_step {
+	/** Rate of the flows as multiple of the given rate */
+	double factor;
+	/** Aggregated target rate, in bytes per second */
+	double target;
+	/** Aggregated achieved rate, in bytes per second */
+	double achieved;
+	/** Median of the kernel RTT, in milliseconds */
+	double rtt_p50;
+	/** 95th percentile of the kernel RTT, in milliseconds */
+	double rtt_p95;
+	/** Average number of retransmitted segments */
+	double retr;
+	/** Latency or loss crossed its threshold at this step */
+	bool saturated;
 };
 
 /** Header of an intermediated interval report column */
@@ -238,6 +383,19 @@ struct _column_state {
         unsigned int oversized;
         /** Last width of the column */
         unsigned int last_width;
+        /** Number of digits before the comma of the last value, 0 if none */
+        int digits;
+        /** Range of values with the same number of digits */
+        double digits_min, digits_max;
+};
+
+/** Row of the interval report being built */
+struct _row {
+        /** End of the row */
+        char *pos;
+        /** Space left in the buffer of the row, including the terminating
+         * null byte */
+        size_t left;
 };
 
 /** Intermediated interval report column */
@@ -250,4 +408,47 @@ struct _column {
         struct _column_state state;
 };
 
+/** Interval report together with the values of its flow it is formatted
+ * with, which may change until the output thread gets to it */
+struct _queued_report {
+        /** Flow and endpoint of the report */
+        int id;
+        int endpoint;
+        /** First report of the endpoint, the columns are relative to it */
+        struct timespec start;
+        /** Target rate of the endpoint (option -R) */
+        double write_rate;
+        /** Endpoint finished already */
+        bool finished;
+        struct _report report;
+};
+
+/** Item of the output queue, either a report or text */
+struct _output_item {
+        struct _output_item *next;
+        /** Text to be written, NULL for a report */
+        char *text;
+        struct _queued_report report;
+};
+
+/** Measurement output handed from the controller to the output thread.
+ * The thread formats the queued reports and writes them out together with
+ * the queued text, in order */
+struct _output {
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        /** Signals queued items to the thread and room in the queue back */
+        pthread_cond_t cond;
+        /** True while the output thread is running */
+        bool running;
+        /** Set to let the thread exit once all items are written */
+        bool stop;
+
+        /** Queued items, oldest first @{ */
+        struct _output_item *head;
+        struct _output_item *tail;                              /** @} */
+        /** Number of queued items */
+        unsigned int queued;
+};
+
 #endif /* _FLOWGRIND_H_ */
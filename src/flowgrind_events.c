@@ -0,0 +1,195 @@
+/**
+ * @file flowgrind_events.c
+ * @brief Utility to convert event logs of the Flowgrind daemon to CSV
+ */
+
+/*
+ * This file is part of Flowgrind. Flowgrind is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General
+ * Public License version 2 as published by the Free Software Foundation.
+ *
+ * Flowgrind distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "fg_error.h"
+#include "fg_events.h"
+#include "fg_progname.h"
+
+/** Number of records read with a single call */
+#define READ_BATCH 4096
+
+/* External global variables */
+extern const char *progname;
+
+/* Forward declarations */
+static void usage(short status) __attribute__((noreturn));
+
+static const char *event_names[] = {
+	[EVENT_REQUEST_WRITTEN] = "request_written",
+	[EVENT_RESPONSE_WRITTEN] = "response_written",
+	[EVENT_REQUEST_READ] = "request_read",
+	[EVENT_RESPONSE_READ] = "response_read",
+	[EVENT_LOST] = "lost",
+};
+
+/**
+ * Print flowgrind-events usage and exit
+ */
+static void usage(short status)
+{
+	/* Syntax error. Emit 'try help' to stderr and exit */
+	if (status != EXIT_SUCCESS) {
+		fprintf(stderr, "Try '%s -h' for more information\n", progname);
+		exit(status);
+	}
+
+	fprintf(stderr,
+		"Usage: %1$s [OPTION]... FILE...\n"
+		"Convert event logs of flowgrindd (option -e) to CSV on standard output.\n\n"
+
+		"Mandatory arguments to long options are mandatory for short options too.\n"
+		"  -h, --help     display this help and exit\n"
+		"  -v, --version  print version information and exit\n\n"
+
+		"Example:\n"
+		"   %1$s /tmp/events.bin > events.csv\n",
+		progname);
+	exit(EXIT_SUCCESS);
+}
+
+static inline unsigned long long join_u32(uint32_t high, uint32_t low)
+{
+	return ((unsigned long long)ntohl(high) << 32) + ntohl(low);
+}
+
+/* Print a point in time or duration in nanoseconds as seconds, nothing if
+ * it does not apply to the event */
+static void print_time(unsigned long long ns, int known)
+{
+	if (known)
+		printf(",%llu.%09llu", ns / 1000000000ULL, ns % 1000000000ULL);
+	else
+		printf(",");
+}
+
+static int convert(const char *path)
+{
+	static struct _event_record records[READ_BATCH];
+	char magic[sizeof(EVENT_MAGIC) - 1];
+	unsigned long long lost = 0;
+	size_t n;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (!file) {
+		warn("could not open %s", path);
+		return -1;
+	}
+	if (fread(magic, sizeof(magic), 1, file) != 1 ||
+	    memcmp(magic, EVENT_MAGIC, sizeof(magic))) {
+		warnx("%s is not an event log", path);
+		fclose(file);
+		return -1;
+	}
+
+	while ((n = fread(records, sizeof(struct _event_record), READ_BATCH,
+			  file))) {
+		for (size_t i = 0; i < n; i++) {
+			const struct _event_record *r = &records[i];
+			uint32_t type = ntohl(r->type);
+
+			if (type == EVENT_LOST)
+				lost += ntohl(r->size);
+			printf("%u,%s,%u", ntohl(r->flow_id),
+			       type <= EVENT_LOST ? event_names[type] :
+			       "unknown", ntohl(r->size));
+			print_time(join_u32(r->sent_high, r->sent_low),
+				   type != EVENT_LOST);
+			print_time(join_u32(r->received_high, r->received_low),
+				   type == EVENT_REQUEST_READ ||
+				   type == EVENT_RESPONSE_READ);
+			/* a response read within the clock resolution has a
+			 * round-trip time of zero */
+			print_time(join_u32(r->rtt_high, r->rtt_low),
+				   type == EVENT_RESPONSE_READ);
+			printf("\n");
+		}
+	}
+	if (ferror(file))
+		warn("could not read %s", path);
+	/* the daemon may still be appending to the log */
+	else if ((ftell(file) - sizeof(magic)) % sizeof(struct _event_record))
+		warnx("%s: last record is incomplete", path);
+	if (lost)
+		warnx("%s: %llu events lost by the daemon", path, lost);
+
+	fclose(file);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int rc = EXIT_SUCCESS;
+
+	/* update progname from argv[0] */
+	set_progname(argv[0]);
+
+	/* long options */
+	static const struct option long_opt[] = {
+		{"help", no_argument, 0, 'h'},
+		{"version", no_argument, 0, 'v'},
+		{NULL, 0, NULL, 0}
+	};
+
+	/* short options */
+	static const char *short_opt = "hv";
+
+	/* parse command line */
+	int ch;
+	while ((ch = getopt_long(argc, argv, short_opt, long_opt, NULL)) != -1) {
+		switch (ch) {
+		case 'h':
+			usage(EXIT_SUCCESS);
+			break;
+		case 'v':
+			fprintf(stderr, "%s version: %s\n", progname,
+				FLOWGRIND_VERSION);
+			exit(EXIT_SUCCESS);
+
+		/* unknown option or missing option-argument */
+		case '?':
+			usage(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if (optind == argc) {
+		errx("no event log given");
+		usage(EXIT_FAILURE);
+	}
+
+	printf("flow_id,event,size,sent,received,rtt\n");
+	for (int i = optind; i < argc; i++)
+		if (convert(argv[i]) == -1)
+			rc = EXIT_FAILURE;
+
+	exit(rc);
+}
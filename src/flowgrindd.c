@@ -61,8 +61,12 @@
 #include "daemon.h"
 #include "log.h"
 #include "fg_error.h"
+#include "fg_events.h"
 #include "fg_math.h"
+#include "fg_metrics.h"
+#include "fg_payload.h"
 #include "fg_progname.h"
+#include "fg_reports.h"
 #include "fg_string.h"
 #include "fg_time.h"
 #include "fg_stdlib.h"
@@ -81,6 +85,12 @@ static char *rpc_bind_addr = NULL;
 /* XXX add a brief description doxygen */
 static int cpu = -1;				    /* No CPU affinity */
 
+/** Port of the HTTP metrics endpoint, 0 if disabled (option -m) */
+static unsigned metrics_port = 0;
+
+/** Event log of all blocks, NULL if disabled (option -e) */
+static char *event_log = NULL;
+
 /* External global variables */
 extern const char *progname;
 
@@ -111,7 +121,11 @@ static void usage(short status)
 #else
 		"  -d             don't fork into background\n"
 #endif /* DEBUG */
+		"  -e FILE        record every block written or read to the binary event\n"
+		"                 log FILE, see flowgrind-events(1)\n"
 		"  -h, --help     display this help and exit\n"
+		"  -m #           serve metrics in the Prometheus text format over HTTP\n"
+		"                 on port #, bound to the address of option -b\n"
 		"  -p #           XML-RPC server port\n"
 #ifdef HAVE_LIBPCAP
 		"  -w DIR         target directory for dumps\n"
@@ -143,6 +157,12 @@ static void sighandler(int sig)
 	case SIGPIPE:
 		break;
 
+	/* only intercepted with an event log, exit() writes its remainder */
+	case SIGINT:
+	case SIGTERM:
+		logging_log(LOG_NOTICE, "got signal %d, exiting", sig);
+		exit(EXIT_SUCCESS);
+
 	default:
 		logging_log(LOG_ALERT, "got signal %d, but don't remember "
 				"intercepting it, aborting...", sig);
@@ -199,7 +219,10 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 	char* destination_host = 0;
 	char* cc_alg = 0;
 	char* bind_address = 0;
+	char* trace_file = 0;
+	char* payload_file = 0;
 	xmlrpc_value* extra_options = 0;
+	int write_bytes_high = 0, write_bytes_low = 0;
 
 	struct _flow_settings settings;
 	struct _flow_source_settings source_settings;
@@ -213,13 +236,21 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 		"("
 		"{s:s,*}"
 		"{s:d,s:d,s:d,s:d,s:d,*}"
+		"{s:i,s:i,s:i,*}"
 		"{s:i,s:i,*}"
 		"{s:i,*}"
 		"{s:b,s:b,s:b,s:b,s:b,*}"
 		"{s:i,s:i,*}"
+		"{s:i,s:i,*}" /* pacing */
+		"{s:i,*}" /* pipeline */
+		"{s:i,*}" /* write batch */
 		"{s:i,s:d,s:d,*}" /* request */
 		"{s:i,s:d,s:d,*}" /* response */
 		"{s:i,s:d,s:d,*}" /* interpacket_gap */
+		"{s:i,s:d,s:d,*}" /* flow_arrival */
+		"{s:i,s:d,s:d,*}" /* flow_size */
+		"{s:s,s:d,s:i,s:i,*}" /* trace */
+		"{s:i,s:d,s:s,*}" /* payload */
 		"{s:b,s:b,s:i,s:i,*}"
 		"{s:s,*}"
 		"{s:i,s:i,s:i,s:i,s:i,*}"
@@ -239,6 +270,10 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 		"read_duration", &settings.duration[READ],
 		"reporting_interval", &settings.reporting_interval,
 
+		"write_bytes_high", &write_bytes_high,
+		"write_bytes_low", &write_bytes_low,
+		"write_blocks", &settings.write_blocks,
+
 		"requested_send_buffer_size", &settings.requested_send_buffer_size,
 		"requested_read_buffer_size", &settings.requested_read_buffer_size,
 
@@ -253,6 +288,12 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 		"write_rate", &settings.write_rate,
 		"random_seed",&settings.random_seed,
 
+		"pacing_burst", &settings.pacing_burst,
+		"kernel_pacing", &settings.kernel_pacing,
+
+		"pipeline_depth", &settings.pipeline_depth,
+		"write_batch", &settings.write_batch,
+
 		"traffic_generation_request_distribution", &settings.request_trafgen_options.distribution,
 		"traffic_generation_request_param_one", &settings.request_trafgen_options.param_one,
 		"traffic_generation_request_param_two", &settings.request_trafgen_options.param_two,
@@ -265,6 +306,23 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 		"traffic_generation_gap_param_one", &settings.interpacket_gap_trafgen_options.param_one,
 		"traffic_generation_gap_param_two", &settings.interpacket_gap_trafgen_options.param_two,
 
+		"traffic_generation_flow_arrival_distribution", &settings.flow_arrival_trafgen_options.distribution,
+		"traffic_generation_flow_arrival_param_one", &settings.flow_arrival_trafgen_options.param_one,
+		"traffic_generation_flow_arrival_param_two", &settings.flow_arrival_trafgen_options.param_two,
+
+		"traffic_generation_flow_size_distribution", &settings.flow_size_trafgen_options.distribution,
+		"traffic_generation_flow_size_param_one", &settings.flow_size_trafgen_options.param_one,
+		"traffic_generation_flow_size_param_two", &settings.flow_size_trafgen_options.param_two,
+
+		"trace_file", &trace_file,
+		"trace_start", &settings.trace_start,
+		"trace_loop", &settings.trace_loop,
+		"trace_sample", &settings.trace_sample,
+
+		"payload", &settings.payload,
+		"payload_ratio", &settings.payload_ratio,
+		"payload_file", &payload_file,
+
 		"flow_control", &settings.flow_control,
 		"byte_counting", &settings.byte_counting,
 		"cork", &settings.cork,
@@ -291,10 +349,14 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 	if (env->fault_occurred)
 		goto cleanup;
 
+	settings.write_bytes = ((long long)write_bytes_high << 32) +
+			       (uint32_t)write_bytes_low;
+
 	/* Check for sanity */
 	if (strlen(bind_address) >= sizeof(settings.bind_address) - 1 ||
-		settings.delay[WRITE] < 0 || settings.duration[WRITE] < 0 ||
-		settings.delay[READ] < 0 || settings.duration[READ] < 0 ||
+		settings.delay[WRITE] < 0 || settings.delay[READ] < 0 ||
+		(settings.duration[WRITE] < 0 && !settings.write_bytes &&
+		 !settings.write_blocks) ||
 		settings.requested_send_buffer_size < 0 || settings.requested_read_buffer_size < 0 ||
 		settings.maximum_block_size < MIN_BLOCK_SIZE ||
 		strlen(destination_host) >= sizeof(source_settings.destination_host) - 1||
@@ -304,6 +366,19 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 		xmlrpc_array_size(env, extra_options) != settings.num_extra_socket_options ||
 		settings.dscp < 0 || settings.dscp > 255 ||
 		settings.write_rate < 0 ||
+		settings.pacing_burst < 0 ||
+		settings.pipeline_depth < 0 ||
+		settings.write_batch < 0 ||
+		settings.write_batch > MAX_WRITE_BATCH ||
+		strlen(trace_file) >= sizeof(settings.trace_file) ||
+		settings.trace_start < 0 || settings.trace_start >= 1 ||
+		settings.payload < PAYLOAD_ZERO ||
+		settings.payload > PAYLOAD_FILE ||
+		(settings.payload == PAYLOAD_COMPRESSIBLE &&
+		 settings.payload_ratio < 1) ||
+		(settings.payload != PAYLOAD_ZERO &&
+		 settings.maximum_block_size > PAYLOAD_POOL_SIZE) ||
+		strlen(payload_file) >= sizeof(settings.payload_file) ||
 		settings.reporting_interval < 0) {
 		XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Flow settings incorrect");
 	}
@@ -350,6 +425,8 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 	strcpy(source_settings.destination_host, destination_host);
 	strcpy(settings.cc_alg, cc_alg);
 	strcpy(settings.bind_address, bind_address);
+	strcpy(settings.trace_file, trace_file);
+	strcpy(settings.payload_file, payload_file);
 
 	request = malloc(sizeof(struct _request_add_flow_source));
 	request->settings = settings;
@@ -370,7 +447,7 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 cleanup:
 	if (request)
 		free_all(request->r.error, request);
-	free_all(destination_host, cc_alg, bind_address);
+	free_all(destination_host, cc_alg, bind_address, trace_file, payload_file);
 
 	if (extra_options)
 		xmlrpc_DECREF(extra_options);
@@ -394,7 +471,10 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 	xmlrpc_value *ret = 0;
 	char* cc_alg = 0;
 	char* bind_address = 0;
+	char* trace_file = 0;
+	char* payload_file = 0;
 	xmlrpc_value* extra_options = 0;
+	int write_bytes_high = 0, write_bytes_low = 0;
 
 	struct _flow_settings settings;
 
@@ -407,13 +487,21 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 		"("
 		"{s:s,*}"
 		"{s:d,s:d,s:d,s:d,s:d,*}"
+		"{s:i,s:i,s:i,*}"
 		"{s:i,s:i,*}"
 		"{s:i,*}"
 		"{s:b,s:b,s:b,s:b,s:b,*}"
 		"{s:i,s:i,*}"
+		"{s:i,s:i,*}" /* pacing */
+		"{s:i,*}" /* pipeline */
+		"{s:i,*}" /* write batch */
 		"{s:i,s:d,s:d,*}" /* request */
 		"{s:i,s:d,s:d,*}" /* response */
 		"{s:i,s:d,s:d,*}" /* interpacket_gap */
+		"{s:i,s:d,s:d,*}" /* flow_arrival */
+		"{s:i,s:d,s:d,*}" /* flow_size */
+		"{s:s,s:d,s:i,s:i,*}" /* trace */
+		"{s:i,s:d,s:s,*}" /* payload */
 		"{s:b,s:b,s:i,s:i,*}"
 		"{s:s,*}"
 		"{s:i,s:i,s:i,s:i,s:i,*}"
@@ -432,6 +520,10 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 		"read_duration", &settings.duration[READ],
 		"reporting_interval", &settings.reporting_interval,
 
+		"write_bytes_high", &write_bytes_high,
+		"write_bytes_low", &write_bytes_low,
+		"write_blocks", &settings.write_blocks,
+
 		"requested_send_buffer_size", &settings.requested_send_buffer_size,
 		"requested_read_buffer_size", &settings.requested_read_buffer_size,
 
@@ -446,6 +538,12 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 		"write_rate", &settings.write_rate,
 		"random_seed",&settings.random_seed,
 
+		"pacing_burst", &settings.pacing_burst,
+		"kernel_pacing", &settings.kernel_pacing,
+
+		"pipeline_depth", &settings.pipeline_depth,
+		"write_batch", &settings.write_batch,
+
 		"traffic_generation_request_distribution", &settings.request_trafgen_options.distribution,
 		"traffic_generation_request_param_one", &settings.request_trafgen_options.param_one,
 		"traffic_generation_request_param_two", &settings.request_trafgen_options.param_two,
@@ -458,6 +556,23 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 		"traffic_generation_gap_param_one", &settings.interpacket_gap_trafgen_options.param_one,
 		"traffic_generation_gap_param_two", &settings.interpacket_gap_trafgen_options.param_two,
 
+		"traffic_generation_flow_arrival_distribution", &settings.flow_arrival_trafgen_options.distribution,
+		"traffic_generation_flow_arrival_param_one", &settings.flow_arrival_trafgen_options.param_one,
+		"traffic_generation_flow_arrival_param_two", &settings.flow_arrival_trafgen_options.param_two,
+
+		"traffic_generation_flow_size_distribution", &settings.flow_size_trafgen_options.distribution,
+		"traffic_generation_flow_size_param_one", &settings.flow_size_trafgen_options.param_one,
+		"traffic_generation_flow_size_param_two", &settings.flow_size_trafgen_options.param_two,
+
+		"trace_file", &trace_file,
+		"trace_start", &settings.trace_start,
+		"trace_loop", &settings.trace_loop,
+		"trace_sample", &settings.trace_sample,
+
+		"payload", &settings.payload,
+		"payload_ratio", &settings.payload_ratio,
+		"payload_file", &payload_file,
+
 		"flow_control", &settings.flow_control,
 		"byte_counting", &settings.byte_counting,
 		"cork", &settings.cork,
@@ -479,13 +594,30 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 	if (env->fault_occurred)
 		goto cleanup;
 
+	settings.write_bytes = ((long long)write_bytes_high << 32) +
+			       (uint32_t)write_bytes_low;
+
 	/* Check for sanity */
 	if (strlen(bind_address) >= sizeof(settings.bind_address) - 1 ||
-		settings.delay[WRITE] < 0 || settings.duration[WRITE] < 0 ||
-		settings.delay[READ] < 0 || settings.duration[READ] < 0 ||
+		settings.delay[WRITE] < 0 || settings.delay[READ] < 0 ||
+		(settings.duration[WRITE] < 0 && !settings.write_bytes &&
+		 !settings.write_blocks) ||
 		settings.requested_send_buffer_size < 0 || settings.requested_read_buffer_size < 0 ||
 		settings.maximum_block_size < MIN_BLOCK_SIZE ||
 		settings.write_rate < 0 ||
+		settings.pacing_burst < 0 ||
+		settings.pipeline_depth < 0 ||
+		settings.write_batch < 0 ||
+		settings.write_batch > MAX_WRITE_BATCH ||
+		strlen(trace_file) >= sizeof(settings.trace_file) ||
+		settings.trace_start < 0 || settings.trace_start >= 1 ||
+		settings.payload < PAYLOAD_ZERO ||
+		settings.payload > PAYLOAD_FILE ||
+		(settings.payload == PAYLOAD_COMPRESSIBLE &&
+		 settings.payload_ratio < 1) ||
+		(settings.payload != PAYLOAD_ZERO &&
+		 settings.maximum_block_size > PAYLOAD_POOL_SIZE) ||
+		strlen(payload_file) >= sizeof(settings.payload_file) ||
 		strlen(cc_alg) > TCP_CA_NAME_MAX ||
 		settings.num_extra_socket_options < 0 || settings.num_extra_socket_options > MAX_EXTRA_SOCKET_OPTIONS ||
 		xmlrpc_array_size(env, extra_options) != settings.num_extra_socket_options) {
@@ -533,6 +665,8 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 
 	strcpy(settings.cc_alg, cc_alg);
 	strcpy(settings.bind_address, bind_address);
+	strcpy(settings.trace_file, trace_file);
+	strcpy(settings.payload_file, payload_file);
 	DEBUG_MSG(LOG_WARNING, "bind_address=%s", bind_address);
 	request = malloc(sizeof(struct _request_add_flow_destination));
 	request->settings = settings;
@@ -552,7 +686,7 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 cleanup:
 	if (request)
 		free_all(request->r.error, request);
-	free_all(cc_alg, bind_address);
+	free_all(cc_alg, bind_address, trace_file, payload_file);
 
 	if (extra_options)
 		xmlrpc_DECREF(extra_options);
@@ -574,22 +708,24 @@ static xmlrpc_value * start_flows(xmlrpc_env * const env,
 
 	int rc;
 	xmlrpc_value *ret = 0;
-	int start_timestamp;
+	int start_sec, start_nsec;
 	struct _request_start_flows *request = 0;
 
 	DEBUG_MSG(LOG_WARNING, "Method start_flows called");
 
 	/* Parse our argument array. */
-	xmlrpc_decompose_value(env, param_array, "({s:i,*})",
+	xmlrpc_decompose_value(env, param_array, "({s:i,s:i,*})",
 
 		/* general settings */
-		"start_timestamp", &start_timestamp);
+		"start_timestamp", &start_sec,
+		"start_timestamp_nsec", &start_nsec);
 
 	if (env->fault_occurred)
 		goto cleanup;
 
 	request = malloc(sizeof(struct _request_start_flows));
-	request->start_timestamp = start_timestamp;
+	request->start_timestamp.tv_sec = start_sec;
+	request->start_timestamp.tv_nsec = start_nsec;
 	rc = dispatch_request((struct _request*)request, REQUEST_START_FLOWS);
 
 	if (rc == -1) {
@@ -612,110 +748,6 @@ cleanup:
 	return ret;
 }
 
-static xmlrpc_value * method_get_reports(xmlrpc_env * const env,
-		   xmlrpc_value * const param_array,
-		   void * const user_data)
-{
-	int has_more;
-	xmlrpc_value *ret = 0, *item = 0;
-
-	UNUSED_ARGUMENT(param_array);
-	UNUSED_ARGUMENT(user_data);
-
-	DEBUG_MSG(LOG_NOTICE, "Method get_reports called");
-
-	struct _report *report = get_reports(&has_more);
-
-	ret = xmlrpc_array_new(env);
-
-	/* Add information if there's more reports pending */
-	item = xmlrpc_int_new(env, has_more);
-	xmlrpc_array_append_item(env, ret, item);
-	xmlrpc_DECREF(item);
-
-	while (report) {
-		xmlrpc_value *rv = xmlrpc_build_value(env,
-			"("
-			"{s:i,s:i,s:i,s:i,s:i,s:i}" /* timeval */
-			"{s:i,s:i,s:i,s:i}" /* bytes */
-			"{s:i,s:i,s:i,s:i}" /* block counts */
-			"{s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d}" /* RTT, IAT, Delay */
-			"{s:i,s:i}" /* MTU */
-			"{s:i,s:i,s:i,s:i,s:i}" /* TCP info */
-			"{s:i,s:i,s:i,s:i,s:i}" /* ...      */
-			"{s:i,s:i,s:i,s:i,s:i}" /* ...      */
-			"{s:i}"
-			")",
-
-			"id", report->id,
-			"type", report->type,
-			"begin_tv_sec", (int)report->begin.tv_sec,
-			"begin_tv_nsec", (int)report->begin.tv_nsec,
-			"end_tv_sec", (int)report->end.tv_sec,
-			"end_tv_nsec", (int)report->end.tv_nsec,
-
-			"bytes_read_high", (int32_t)(report->bytes_read >> 32),
-			"bytes_read_low", (int32_t)(report->bytes_read & 0xFFFFFFFF),
-			"bytes_written_high", (int32_t)(report->bytes_written >> 32),
-			"bytes_written_low", (int32_t)(report->bytes_written & 0xFFFFFFFF),
-
-			"request_blocks_read", report->request_blocks_read,
-			"request_blocks_written", report->request_blocks_written,
-			"response_blocks_read", report->response_blocks_read,
-			"response_blocks_written", report->response_blocks_written,
-
-			"rtt_min", report->rtt_min,
-			"rtt_max", report->rtt_max,
-			"rtt_sum", report->rtt_sum,
-			"iat_min", report->iat_min,
-			"iat_max", report->iat_max,
-			"iat_sum", report->iat_sum,
-			"delay_min", report->delay_min,
-			"delay_max", report->delay_max,
-			"delay_sum", report->delay_sum,
-
-			"pmtu", report->pmtu,
-			"imtu", report->imtu,
-
-/* Currently, not all members of the TCP_INFO socket option are used by the
- * FreeBSD kernel. Other members will contain zeroes */
-			"tcpi_snd_cwnd", (int)report->tcp_info.tcpi_snd_cwnd,
-			"tcpi_snd_ssthresh", (int)report->tcp_info.tcpi_snd_ssthresh,
-			"tcpi_unacked", (int)report->tcp_info.tcpi_unacked,
-			"tcpi_sacked", (int)report->tcp_info.tcpi_sacked,
-			"tcpi_lost", (int)report->tcp_info.tcpi_lost,
-			"tcpi_retrans", (int)report->tcp_info.tcpi_retrans,
-			"tcpi_retransmits", (int)report->tcp_info.tcpi_retransmits,
-			"tcpi_fackets", (int)report->tcp_info.tcpi_fackets,
-			"tcpi_reordering", (int)report->tcp_info.tcpi_reordering,
-			"tcpi_rtt", (int)report->tcp_info.tcpi_rtt,
-			"tcpi_rttvar", (int)report->tcp_info.tcpi_rttvar,
-			"tcpi_rto", (int)report->tcp_info.tcpi_rto,
-			"tcpi_backoff", (int)report->tcp_info.tcpi_backoff,
-			"tcpi_ca_state", (int)report->tcp_info.tcpi_ca_state,
-			"tcpi_snd_mss", (int)report->tcp_info.tcpi_snd_mss,
-
-			"status", report->status
-		);
-
-		xmlrpc_array_append_item(env, ret, rv);
-
-		xmlrpc_DECREF(rv);
-
-		struct _report *next = report->next;
-		free(report);
-		report = next;
-	}
-
-	if (env->fault_occurred)
-		logging_log(LOG_WARNING, "Method get_reports failed: %s", env->fault_string);
-	else {
-		DEBUG_MSG(LOG_WARNING, "Method get_reports successful");
-	}
-
-	return ret;
-}
-
 static xmlrpc_value * method_stop_flow(xmlrpc_env * const env,
 		   xmlrpc_value * const param_array,
 		   void * const user_data)
@@ -795,6 +827,29 @@ static xmlrpc_value * method_get_version(xmlrpc_env * const env,
 	return ret;
 }
 
+/* This method returns the wall-clock time of the daemon. The controller
+ * estimates the clock offset between the daemons from it */
+static xmlrpc_value * method_get_time(xmlrpc_env * const env,
+		   xmlrpc_value * const param_array,
+		   void * const user_data)
+{
+	UNUSED_ARGUMENT(param_array);
+	UNUSED_ARGUMENT(user_data);
+	struct timespec now;
+
+	xmlrpc_value *ret = 0;
+
+	gettime(&now);
+	ret = xmlrpc_build_value(env, "{s:i,s:i}",
+				 "sec", (int)now.tv_sec,
+				 "nsec", (int)now.tv_nsec);
+
+	if (env->fault_occurred)
+		logging_log(LOG_WARNING, "Method get_time failed: %s", env->fault_string);
+
+	return ret;
+}
+
 /* This method returns the number of flows and if actual test has started */
 static xmlrpc_value * method_get_status(xmlrpc_env * const env,
 		   xmlrpc_value * const param_array,
@@ -833,6 +888,55 @@ cleanup:
 	return ret;
 }
 
+static xmlrpc_value * method_get_daemon_stats(xmlrpc_env * const env,
+		   xmlrpc_value * const param_array,
+		   void * const user_data)
+{
+	UNUSED_ARGUMENT(param_array);
+	UNUSED_ARGUMENT(user_data);
+
+	int rc;
+	xmlrpc_value *ret = 0;
+	struct _request_get_daemon_stats *request = 0;
+
+	DEBUG_MSG(LOG_WARNING, "Method get_daemon_stats called");
+
+	request = malloc(sizeof(struct _request_get_daemon_stats));
+	rc = dispatch_request((struct _request*)request,
+			      REQUEST_GET_DAEMON_STATS);
+
+	if (rc == -1) {
+		XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, request->r.error); /* goto cleanup on failure */
+	}
+
+	/* Return our result. Counters are sent as doubles, they are exact
+	 * up to 2**53 */
+	ret = xmlrpc_build_value(env,
+		"{s:d,s:d,s:d,s:d,s:d," /* event loop */
+		"s:d,s:d,s:d,s:d}", /* system calls */
+		"loop_iterations", (double)request->stats.loop_iterations,
+		"select_time", request->stats.select_time,
+		"prepare_time", request->stats.prepare_time,
+		"timer_time", request->stats.timer_time,
+		"process_time", request->stats.process_time,
+
+		"syscalls", (double)request->stats.syscalls,
+		"write_eagain", (double)request->stats.write_eagain,
+		"whole_blocks", (double)request->stats.whole_blocks,
+		"split_blocks", (double)request->stats.split_blocks);
+
+cleanup:
+	if (request)
+		free_all(request->r.error, request);
+
+	if (env->fault_occurred)
+		logging_log(LOG_WARNING, "Method get_daemon_stats failed: %s", env->fault_string);
+	else
+		DEBUG_MSG(LOG_WARNING, "Method get_daemon_stats successful");
+
+	return ret;
+}
+
 void create_daemon_thread()
 {
 	int flags;
@@ -851,7 +955,7 @@ void create_daemon_thread()
 		crit("could not start thread");
 }
 
-/* creates listen socket for the xmlrpc server */
+/* creates listen socket for the xmlrpc server and the metrics endpoint */
 static int bind_rpc_server(char *bind_addr, unsigned int port) {
 	int rc;
 	int fd;
@@ -917,6 +1021,8 @@ static void run_rpc_server(xmlrpc_env *env, unsigned int port)
 	xmlrpc_registry_add_method(env, registryP, NULL, "stop_flow", &method_stop_flow, NULL);
 	xmlrpc_registry_add_method(env, registryP, NULL, "get_version", &method_get_version, NULL);
 	xmlrpc_registry_add_method(env, registryP, NULL, "get_status", &method_get_status, NULL);
+	xmlrpc_registry_add_method(env, registryP, NULL, "get_time", &method_get_time, NULL);
+	xmlrpc_registry_add_method(env, registryP, NULL, "get_daemon_stats", &method_get_daemon_stats, NULL);
 
 	/* In the modern form of the Abyss API, we supply parameters in memory
 	   like a normal API.  We select the modern form by setting
@@ -1004,9 +1110,9 @@ static void parse_cmdline(int argc, char *argv[])
 
 	/* short options */
 #ifdef HAVE_LIBPCAP
-	static const char *short_opt = "b:c:dhp:w:v";
+	static const char *short_opt = "b:c:de:hm:p:w:v";
 #else
-	static const char *short_opt = "b:c:dhp:v";
+	static const char *short_opt = "b:c:de:hm:p:v";
 #endif /* HAVE_LIBPCAP */
 
 	/* variables from getopt() */
@@ -1034,9 +1140,18 @@ static void parse_cmdline(int argc, char *argv[])
 			log_type = LOGTYPE_STDERR;
 			increase_debuglevel();
 			break;
+		case 'e':
+			event_log = optarg;
+			break;
 		case 'h':
 			usage(EXIT_SUCCESS);
 			break;
+		case 'm':
+			if (sscanf(optarg, "%u", &metrics_port) != 1) {
+				errx("failed to parse metrics port number");
+				usage(EXIT_FAILURE);
+			}
+			break;
 		case 'p':
 			if (sscanf(optarg, "%u", &port) != 1) {
 				errx("failed to parse port number");
@@ -1076,6 +1191,7 @@ static void parse_cmdline(int argc, char *argv[])
 int main(int argc, char *argv[])
 {
 	struct sigaction sa;
+	sigset_t term;
 
 	xmlrpc_env env;
 
@@ -1095,6 +1211,10 @@ int main(int argc, char *argv[])
 #ifdef HAVE_LIBPCAP
 	fg_pcap_init();
 #endif /* HAVE_LIBPCAP */
+	/* open the log before daemon() changes to the root directory, so
+	 * that a relative path works */
+	if (event_log && events_open(event_log) == -1)
+		critx("could not create event log %s", event_log);
 	if (log_type == LOGTYPE_SYSLOG) {
 		/* Need to call daemon() before creating the thread because
 		 * it internally calls fork() which does not copy threads. */
@@ -1106,7 +1226,31 @@ int main(int argc, char *argv[])
 	if (cpu >= 0)
 		set_affinity(cpu);
 
+	/* the threads feeding the event log must not exit the daemon while
+	 * holding it, so only this thread handles SIGINT and SIGTERM */
+	sigemptyset(&term);
+	sigaddset(&term, SIGINT);
+	sigaddset(&term, SIGTERM);
+	if (event_log) {
+		pthread_sigmask(SIG_BLOCK, &term, NULL);
+		if (events_start() == -1)
+			critx("could not start event log");
+		atexit(events_stop);
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+	}
+
 	create_daemon_thread();
+	pthread_sigmask(SIG_UNBLOCK, &term, NULL);
+
+	if (metrics_port) {
+		int fd = bind_rpc_server(rpc_bind_addr, metrics_port);
+		if (fd == -1 || metrics_init(fd) == -1)
+			critx("could not start metrics endpoint on port %u",
+			      metrics_port);
+		logging_log(LOG_NOTICE, "Serving metrics on port %u",
+			    metrics_port);
+	}
 
 	xmlrpc_env_init(&env);
 
@@ -61,6 +61,7 @@
 #include "fg_socket.h"
 #include "fg_time.h"
 #include "log.h"
+#include "trafgen.h"
 
 void remove_flow(unsigned int i);
 
@@ -166,22 +167,14 @@ int add_flow_source(struct _request_add_flow_source *request)
 
 	flow->settings = request->settings;
 	flow->source_settings = request->source_settings;
-	/* be greedy with buffer sizes */
-	flow->write_block = calloc(1, flow->settings.maximum_block_size);
-	flow->read_block = calloc(1, flow->settings.maximum_block_size);
 
-	if (flow->write_block == NULL || flow->read_block == NULL) {
+	if (alloc_flow_blocks(flow) == -1) {
 		logging_log(LOG_ALERT, "could not allocate memory for read/write blocks");
 		request_error(&request->r, "could not allocate memory for read/write blocks");
 		uninit_flow(flow);
 		num_flows--;
 		return -1;
 	}
-	if (flow->settings.byte_counting) {
-		int byte_idx;
-		for (byte_idx = 0; byte_idx < flow->settings.maximum_block_size; byte_idx++)
-			*(flow->write_block + byte_idx) = (unsigned char)(byte_idx & 0xff);
-	}
 
 	flow->state = GRIND_WAIT_CONNECT;
 	flow->fd = name2socket(flow, flow->source_settings.destination_host,
@@ -197,6 +190,14 @@ int add_flow_source(struct _request_add_flow_source *request)
 		return -1;
 	}
 
+	if (init_trace_replay(flow) == -1 || init_payload(flow) == -1) {
+		request->r.error = flow->error;
+		flow->error = NULL;
+		uninit_flow(flow);
+		num_flows--;
+		return -1;
+	}
+
 	if (set_flow_tcp_options(flow) == -1) {
 		request->r.error = flow->error;
 		flow->error = NULL;
@@ -217,6 +218,15 @@ int add_flow_source(struct _request_add_flow_source *request)
 	}
 #endif /* TCP_CONGESTION */
 
+	/* A template for the dynamic flow arrival process never connects
+	 * itself. The socket was only needed to determine the real settings */
+	if (flow_is_template(flow)) {
+		close(flow->fd);
+		flow->fd = -1;
+		request->flow_id = flow->id;
+		return 0;
+	}
+
 #ifdef HAVE_LIBPCAP
 	fg_pcap_go(flow);
 #endif /* HAVE_LIBPCAP */
@@ -231,3 +241,106 @@ int add_flow_source(struct _request_add_flow_source *request)
 
 	return 0;
 }
+
+int spawn_flow_source(struct _flow *template)
+{
+	struct _flow *flow;
+	struct timespec now;
+
+	if (num_flows >= MAX_FLOWS) {
+		logging_log(LOG_WARNING, "Can not spawn another flow, already "
+			    "handling MAX_FLOW flows.");
+		return -1;
+	}
+
+	flow = &flows[num_flows++];
+	init_flow(flow, 1);
+
+	flow->settings = template->settings;
+	flow->source_settings = template->source_settings;
+
+	/* A spawned flow transfers a sampled amount of data, signals its end
+	 * by shutdown() and completes once the destination closed the
+	 * connection */
+	flow->settings.write_bytes = next_flow_size(template);
+	flow->settings.write_blocks = 0;
+	flow->settings.delay[WRITE] = flow->settings.delay[READ] = 0;
+	flow->settings.duration[WRITE] = flow->settings.duration[READ] = -1;
+	flow->settings.reporting_interval = 0;
+	flow->settings.shutdown = 1;
+	flow->settings.traffic_dump = 0;
+	memset(&flow->settings.flow_arrival_trafgen_options, 0,
+	       sizeof(flow->settings.flow_arrival_trafgen_options));
+
+	if (alloc_flow_blocks(flow) == -1) {
+		logging_log(LOG_ALERT, "could not allocate memory for read/write blocks");
+		goto error;
+	}
+
+	if (init_payload(flow) == -1) {
+		logging_log(LOG_WARNING, "could not generate payload of spawned "
+			    "flow: %s", flow->error);
+		goto error;
+	}
+
+	flow->addr = malloc(template->addr_len);
+	if (flow->addr == NULL) {
+		logging_log(LOG_ALERT, "could not allocate memory for address");
+		goto error;
+	}
+	memcpy(flow->addr, template->addr, template->addr_len);
+	flow->addr_len = template->addr_len;
+
+	flow->fd = socket(flow->addr->sa_family, SOCK_STREAM, IPPROTO_TCP);
+	if (flow->fd == -1) {
+		logging_log(LOG_WARNING, "could not create data socket: %s",
+			    strerror(errno));
+		goto error;
+	}
+	set_window_size_directed(flow->fd,
+				 flow->settings.requested_send_buffer_size,
+				 SO_SNDBUF);
+	set_window_size_directed(flow->fd,
+				 flow->settings.requested_read_buffer_size,
+				 SO_RCVBUF);
+
+	if (set_flow_tcp_options(flow) == -1) {
+		logging_log(LOG_WARNING, "could not set options of spawned "
+			    "flow: %s", flow->error);
+		goto error;
+	}
+
+	if (connect(flow->fd, flow->addr, flow->addr_len) == -1 &&
+	    errno != EINPROGRESS) {
+		logging_log(LOG_WARNING, "connect of spawned flow failed: %s",
+			    strerror(errno));
+		goto error;
+	}
+	flow->connect_called = 1;
+
+	init_math_functions(flow, flow->settings.random_seed ?
+			    flow->settings.random_seed + flow->id : 0);
+	select_block_generator(flow);
+
+	gettime(&now);
+	for (int i = 0; i < 2; i++)
+		flow->start_timestamp[i] = now;
+	flow->next_write_block_timestamp = now;
+	init_pacer(flow);
+	flow->first_report_time = flow->last_report_time = now;
+	flow->next_report_time = now;
+
+	flow->template_id = template->id;
+	template->active_children++;
+
+	DEBUG_MSG(LOG_NOTICE, "spawned flow %d from flow %d, size %llu",
+		  flow->id, template->id,
+		  (unsigned long long)flow->settings.write_bytes);
+
+	return 0;
+
+error:
+	uninit_flow(flow);
+	num_flows--;
+	return -1;
+}
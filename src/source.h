@@ -30,5 +30,6 @@
 #endif /* HAVE_CONFIG_H */
 
 int add_flow_source(struct _request_add_flow_source *request);
+int spawn_flow_source(struct _flow *template);
 
 #endif /* _SOURCE_H_ */
@@ -36,116 +36,297 @@
 #include <string.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/param.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <syslog.h>
+#include <limits.h>
+#include <arpa/inet.h>
 
 #include "daemon.h"
 #include "debug.h"
 #include "fg_math.h"
+#include "fg_stdlib.h"
+#include "fg_trace.h"
 #include "trafgen.h"
 
-#define MAX_RUNS_PER_DISTRIBUTION 10
+/* Next value of a traffic generation parameter, drawn from the distribution
+ * given by @p options truncated to [min,max]. Values are drawn TRAFGEN_BATCH
+ * at a time into the @p ring of the flow */
+static inline double next_value(struct _flow *flow, struct _trafgen_ring *ring,
+				const struct _trafgen_options *options,
+				double min, double max)
+{
+	if (options->distribution == CONSTANT)
+		return MIN(MAX(options->param_one, min), max);
+
+	if (!ring->count) {
+		dist_truncated(flow, options->distribution, options->param_one,
+			       options->param_two, min, max, ring->values,
+			       TRAFGEN_BATCH);
+		ring->count = TRAFGEN_BATCH;
+	}
 
-inline static double calculate(struct _flow *flow, enum distributions type, double param_one, double param_two) {
+	return ring->values[--ring->count];
+}
 
-	double val = 0;
+/* Open addressing hash map counting the records per request and response
+ * size pair. A slot of weight zero is free */
+struct _size_map {
+	uint64_t *pairs;
+	double *weights;
+	/** Number of slots, a power of two */
+	uint64_t size;
+	/** Binary logarithm of the number of slots */
+	unsigned int bits;
+	/** Number of used slots */
+	uint64_t count;
+};
+
+static int size_map_alloc(struct _size_map *map, unsigned int bits)
+{
+	map->size = (uint64_t)1 << bits;
+	map->bits = bits;
+	map->count = 0;
+	map->pairs = malloc(map->size * sizeof(*map->pairs));
+	map->weights = calloc(map->size, sizeof(*map->weights));
+	if (map->pairs && map->weights)
+		return 0;
+	free_all(map->pairs, map->weights);
+	return -1;
+}
 
-	switch (type) {
-		case NORMAL:
-			val = dist_normal (flow, param_one, param_two );
-			DEBUG_MSG(LOG_DEBUG, "calculated normal distribution value %f for parameters %f,%f", val, param_one, param_two);
-		break;
+/* Slot of @p pair, or the free slot the pair belongs to. The upper bits
+ * of the product depend on all bits of the pair (Fibonacci hashing) */
+static uint64_t size_map_slot(const struct _size_map *map, uint64_t pair)
+{
+	uint64_t i = (pair * 0x9e3779b97f4a7c15ULL) >> (64 - map->bits);
 
-		case UNIFORM:
-			val = dist_uniform (flow, param_one, param_two );
-			DEBUG_MSG(LOG_DEBUG, "calculated uniform distribution value %f", val);
-		break;
+	while (map->weights[i] && map->pairs[i] != pair)
+		i = (i + 1) & (map->size - 1);
 
-		case WEIBULL:
-			val = dist_weibull (flow, param_one, param_two );
-			DEBUG_MSG(LOG_DEBUG, "calculated weibull distribution value %f for parameters %f,%f", val, param_one, param_two);
-		break;
+	return i;
+}
 
-		case EXPONENTIAL:
-			val = dist_exponential (flow, param_one);
-			DEBUG_MSG(LOG_DEBUG, "calculated exponential distribution value %f for parameters %f", val, param_one);
-		break;
+/* Double the number of slots of @p map */
+static int size_map_grow(struct _size_map *map)
+{
+	struct _size_map old = *map;
 
-		case PARETO:
-			val = dist_pareto (flow, param_one, param_two);
-			DEBUG_MSG(LOG_DEBUG, "calculated pareto distribution value %f for parameters %f,%f", val, param_one, param_two);
-		break;
+	if (size_map_alloc(map, old.bits + 1) == -1) {
+		*map = old;
+		return -1;
+	}
 
-		case LOGNORMAL:
-			val = dist_normal (flow, param_one, param_two );
-			DEBUG_MSG(LOG_DEBUG, "calculated lognormal distribution value %f for parameters %f,%f", val, param_one, param_two);
-		break;
+	for (uint64_t i = 0; i < old.size; i++) {
+		if (!old.weights[i])
+			continue;
+		uint64_t j = size_map_slot(map, old.pairs[i]);
+		map->pairs[j] = old.pairs[i];
+		map->weights[j] = old.weights[i];
+	}
+	map->count = old.count;
+	free_all(old.pairs, old.weights);
+	return 0;
+}
 
-		case CONSTANT:
-		/* constant is default */
-		default:
-			val = param_one;
-			DEBUG_MSG(LOG_DEBUG, "constant value %f", val);
+/* Build the empirical distribution of the request and response size pairs
+ * of the trace, shared by all flows sampling it. The distinct pairs are
+ * few compared to the records, hence the table stays in cache while
+ * drawing a random record would touch a random page of the mapping. The
+ * pairs are counted in a single pass over the records, so the memory
+ * needed grows with the distinct pairs only */
+static int init_trace_sampling(struct _trace *trace, const char **error)
+{
+	struct _size_map map = {NULL, NULL, 0, 0, 0};
+	struct _alias_table *table = NULL;
+	uint64_t i, n = 0;
+
+	if (trace->size_table)
+		return 0;
+
+	table = malloc(sizeof(*table));
+	if (!table || size_map_alloc(&map, 10) == -1)
+		goto err;
+
+	for (i = 0; i < trace->num_records; i++) {
+		uint64_t pair =
+			(uint64_t)ntohl(trace->records[i].request_size) << 32 |
+			ntohl(trace->records[i].response_size);
+		uint64_t slot = size_map_slot(&map, pair);
+
+		if (!map.weights[slot]) {
+			if (map.count == TRACE_SAMPLE_MAX_PAIRS) {
+				*error = "too many distinct request and "
+					 "response sizes";
+				goto out;
+			}
+			map.pairs[slot] = pair;
+			map.count++;
+		}
+		map.weights[slot]++;
+
+		/* keep the load factor at most one half */
+		if (2 * map.count > map.size && size_map_grow(&map) == -1)
+			goto err;
+	}
 
+	/* move the used slots to the front */
+	for (i = 0; i < map.size; i++) {
+		if (!map.weights[i])
+			continue;
+		map.pairs[n] = map.pairs[i];
+		map.weights[n++] = map.weights[i];
 	}
 
-	return val;
+	if (alias_table_init(table, map.weights, n) == -1)
+		goto err;
+
+	DEBUG_MSG(LOG_NOTICE, "trace %s has %llu distinct request and "
+		  "response sizes", trace->path, (unsigned long long)n);
+
+	trace->size_pairs = realloc(map.pairs, n * sizeof(*map.pairs)) ?:
+			    map.pairs;
+	trace->size_table = table;
+	free(map.weights);
+	return 0;
 
+err:
+	*error = strerror(errno);
+out:
+	free_all(map.pairs, map.weights, table);
+	return -1;
 }
-int next_request_block_size(struct _flow *flow)
+
+/* Map the trace file of the flow (option --trace). The record of the
+ * current block determines its request and response size, the offset to
+ * the next record the gap before the next block. When sampling the trace,
+ * the sizes of each block are drawn from all records instead */
+int init_trace_replay(struct _flow *flow)
 {
-	int bs = 0;
-	int i = 0;
-	/* recalculate values to match prequisits, but at most 10 times */
-	while (( bs < MIN_BLOCK_SIZE || bs > flow->settings.maximum_block_size) && i < MAX_RUNS_PER_DISTRIBUTION) {
-
-		bs = round(calculate(
-			   flow,
-			   flow->settings.request_trafgen_options.distribution,
-			   flow->settings.request_trafgen_options.param_one,
-			   flow->settings.request_trafgen_options.param_two
-			   ));
-		i++;
-	}
+	const char *error = NULL;
 
-	/* sanity checks */
-	if (i >= MAX_RUNS_PER_DISTRIBUTION && bs < MIN_BLOCK_SIZE) {
-		bs = MIN_BLOCK_SIZE;
-		DEBUG_MSG(LOG_WARNING, "WARNING: applied minimal request size limit %d for flow %d", bs, flow->id);
+	if (!*flow->settings.trace_file)
+		return 0;
+
+	if (flow->settings.write_rate && !flow->settings.trace_sample) {
+		flow_error(flow, "Trace replay can not be combined with a "
+			   "rate");
+		return -1;
 	}
 
-	if (i >= MAX_RUNS_PER_DISTRIBUTION && bs > flow->settings.maximum_block_size) {
-		bs = flow->settings.maximum_block_size;
-		DEBUG_MSG(LOG_WARNING, "WARNING: applied maximal request size limit %d for flow %d", bs, flow->id);
+	flow->trace = trace_open(flow->settings.trace_file, &error);
+	if (!flow->trace) {
+		flow_error(flow, "Unable to map trace file %s: %s",
+			   flow->settings.trace_file, error);
+		return -1;
+	}
 
+	if (flow->settings.trace_sample &&
+	    init_trace_sampling(flow->trace, &error) == -1) {
+		flow_error(flow, "Unable to sample trace file %s: %s",
+			   flow->settings.trace_file, error);
+		return -1;
 	}
 
-	DEBUG_MSG(LOG_NOTICE, "calculated request size %d for flow %d after %d runs", bs, flow->id, i);
+	flow->trace_pos = flow->settings.trace_start *
+			  flow->trace->num_records;
+	if (flow->trace_pos >= flow->trace->num_records)
+		flow->trace_pos = 0;
+	flow->trace_replayed = 0;
+
+	return 0;
+}
+
+/* Block size of the current trace record limited to the block sizes the
+ * flow supports. A response size of zero requests no response */
+static int trace_block_size(struct _flow *flow, uint32_t size, int request)
+{
+	int bs = MIN(size, (uint32_t)flow->settings.maximum_block_size);
+
+	if ((request || bs) && bs < MIN_BLOCK_SIZE)
+		bs = MIN_BLOCK_SIZE;
+
+	return bs;
+}
+
+/* Gap between the current and the next trace record. Advances the replay
+ * to the next record, the gap at the end of the trace is zero */
+static double next_trace_gap(struct _flow *flow)
+{
+	uint64_t next = flow->trace_pos + 1;
+	double gap = 0.0;
+
+	if (next == flow->trace->num_records)
+		next = 0;
+	else
+		gap = trace_offset(flow->trace, next) -
+		      trace_offset(flow->trace, flow->trace_pos);
+
+	flow->trace_pos = next;
+	flow->trace_replayed++;
+
+	/* records of unsorted traces are sent immediately */
+	return MAX(gap, 0.0);
+}
+
+/* Request and response size of the current block of a trace. The record
+ * is drawn from the empirical distribution of the trace when sampling it */
+static int trace_request_size(struct _flow *flow)
+{
+	if (!flow->settings.trace_sample)
+		return trace_block_size(flow, ntohl(flow->trace->records
+					[flow->trace_pos].request_size), 1);
+
+	flow->trace_pos = alias_table_sample(flow, flow->trace->size_table);
+	return trace_block_size(flow,
+				flow->trace->size_pairs[flow->trace_pos] >> 32, 1);
+}
+
+static int trace_response_size(struct _flow *flow)
+{
+	if (!flow->settings.trace_sample)
+		return trace_block_size(flow, ntohl(flow->trace->records
+					[flow->trace_pos].response_size), 0);
+
+	return trace_block_size(flow,
+				(uint32_t)flow->trace->size_pairs[flow->trace_pos], 0);
+}
+
+int next_request_block_size(struct _flow *flow)
+{
+	int bs;
+
+	if (flow->trace)
+		return trace_request_size(flow);
+
+	bs = round(next_value(flow, &flow->request_sizes,
+			      &flow->settings.request_trafgen_options,
+			      MIN_BLOCK_SIZE,
+			      flow->settings.maximum_block_size));
+
+	DEBUG_MSG(LOG_NOTICE, "calculated request size %d for flow %d", bs, flow->id);
 
 	return bs;
 }
 
 int next_response_block_size(struct _flow *flow)
 {
-	int bs = round(calculate(
-			   flow,
-			   flow->settings.response_trafgen_options.distribution,
-			   flow->settings.response_trafgen_options.param_one,
-			   flow->settings.response_trafgen_options.param_two
-			   ));
+	int bs;
+
+	if (flow->trace)
+		return trace_response_size(flow);
+
+	bs = round(next_value(flow, &flow->response_sizes,
+			      &flow->settings.response_trafgen_options,
+			      0, flow->settings.maximum_block_size));
 
 	/* sanity checks */
 	if (bs && bs < MIN_BLOCK_SIZE) {
 		bs = MIN_BLOCK_SIZE;
 		DEBUG_MSG(LOG_WARNING, "applied minimal response size limit %d for flow %d", bs, flow->id);
 	}
-	if (bs > flow->settings.maximum_block_size) {
-		bs = flow->settings.maximum_block_size;
-		DEBUG_MSG(LOG_WARNING, "applied maximal response size limit %d for flow %d", bs, flow->id);
-
-	}
 
 	if (bs)
 		DEBUG_MSG(LOG_NOTICE, "calculated response size %d for flow %d", bs, flow->id);
@@ -157,17 +338,121 @@ int next_response_block_size(struct _flow *flow)
 double next_interpacket_gap(struct _flow *flow) {
 
 	double gap = 0.0;
-	if (flow->settings.write_rate)
+	if (flow->trace && !flow->settings.trace_sample)
+		gap = next_trace_gap(flow);
+	else if (flow->settings.write_rate)
 		gap = (double)1.0/flow->settings.write_rate;
 	else
-		gap = calculate(flow,
-				flow->settings.interpacket_gap_trafgen_options.distribution,
-				       flow->settings.interpacket_gap_trafgen_options.param_one,
-				       flow->settings.interpacket_gap_trafgen_options.param_two
-				      );
+		gap = next_value(flow, &flow->interpacket_gaps,
+				 &flow->settings.interpacket_gap_trafgen_options,
+				 -HUGE_VAL, HUGE_VAL);
 
 	if (gap)
 		DEBUG_MSG(LOG_NOTICE, "calculated next interpacket gap %.6fs for flow %d", gap, flow->id);
 
 	return gap;
 }
+
+/* Block generators of the flows. Most flows send blocks of constant size,
+ * without response and gap, and skip the distributions entirely */
+static int bulk_block(struct _flow *flow, int *response_size)
+{
+	*response_size = 0;
+	return flow->constant_request_size;
+}
+
+static int constant_block(struct _flow *flow, int *response_size)
+{
+	*response_size = flow->constant_response_size;
+	return flow->constant_request_size;
+}
+
+static int stochastic_block(struct _flow *flow, int *response_size)
+{
+	/* the request size selects the trace record of the response size */
+	int bs = next_request_block_size(flow);
+
+	*response_size = next_response_block_size(flow);
+	return bs;
+}
+
+static double no_gap(struct _flow *flow)
+{
+	UNUSED_ARGUMENT(flow);
+	return 0.0;
+}
+
+static double constant_gap(struct _flow *flow)
+{
+	return flow->constant_gap;
+}
+
+/* Select the block generators matching the traffic generation of the flow.
+ * Must be called once the trace of the flow is mapped */
+void select_block_generator(struct _flow *flow)
+{
+	const struct _flow_settings *settings = &flow->settings;
+
+	if (flow->trace ||
+	    settings->request_trafgen_options.distribution != CONSTANT ||
+	    settings->response_trafgen_options.distribution != CONSTANT) {
+		flow->next_block = stochastic_block;
+	} else {
+		flow->constant_request_size = next_request_block_size(flow);
+		flow->constant_response_size = next_response_block_size(flow);
+		flow->next_block = flow->constant_response_size ?
+				   constant_block : bulk_block;
+	}
+
+	/* the rate is enforced by the pacer or by the kernel */
+	if (settings->write_rate) {
+		flow->next_gap = no_gap;
+	} else if ((flow->trace && !settings->trace_sample) ||
+		   settings->interpacket_gap_trafgen_options.distribution !=
+		   CONSTANT) {
+		flow->next_gap = next_interpacket_gap;
+	} else {
+		flow->constant_gap = next_interpacket_gap(flow);
+		flow->next_gap = flow->constant_gap ? constant_gap : no_gap;
+	}
+
+	DEBUG_MSG(LOG_NOTICE, "flow %d sends %s blocks %s gap", flow->id,
+		  flow->next_block == bulk_block ? "bulk" :
+		  flow->next_block == constant_block ? "constant" :
+		  "stochastic", flow->next_gap == no_gap ? "without" :
+		  flow->next_gap == constant_gap ? "with constant" :
+		  "with stochastic");
+}
+
+double next_flow_arrival(struct _flow *flow)
+{
+	double gap = dist_sample(flow,
+			       flow->settings.flow_arrival_trafgen_options.distribution,
+			       flow->settings.flow_arrival_trafgen_options.param_one,
+			       flow->settings.flow_arrival_trafgen_options.param_two);
+
+	if (gap < 0)
+		gap = 0;
+
+	DEBUG_MSG(LOG_NOTICE, "calculated next flow arrival in %.6fs for flow %d", gap, flow->id);
+
+	return gap;
+}
+
+double next_flow_size(struct _flow *flow)
+{
+	double size = round(dist_sample(flow,
+				      flow->settings.flow_size_trafgen_options.distribution,
+				      flow->settings.flow_size_trafgen_options.param_one,
+				      flow->settings.flow_size_trafgen_options.param_two));
+
+	/* a flow carries at least one block */
+	if (size < MIN_BLOCK_SIZE) {
+		size = MIN_BLOCK_SIZE;
+		DEBUG_MSG(LOG_WARNING, "applied minimal flow size limit %d for flow %d", MIN_BLOCK_SIZE, flow->id);
+	}
+
+	DEBUG_MSG(LOG_NOTICE, "calculated flow size %.0f for flow %d", size, flow->id);
+
+	return size;
+}
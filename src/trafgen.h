@@ -27,8 +27,12 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+extern int init_trace_replay(struct _flow *);
+extern void select_block_generator(struct _flow *);
 extern int next_request_block_size(struct _flow *);
 extern int next_response_block_size(struct _flow *);
 extern double next_interpacket_gap(struct _flow *);
+extern double next_flow_arrival(struct _flow *);
+extern double next_flow_size(struct _flow *);
 
 #endif /* _TRAFGEN_H_ */